@@ -0,0 +1,642 @@
+#include "BlockCompressor.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+// The texels of a 4x4 block as values in [0, 255], in row order
+struct Block
+{
+    float texels[16][4];
+};
+
+// Weights of the BC1 palette entries, from the first endpoint to the second
+float constexpr BC1_WEIGHTS_4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+float constexpr BC1_WEIGHTS_3[3] = { 0.0f, 1.0f, 0.5f };
+
+// Weights of the BC7 palette entries for 4-bit indices, out of 64
+int constexpr BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Number of least squares refinements of the endpoints for each quality
+int refinements(CompressionQuality quality)
+{
+    switch (quality)
+    {
+    case CompressionQuality::eFast:   return 0;
+    case CompressionQuality::eNormal: return 1;
+    default:                          return 3;
+    }
+}
+
+// Copies a 4x4 block of an image. Texels beyond the right or bottom edge repeat the edge.
+void loadBlock(uint8_t const * texels, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, Block & block)
+{
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        uint32_t sy = std::min(by * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            uint32_t        sx = std::min(bx * 4 + x, width - 1);
+            uint8_t const * in = texels + ((size_t)sy * width + sx) * 4;
+            for (int c = 0; c < 4; ++c)
+            {
+                block.texels[y * 4 + x][c] = in[c];
+            }
+        }
+    }
+}
+
+float squaredDistance(float const * a, float const * b, int channels)
+{
+    float d = 0.0f;
+    for (int c = 0; c < channels; ++c)
+    {
+        d += (a[c] - b[c]) * (a[c] - b[c]);
+    }
+    return d;
+}
+
+// Finds the initial endpoints of the selected texels of a block. The fast search uses the corners of their bounding
+// box. The others use the extremes of their projections onto the principal axis, found by power iteration.
+void findEndpoints(Block const &      block,
+                   bool const *       selected,
+                   int                channels,
+                   CompressionQuality quality,
+                   float *            e0,
+                   float *            e1)
+{
+    float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float lo[4]   = { 255.0f, 255.0f, 255.0f, 255.0f };
+    float hi[4]   = { 0.0f, 0.0f, 0.0f, 0.0f };
+    int   n       = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!selected[i])
+            continue;
+        for (int c = 0; c < channels; ++c)
+        {
+            mean[c] += block.texels[i][c];
+            lo[c]    = std::min(lo[c], block.texels[i][c]);
+            hi[c]    = std::max(hi[c], block.texels[i][c]);
+        }
+        ++n;
+    }
+    if (n == 0 || quality == CompressionQuality::eFast)
+    {
+        std::copy(lo, lo + channels, e0);
+        std::copy(hi, hi + channels, e1);
+        return;
+    }
+    for (int c = 0; c < channels; ++c)
+    {
+        mean[c] /= (float)n;
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!selected[i])
+            continue;
+        for (int r = 0; r < channels; ++r)
+        {
+            for (int c = 0; c < channels; ++c)
+            {
+                covariance[r][c] += (block.texels[i][r] - mean[r]) * (block.texels[i][c] - mean[c]);
+            }
+        }
+    }
+
+    // Starting from the diagonal of the bounding box converges quickly, since it is usually close already.
+    float axis[4];
+    for (int c = 0; c < channels; ++c)
+    {
+        axis[c] = hi[c] - lo[c];
+    }
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float largest = 0.0f;
+        for (int r = 0; r < channels; ++r)
+        {
+            for (int c = 0; c < channels; ++c)
+            {
+                next[r] += covariance[r][c] * axis[c];
+            }
+            largest = std::max(largest, std::abs(next[r]));
+        }
+        if (largest == 0.0f)
+            break;
+        for (int c = 0; c < channels; ++c)
+        {
+            axis[c] = next[c] / largest;
+        }
+    }
+
+    float lengthSquared = 0.0f;
+    for (int c = 0; c < channels; ++c)
+    {
+        lengthSquared += axis[c] * axis[c];
+    }
+    if (lengthSquared == 0.0f)
+    {
+        std::copy(mean, mean + channels, e0);
+        std::copy(mean, mean + channels, e1);
+        return;
+    }
+
+    float tMin = std::numeric_limits<float>::max();
+    float tMax = -std::numeric_limits<float>::max();
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!selected[i])
+            continue;
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c)
+        {
+            t += (block.texels[i][c] - mean[c]) * axis[c];
+        }
+        t /= lengthSquared;
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < channels; ++c)
+    {
+        e0[c] = std::min(std::max(mean[c] + tMin * axis[c], 0.0f), 255.0f);
+        e1[c] = std::min(std::max(mean[c] + tMax * axis[c], 0.0f), 255.0f);
+    }
+}
+
+// Replaces the endpoints with the ones that minimize the squared error of the selected texels, given the weight of the
+// second endpoint in each texel's palette entry. The endpoints are unchanged if the weights are all the same.
+void refineEndpoints(Block const & block, bool const * selected, float const * weights, int channels, float * e0, float * e1)
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float bx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!selected[i])
+            continue;
+        float b = weights[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; ++c)
+        {
+            ax[c] += a * block.texels[i][c];
+            bx[c] += b * block.texels[i][c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f)
+        return;
+    for (int c = 0; c < channels; ++c)
+    {
+        e0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+        e1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+    }
+}
+
+uint16_t packRgb565(float const * c)
+{
+    uint32_t r = (uint32_t)(c[0] * 31.0f / 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(c[1] * 63.0f / 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(c[2] * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpackRgb565(uint16_t v, float * c)
+{
+    uint32_t r = (v >> 11) & 31;
+    uint32_t g = (v >> 5) & 63;
+    uint32_t b = v & 31;
+    c[0] = (float)((r << 3) | (r >> 2));
+    c[1] = (float)((g << 2) | (g >> 4));
+    c[2] = (float)((b << 3) | (b >> 2));
+}
+
+// An encoded BC1 color block and its squared error
+struct ColorBlock
+{
+    uint16_t c0;
+    uint16_t c1;
+    uint8_t  indices[16];
+    float    error;
+};
+
+// Encodes the colors of a block in the 4-color or 3-color mode of BC1. Texels that are not selected are transparent,
+// which is only possible in the 3-color mode.
+ColorBlock encodeColors(Block const & block, bool const * selected, bool fourColor, CompressionQuality quality)
+{
+    float const * weights = fourColor ? BC1_WEIGHTS_4 : BC1_WEIGHTS_3;
+    int const     entries = fourColor ? 4 : 3;
+
+    float e0[4], e1[4];
+    findEndpoints(block, selected, 3, quality, e0, e1);
+
+    ColorBlock best;
+    best.error = std::numeric_limits<float>::max();
+    for (int pass = 0; pass <= refinements(quality); ++pass)
+    {
+        ColorBlock candidate;
+        candidate.c0    = packRgb565(e0);
+        candidate.c1    = packRgb565(e1);
+        candidate.error = 0.0f;
+
+        float q0[3], q1[3], palette[4][3];
+        unpackRgb565(candidate.c0, q0);
+        unpackRgb565(candidate.c1, q1);
+        for (int k = 0; k < entries; ++k)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[k][c] = q0[c] + weights[k] * (q1[c] - q0[c]);
+            }
+        }
+
+        // Equal endpoints select the 3-color mode, where index 3 is transparent, so only index 0 is used.
+        int const usable = candidate.c0 == candidate.c1 ? 1 : entries;
+        float texelWeights[16];
+        for (int i = 0; i < 16; ++i)
+        {
+            texelWeights[i] = 0.0f;
+            if (!selected[i])
+            {
+                candidate.indices[i] = 3;
+                continue;
+            }
+            int   index    = 0;
+            float distance = squaredDistance(block.texels[i], palette[0], 3);
+            for (int k = 1; k < usable; ++k)
+            {
+                float d = squaredDistance(block.texels[i], palette[k], 3);
+                if (d < distance)
+                {
+                    distance = d;
+                    index    = k;
+                }
+            }
+            candidate.indices[i] = (uint8_t)index;
+            candidate.error     += distance;
+            texelWeights[i]      = weights[index];
+        }
+
+        if (candidate.error < best.error)
+            best = candidate;
+        if (best.error == 0.0f)
+            break;
+        refineEndpoints(block, selected, texelWeights, 3, e0, e1);
+    }
+    return best;
+}
+
+// Writes a BC1 color block, ordering the endpoints as its mode requires
+void writeColorBlock(ColorBlock block, bool fourColor, uint8_t * out)
+{
+    bool swap = fourColor ? block.c0 < block.c1 : block.c0 > block.c1;
+    if (swap)
+    {
+        std::swap(block.c0, block.c1);
+        for (auto & index : block.indices)
+        {
+            if (index < 2)
+                index ^= 1;
+            else if (fourColor)
+                index ^= 1; // 2 <-> 3
+        }
+    }
+
+    uint32_t indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        indices |= (uint32_t)block.indices[i] << (i * 2);
+    }
+    out[0] = (uint8_t)block.c0;
+    out[1] = (uint8_t)(block.c0 >> 8);
+    out[2] = (uint8_t)block.c1;
+    out[3] = (uint8_t)(block.c1 >> 8);
+    memcpy(out + 4, &indices, sizeof(indices)); // Little-endian hosts only, as with the rest of the caches
+}
+
+// Encodes a block as BC1. Texels with alpha below 128 are transparent if `alpha` is set. Opaque blocks use the 4-color
+// mode, or at the best quality whichever mode has the smaller error.
+void encodeBc1(Block const & block, CompressionQuality quality, bool alpha, uint8_t * out)
+{
+    bool selected[16];
+    bool transparent = false;
+    for (int i = 0; i < 16; ++i)
+    {
+        selected[i]  = !alpha || block.texels[i][3] >= 128.0f;
+        transparent |= !selected[i];
+    }
+
+    if (transparent)
+    {
+        writeColorBlock(encodeColors(block, selected, false, quality), false, out);
+        return;
+    }
+
+    ColorBlock fourColor = encodeColors(block, selected, true, quality);
+    if (quality == CompressionQuality::eBest && fourColor.error > 0.0f)
+    {
+        ColorBlock threeColor = encodeColors(block, selected, false, quality);
+        if (threeColor.error < fourColor.error)
+        {
+            writeColorBlock(threeColor, false, out);
+            return;
+        }
+    }
+    writeColorBlock(fourColor, true, out);
+}
+
+// Encodes the alpha of a block as a BC4 block, using the 8-value mode between the smallest and largest alpha
+void encodeAlpha(Block const & block, uint8_t * out)
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        lo = std::min(lo, (int)block.texels[i][3]);
+        hi = std::max(hi, (int)block.texels[i][3]);
+    }
+
+    // Palette entry k of the 8-value mode is ((8 - k) * a0 + (k - 1) * a1) / 7 for k >= 2, in the order
+    // a0, a1, then from a0 to a1.
+    float palette[8] = { (float)hi, (float)lo };
+    for (int k = 2; k < 8; ++k)
+    {
+        palette[k] = ((8 - k) * hi + (k - 1) * lo) / 7.0f;
+    }
+
+    uint64_t indices = 0;
+    if (hi > lo)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            int   index    = 0;
+            float distance = std::abs(block.texels[i][3] - palette[0]);
+            for (int k = 1; k < 8; ++k)
+            {
+                float d = std::abs(block.texels[i][3] - palette[k]);
+                if (d < distance)
+                {
+                    distance = d;
+                    index    = k;
+                }
+            }
+            indices |= (uint64_t)index << (i * 3);
+        }
+    }
+
+    out[0] = (uint8_t)hi;
+    out[1] = (uint8_t)lo;
+    for (int b = 0; b < 6; ++b)
+    {
+        out[2 + b] = (uint8_t)(indices >> (b * 8));
+    }
+}
+
+void encodeBc3(Block const & block, CompressionQuality quality, uint8_t * out)
+{
+    encodeAlpha(block, out);
+
+    // The color half of a BC3 block is always decoded in the 4-color mode.
+    bool selected[16];
+    std::fill(selected, selected + 16, true);
+    writeColorBlock(encodeColors(block, selected, true, quality), true, out + 8);
+}
+
+// Writes the bits of a BC7 block from the least significant bit up
+struct BitWriter
+{
+    uint8_t * out;
+    int       position = 0;
+
+    void write(uint32_t value, int bits)
+    {
+        for (int b = 0; b < bits; ++b, ++position)
+        {
+            if (value & (1u << b))
+                out[position / 8] |= (uint8_t)(1u << (position % 8));
+        }
+    }
+};
+
+// A quantized BC7 mode 6 endpoint: seven bits per channel and a shared lowest bit
+struct Bc7Endpoint
+{
+    uint32_t channels[4];
+    uint32_t p;
+
+    int value(int c) const { return (int)(channels[c] << 1 | p); }
+};
+
+Bc7Endpoint quantizeBc7(float const * e)
+{
+    Bc7Endpoint best      = {};
+    float       bestError = std::numeric_limits<float>::max();
+    for (uint32_t p = 0; p < 2; ++p)
+    {
+        Bc7Endpoint candidate;
+        candidate.p = p;
+        float error = 0.0f;
+        for (int c = 0; c < 4; ++c)
+        {
+            int q = (int)std::floor((e[c] - (float)p) * 0.5f + 0.5f);
+            candidate.channels[c] = (uint32_t)std::min(std::max(q, 0), 127);
+            float d = (float)candidate.value(c) - e[c];
+            error += d * d;
+        }
+        if (error < bestError)
+        {
+            bestError = error;
+            best      = candidate;
+        }
+    }
+    return best;
+}
+
+// Encodes a block as BC7 mode 6, which has a single subset of RGBA endpoints and 4-bit indices
+void encodeBc7(Block const & block, CompressionQuality quality, uint8_t * out)
+{
+    bool selected[16];
+    std::fill(selected, selected + 16, true);
+
+    float e0[4], e1[4];
+    findEndpoints(block, selected, 4, quality, e0, e1);
+
+    Bc7Endpoint best0 = {}, best1 = {};
+    uint8_t     bestIndices[16] = {};
+    float       bestError       = std::numeric_limits<float>::max();
+    for (int pass = 0; pass <= refinements(quality); ++pass)
+    {
+        Bc7Endpoint q0 = quantizeBc7(e0);
+        Bc7Endpoint q1 = quantizeBc7(e1);
+
+        float palette[16][4];
+        for (int k = 0; k < 16; ++k)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                palette[k][c] = (float)(((64 - BC7_WEIGHTS[k]) * q0.value(c) + BC7_WEIGHTS[k] * q1.value(c) + 32) >> 6);
+            }
+        }
+
+        uint8_t indices[16];
+        float   texelWeights[16];
+        float   error = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            int   index    = 0;
+            float distance = squaredDistance(block.texels[i], palette[0], 4);
+            for (int k = 1; k < 16; ++k)
+            {
+                float d = squaredDistance(block.texels[i], palette[k], 4);
+                if (d < distance)
+                {
+                    distance = d;
+                    index    = k;
+                }
+            }
+            indices[i]       = (uint8_t)index;
+            texelWeights[i]  = BC7_WEIGHTS[index] / 64.0f;
+            error           += distance;
+        }
+
+        if (error < bestError)
+        {
+            bestError = error;
+            best0     = q0;
+            best1     = q1;
+            std::copy(indices, indices + 16, bestIndices);
+        }
+        if (bestError == 0.0f)
+            break;
+        refineEndpoints(block, selected, texelWeights, 4, e0, e1);
+    }
+
+    // The highest bit of the first index is implied to be 0, so if it is set, the endpoints are swapped.
+    if (bestIndices[0] & 8)
+    {
+        std::swap(best0, best1);
+        for (auto & index : bestIndices)
+        {
+            index = (uint8_t)(15 - index);
+        }
+    }
+
+    memset(out, 0, 16);
+    BitWriter bits = { out };
+    bits.write(1 << 6, 7);  // Mode 6
+    for (int c = 0; c < 4; ++c)
+    {
+        bits.write(best0.channels[c], 7);
+        bits.write(best1.channels[c], 7);
+    }
+    bits.write(best0.p, 1);
+    bits.write(best1.p, 1);
+    bits.write(bestIndices[0], 3);
+    for (int i = 1; i < 16; ++i)
+    {
+        bits.write(bestIndices[i], 4);
+    }
+}
+
+size_t blockBytes(TextureFormat format)
+{
+    return format == TextureFormat::eBC1 ? 8 : 16;
+}
+
+void compressLevel(uint8_t const *    texels,
+                   uint32_t           width,
+                   uint32_t           height,
+                   TextureFormat      format,
+                   CompressionQuality quality,
+                   unsigned           threads,
+                   uint8_t *          out)
+{
+    uint32_t const blocksWide = (width + 3) / 4;
+    uint32_t const blocksHigh = (height + 3) / 4;
+    size_t const   size       = blockBytes(format);
+    parallelForRanges(blocksHigh, threads, [&] (size_t begin, size_t end) {
+        Block block;
+        for (size_t by = begin; by < end; ++by)
+        {
+            for (uint32_t bx = 0; bx < blocksWide; ++bx)
+            {
+                loadBlock(texels, width, height, bx, (uint32_t)by, block);
+                uint8_t * blockOut = out + (by * blocksWide + bx) * size;
+                switch (format)
+                {
+                case TextureFormat::eBC1: encodeBc1(block, quality, true, blockOut); break;
+                case TextureFormat::eBC3: encodeBc3(block, quality, blockOut);       break;
+                default:                  encodeBc7(block, quality, blockOut);       break;
+                }
+            }
+        }
+    });
+}
+} // anonymous namespace
+
+size_t textureSize(TextureFormat format, uint32_t width, uint32_t height)
+{
+    if (format == TextureFormat::eRGBA8)
+        return (size_t)width * height * 4;
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+bool hasTransparency(uint8_t const * texels, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (texels[i * 4 + 3] != 255)
+            return true;
+    }
+    return false;
+}
+
+std::vector<MipLevel> compressedLevels(std::vector<MipLevel> const & levels, TextureFormat format, size_t * size)
+{
+    std::vector<MipLevel> compressed;
+    size_t                total = 0;
+    for (auto const & level : levels)
+    {
+        compressed.push_back({ total, level.width, level.height });
+        total += textureSize(format, level.width, level.height);
+    }
+    *size = total;
+    return compressed;
+}
+
+void compressMipChain(uint8_t const *              texels,
+                      std::vector<MipLevel> const & levels,
+                      TextureFormat                format,
+                      CompressionQuality           quality,
+                      unsigned                     threads,
+                      uint8_t *                    out)
+{
+    size_t                size;
+    std::vector<MipLevel> compressed = compressedLevels(levels, format, &size);
+    if (format == TextureFormat::eRGBA8)
+    {
+        memcpy(out, texels, size);
+        return;
+    }
+
+    for (size_t l = 0; l < levels.size(); ++l)
+    {
+        compressLevel(texels + levels[l].offset,
+                      levels[l].width,
+                      levels[l].height,
+                      format,
+                      quality,
+                      threads,
+                      out + compressed[l].offset);
+    }
+}
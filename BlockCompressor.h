@@ -0,0 +1,49 @@
+#if !defined(BLOCKCOMPRESSOR_H)
+#define BLOCKCOMPRESSOR_H
+
+#pragma once
+
+#include "MipGenerator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The formats a texture can be stored in
+enum class TextureFormat : uint32_t
+{
+    eRGBA8 = 0,     // Uncompressed, 4 bytes per texel
+    eBC1   = 1,     // RGB with 1-bit alpha, 8 bytes per 4x4 block
+    eBC3   = 2,     // RGB with interpolated alpha, 16 bytes per 4x4 block
+    eBC7   = 3      // RGBA, 16 bytes per 4x4 block, using mode 6 (one subset with 4-bit indices)
+};
+
+// How hard the encoder searches for the best endpoints of a block
+enum class CompressionQuality : uint32_t
+{
+    eFast   = 0,    // The corners of the block's bounding box
+    eNormal = 1,    // The extremes along the principal axis, refined once by least squares
+    eBest   = 2     // As eNormal, refined three times, and for BC1 also trying the 3-color mode on opaque blocks
+};
+
+// Returns the size in bytes of an image in the given format. Block-compressed images are padded to whole blocks.
+size_t textureSize(TextureFormat format, uint32_t width, uint32_t height);
+
+// Returns true if any texel is not fully opaque
+bool hasTransparency(uint8_t const * texels, size_t count);
+
+// Returns the levels of a mip chain stored in the given format, one level after the other, and the size of the whole
+// chain in bytes
+std::vector<MipLevel> compressedLevels(std::vector<MipLevel> const & levels, TextureFormat format, size_t * size);
+
+// Compresses each level of an RGBA8 mip chain into the given format, writing them to `out` as laid out by
+// compressedLevels. The rows of blocks are spread across `threads` threads (0 means one per hardware thread). The color
+// channels are encoded as they are, without conversion. With BC1, texels with alpha below 128 become transparent black.
+void compressMipChain(uint8_t const *              texels,
+                      std::vector<MipLevel> const & levels,
+                      TextureFormat                format,
+                      CompressionQuality           quality,
+                      unsigned                     threads,
+                      uint8_t *                    out);
+
+#endif // !defined(BLOCKCOMPRESSOR_H)
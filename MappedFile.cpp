@@ -0,0 +1,182 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile && rhs) noexcept
+{
+    *this = std::move(rhs);
+}
+
+MappedFile & MappedFile::operator =(MappedFile && rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        close();
+        std::swap(data_, rhs.data_);
+        std::swap(size_, rhs.size_);
+        std::swap(open_, rhs.open_);
+#if defined(_WIN32)
+        std::swap(file_, rhs.file_);
+        std::swap(mapping_, rhs.mapping_);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(char const * path)
+{
+    close();
+
+    HANDLE file = CreateFileA(path,
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    file_ = file;
+    size_ = (size_t)size.QuadPart;
+    open_ = true;
+
+    // A zero-length file cannot be mapped, but it is still a valid (empty) file.
+    if (size_ == 0)
+        return true;
+
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_)
+        data_ = (char const *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (!data_)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_)
+        CloseHandle(file_);
+    data_    = nullptr;
+    mapping_ = nullptr;
+    file_    = nullptr;
+    size_    = 0;
+    open_    = false;
+}
+
+#else // if defined(_WIN32)
+
+bool MappedFile::open(char const * path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_ = (size_t)info.st_size;
+    open_ = true;
+
+    // A zero-length file cannot be mapped, but it is still a valid (empty) file.
+    if (size_ > 0)
+    {
+        void * data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            ::close(fd);
+            size_ = 0;
+            open_ = false;
+            return false;
+        }
+        data_ = (char const *)data;
+    }
+
+    // The mapping remains valid after the descriptor is closed.
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data_)
+        munmap((void *)data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+#endif // if defined(_WIN32)
+
+bool replaceFile(char const * path, std::initializer_list<FileChunk> chunks)
+{
+    std::string temporary = std::string(path) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        for (FileChunk const & chunk : chunks)
+        {
+            file.write(static_cast<char const *>(chunk.data), (std::streamsize)chunk.size);
+        }
+        if (!file)
+        {
+            file.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    // rename() replaces an existing file atomically on POSIX systems, but fails on Windows, where MoveFileEx() is
+    // used instead.
+#if defined(_WIN32)
+    bool renamed = MoveFileExA(temporary.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = std::rename(temporary.c_str(), path) == 0;
+#endif
+    if (!renamed)
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#if !defined(MAPPEDFILE_H)
+#define MAPPEDFILE_H
+
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+
+// A read-only view of an entire file mapped into memory. The mapping is released when the object is destroyed.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile && rhs) noexcept;
+    MappedFile & operator =(MappedFile && rhs) noexcept;
+    MappedFile(MappedFile const &) = delete;
+    MappedFile & operator =(MappedFile const &) = delete;
+    ~MappedFile();
+
+    // Maps the file. Returns false if the file cannot be opened or mapped. An empty file is opened but not mapped.
+    bool open(char const * path);
+
+    // Unmaps the file
+    void close();
+
+    // Returns true if a file is open
+    bool isOpen() const { return open_; }
+
+    // Returns the start of the mapped contents
+    char const * data() const { return data_; }
+
+    // Returns the size of the file in bytes
+    size_t size() const { return size_; }
+
+private:
+    char const * data_ = nullptr;
+    size_t size_       = 0;
+    bool open_         = false;
+#if defined(_WIN32)
+    void * file_    = nullptr;
+    void * mapping_ = nullptr;
+#endif
+};
+
+// A piece of the contents of a file to write
+struct FileChunk
+{
+    void const * data;
+    size_t       size;
+};
+
+// Writes the chunks in order to a file under a temporary name, and then replaces the file at `path` with it, so the
+// file at `path` is always either the old one or the complete new one. Returns false if the file cannot be written.
+bool replaceFile(char const * path, std::initializer_list<FileChunk> chunks);
+
+#endif // !defined(MAPPEDFILE_H)
@@ -0,0 +1,227 @@
+#include "MeshCache.h"
+
+#include <cstring>
+
+namespace
+{
+char constexpr MAGIC[8] = { 'V', 'K', 'T', 'M', 'E', 'S', 'H', '\0' };
+size_t constexpr ALIGNMENT = 16;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    MeshCache::Key key;
+};
+
+struct SectionEntry
+{
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+size_t alignUp(size_t x)
+{
+    return (x + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+bool operator ==(MeshCache::Key const & a, MeshCache::Key const & b)
+{
+    return a.sourceHash == b.sourceHash &&
+           a.sourceSize == b.sourceSize &&
+           a.dependencyHash == b.dependencyHash &&
+           a.vertexSize == b.vertexSize &&
+           a.options == b.options;
+}
+} // anonymous namespace
+
+void MeshCache::Builder::add(Section id, void const * data, size_t size)
+{
+    char const * bytes = static_cast<char const *>(data);
+    sections_.push_back({ id, std::vector<char>(bytes, bytes + size) });
+}
+
+std::vector<char> MeshCache::Builder::finish() const
+{
+    size_t tableOffset = sizeof(Header);
+    size_t offset      = alignUp(tableOffset + sections_.size() * sizeof(SectionEntry));
+
+    std::vector<SectionEntry> table;
+    table.reserve(sections_.size());
+    for (auto const & s : sections_)
+    {
+        table.push_back({ (uint32_t)s.id, 0, offset, s.data.size() });
+        offset = alignUp(offset + s.data.size());
+    }
+
+    std::vector<char> image(offset, 0);
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version      = VERSION;
+    header.sectionCount = (uint32_t)sections_.size();
+    header.key          = key_;
+    memcpy(image.data(), &header, sizeof(header));
+    if (!table.empty())
+        memcpy(image.data() + tableOffset, table.data(), table.size() * sizeof(SectionEntry));
+
+    for (size_t i = 0; i < sections_.size(); ++i)
+    {
+        if (!sections_[i].data.empty())
+            memcpy(image.data() + table[i].offset, sections_[i].data.data(), sections_[i].data.size());
+    }
+
+    return image;
+}
+
+std::string MeshCache::pathFor(char const * sourcePath)
+{
+    return std::string(sourcePath) + ".meshcache";
+}
+
+bool MeshCache::keyFor(char const *                     sourcePath,
+                       std::vector<std::string> const & dependencies,
+                       uint32_t                         vertexSize,
+                       uint32_t                         options,
+                       Key &                            key)
+{
+    MappedFile source;
+    if (!source.open(sourcePath))
+        return false;
+
+    // The hash and size of each dependency, in order, are hashed together. A missing file has a size of ~0.
+    std::vector<uint64_t> dependencyHashes;
+    for (auto const & path : dependencies)
+    {
+        MappedFile dependency;
+        bool       found = dependency.open(path.c_str());
+        dependencyHashes.push_back(found ? hash(dependency.data(), dependency.size()) : 0);
+        dependencyHashes.push_back(found ? (uint64_t)dependency.size() : ~0ull);
+    }
+
+    key.sourceHash     = hash(source.data(), source.size());
+    key.sourceSize     = source.size();
+    key.dependencyHash = hash(dependencyHashes.data(), dependencyHashes.size() * sizeof(uint64_t));
+    key.vertexSize     = vertexSize;
+    key.options        = options;
+    return true;
+}
+
+uint64_t MeshCache::hash(void const * data, size_t size)
+{
+    // FNV-1a, consuming 8 bytes per step with an extra shift to mix the high bits back down. This is only used to
+    // detect a changed source, so it favors speed over quality.
+    uint64_t constexpr PRIME = 0x100000001b3ull;
+    uint64_t h = 0xcbf29ce484222325ull ^ (uint64_t)size;
+
+    char const * p   = static_cast<char const *>(data);
+    char const * end = p + size;
+    while (end - p >= 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h  = (h ^ w) * PRIME;
+        h ^= h >> 32;
+        p += 8;
+    }
+    while (p < end)
+    {
+        h = (h ^ (uint8_t)*p) * PRIME;
+        ++p;
+    }
+    return h;
+}
+
+bool MeshCache::write(char const * path, std::vector<char> const & image)
+{
+    return replaceFile(path, { { image.data(), image.size() } });
+}
+
+bool MeshCache::open(char const * path, Key const & key)
+{
+    close();
+
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    if (!validate(file.data(), file.size(), key))
+        return false;
+
+    file_  = std::move(file);
+    image_ = file_.data();
+    size_  = file_.size();
+    return true;
+}
+
+bool MeshCache::assign(std::vector<char> && image, Key const & key)
+{
+    close();
+
+    if (!validate(image.data(), image.size(), key))
+        return false;
+
+    memory_ = std::move(image);
+    image_  = memory_.data();
+    size_   = memory_.size();
+    return true;
+}
+
+void MeshCache::close()
+{
+    file_.close();
+    memory_.clear();
+    memory_.shrink_to_fit();
+    image_ = nullptr;
+    size_  = 0;
+}
+
+void const * MeshCache::section(Section id, size_t * size) const
+{
+    *size = 0;
+    if (!image_)
+        return nullptr;
+
+    Header const * header = reinterpret_cast<Header const *>(image_);
+    SectionEntry const * table = reinterpret_cast<SectionEntry const *>(image_ + sizeof(Header));
+    for (uint32_t i = 0; i < header->sectionCount; ++i)
+    {
+        if (table[i].id == (uint32_t)id)
+        {
+            *size = (size_t)table[i].size;
+            return image_ + table[i].offset;
+        }
+    }
+    return nullptr;
+}
+
+bool MeshCache::validate(char const * image, size_t size, Key const & key)
+{
+    if (size < sizeof(Header))
+        return false;
+
+    Header header;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || !(header.key == key))
+        return false;
+
+    size_t tableEnd = sizeof(Header) + (size_t)header.sectionCount * sizeof(SectionEntry);
+    if (tableEnd > size)
+        return false;
+
+    // Every section must lie within the image and be aligned so that its contents can be accessed in place.
+    SectionEntry const * table = reinterpret_cast<SectionEntry const *>(image + sizeof(Header));
+    for (uint32_t i = 0; i < header.sectionCount; ++i)
+    {
+        if (table[i].offset % ALIGNMENT != 0 ||
+            table[i].offset < tableEnd ||
+            table[i].offset > size ||
+            table[i].size > size - table[i].offset)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,175 @@
+#if !defined(MESHCACHE_H)
+#define MESHCACHE_H
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A versioned binary image of a fully processed mesh, stored next to its source file.
+//
+// The image is a header followed by a table of sections, each holding one array exactly as it is uploaded to the
+// GPU. A cache is only used if its key matches the current source file and settings, and it is memory-mapped so the
+// arrays can be copied straight into staging buffers without any parsing. The image is in native byte order.
+class MeshCache
+{
+public:
+    // Increment this whenever the layout or the contents of any section changes.
+    static uint32_t constexpr VERSION = 8;
+
+    // Identifies the arrays stored in a cache
+    enum class Section : uint32_t
+    {
+        eVertices       = 1,    // Vertex array
+        eIndices        = 2,    // Index array (uint16_t or uint32_t, as described by eDrawRanges)
+        eBounds         = 3,    // Bounds
+        eDequantization = 4,    // Dequantization
+        eDrawRanges     = 5,    // DrawRange array
+        eMeshlets       = 6,    // Meshlet array
+        eLods           = 7,    // Lod array, from the most detailed
+        eTextures       = 8     // Texture paths, each terminated by '\0', indexed by DrawRange::texture
+    };
+
+    // Axis-aligned bounds of the vertex positions
+    struct Bounds
+    {
+        float min[3];
+        float max[3];
+    };
+
+    // Restores quantized vertex attributes: value = quantized * scale + offset, where a quantized value is in [0, 1]
+    struct Dequantization
+    {
+        float positionScale[3];
+        float positionOffset[3];
+        float texCoordScale[2];
+        float texCoordOffset[2];
+    };
+
+    // A range of the index array that is drawn with one command. All of its triangles use the same texture.
+    struct DrawRange
+    {
+        uint32_t offset;        // Offset of the first index in bytes
+        uint32_t count;         // Number of indices
+        int32_t  vertexOffset;  // Added to each index
+        uint32_t indexSize;     // Size of each index in bytes (2 or 4)
+        uint32_t firstMeshlet;  // The range's meshlets
+        uint32_t meshletCount;
+        uint32_t texture;       // Index into eTextures
+    };
+
+    // A cluster of triangles that is culled as a unit, in the layout read by the culling shader
+    struct Meshlet
+    {
+        float    center[3];     // Bounding sphere
+        float    radius;
+        float    coneAxis[3];   // Normal cone (see buildMeshlets)
+        float    coneCutoff;
+        uint32_t firstIndex;    // Relative to the start of the draw range
+        uint32_t indexCount;
+        int32_t  vertexOffset;
+        uint32_t padding;
+    };
+
+    // A level of detail, which is a set of draw ranges and their meshlets. The draw ranges are sorted by texture.
+    struct Lod
+    {
+        uint32_t firstDrawRange;
+        uint32_t drawRangeCount;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t triangleCount;
+        float    error;         // Largest distance from the full detail mesh, in model units
+    };
+
+    // Identifies the source file and the settings that a cache was built from
+    struct Key
+    {
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+        uint64_t dependencyHash;    // Hash of the other files the contents come from (see keyFor)
+        uint32_t vertexSize;
+        uint32_t options;   // Application-defined bits for settings that change the contents
+    };
+
+    // Assembles a cache image in memory
+    class Builder
+    {
+    public:
+        explicit Builder(Key const & key) : key_(key) {}
+
+        // Adds a section. The data is copied.
+        void add(Section id, void const * data, size_t size);
+
+        // Returns the finished image
+        std::vector<char> finish() const;
+
+    private:
+        struct Entry
+        {
+            Section id;
+            std::vector<char> data;
+        };
+
+        Key key_;
+        std::vector<Entry> sections_;
+    };
+
+    // Returns the path of the cache for the given source file
+    static std::string pathFor(char const * sourcePath);
+
+    // Computes the key for a source file and the other files its contents come from, such as an OBJ file's material
+    // libraries. A dependency that cannot be read is hashed as missing, so the key changes if it appears. Returns false
+    // if the source cannot be read.
+    static bool keyFor(char const *                     sourcePath,
+                       std::vector<std::string> const & dependencies,
+                       uint32_t                         vertexSize,
+                       uint32_t                         options,
+                       Key &                            key);
+
+    // Returns a 64-bit hash of the data
+    static uint64_t hash(void const * data, size_t size);
+
+    // Writes an image to a file with replaceFile(), so a partially written cache is never seen. Returns false if the
+    // file could not be written.
+    static bool write(char const * path, std::vector<char> const & image);
+
+    // Maps the cache file. Returns false if it does not exist, is malformed, or does not match the key.
+    bool open(char const * path, Key const & key);
+
+    // Takes ownership of an image built in memory. Returns false if it is malformed or does not match the key.
+    bool assign(std::vector<char> && image, Key const & key);
+
+    // Releases the image
+    void close();
+
+    // Returns true if an image is loaded
+    bool isOpen() const { return image_ != nullptr; }
+
+    // Returns the contents of a section and its size in bytes, or nullptr if the section is not present
+    void const * section(Section id, size_t * size) const;
+
+    // Returns the contents of a section as an array of T and the number of elements
+    template <typename T>
+    T const * array(Section id, size_t * count) const
+    {
+        size_t size = 0;
+        T const * data = static_cast<T const *>(section(id, &size));
+        *count = size / sizeof(T);
+        return data;
+    }
+
+private:
+    bool validate(char const * image, size_t size, Key const & key);
+
+    MappedFile file_;
+    std::vector<char> memory_;
+    char const * image_ = nullptr;
+    size_t size_        = 0;
+};
+
+#endif // !defined(MESHCACHE_H)
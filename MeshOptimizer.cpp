@@ -0,0 +1,696 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+// For each vertex, the list of triangles that use it
+struct Adjacency
+{
+    std::vector<uint32_t> offsets;   // offsets[v] .. offsets[v + 1] is the range of v's triangles
+    std::vector<uint32_t> triangles;
+
+    Adjacency(uint32_t const * indices, size_t indexCount, size_t vertexCount)
+        : offsets(vertexCount + 1, 0)
+        , triangles(indexCount)
+    {
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            ++offsets[indices[i] + 1];
+        }
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            offsets[v + 1] += offsets[v];
+        }
+
+        std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            triangles[next[indices[i]]++] = (uint32_t)(i / 3);
+        }
+    }
+};
+
+// Returns the position of a vertex
+float const * position(void const * positions, size_t stride, uint32_t v)
+{
+    return reinterpret_cast<float const *>(static_cast<char const *>(positions) + v * stride);
+}
+
+// Computes the normal of a triangle, scaled by twice its area
+void triangleNormal(float const * p0, float const * p1, float const * p2, float n[3])
+{
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Computes the bounding sphere and normal cone of a meshlet
+void computeMeshletBounds(Meshlet &                     meshlet,
+                          uint32_t const *              indices,
+                          void const *                  positions,
+                          size_t                        stride,
+                          std::vector<uint32_t> const & vertices)
+{
+    // The sphere is centered on the center of the bounding box, which is not minimal but is close enough.
+    float minimum[3] = { INFINITY, INFINITY, INFINITY };
+    float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t v : vertices)
+    {
+        float const * p = position(positions, stride, v);
+        for (int k = 0; k < 3; ++k)
+        {
+            minimum[k] = std::min(minimum[k], p[k]);
+            maximum[k] = std::max(maximum[k], p[k]);
+        }
+    }
+    float radius2 = 0.0f;
+    for (int k = 0; k < 3; ++k)
+    {
+        meshlet.center[k] = (minimum[k] + maximum[k]) * 0.5f;
+    }
+    for (uint32_t v : vertices)
+    {
+        float const * p = position(positions, stride, v);
+        float dx = p[0] - meshlet.center[0];
+        float dy = p[1] - meshlet.center[1];
+        float dz = p[2] - meshlet.center[2];
+        radius2 = std::max(radius2, dx * dx + dy * dy + dz * dz);
+    }
+    meshlet.radius = std::sqrt(radius2);
+
+    // The axis of the cone is the average of the triangle normals, and its spread is the largest angle between the
+    // axis and any normal. Degenerate triangles are never visible, so they are ignored.
+    std::vector<float> normals;
+    normals.reserve(meshlet.indexCount);
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t i = meshlet.firstIndex; i + 2 < meshlet.firstIndex + meshlet.indexCount; i += 3)
+    {
+        float n[3];
+        triangleNormal(position(positions, stride, indices[i + 0]),
+                       position(positions, stride, indices[i + 1]),
+                       position(positions, stride, indices[i + 2]),
+                       n);
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0f)
+            continue;
+        for (int k = 0; k < 3; ++k)
+        {
+            normals.push_back(n[k] / length);
+            axis[k] += n[k] / length;
+        }
+    }
+
+    meshlet.coneAxis[0] = 0.0f;
+    meshlet.coneAxis[1] = 0.0f;
+    meshlet.coneAxis[2] = 0.0f;
+    meshlet.coneCutoff  = 1.0f;
+
+    float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (length == 0.0f)
+        return;
+    for (int k = 0; k < 3; ++k)
+    {
+        axis[k] /= length;
+    }
+
+    float minimumDot = 1.0f;
+    for (size_t n = 0; n < normals.size(); n += 3)
+    {
+        minimumDot = std::min(minimumDot, normals[n] * axis[0] + normals[n + 1] * axis[1] + normals[n + 2] * axis[2]);
+    }
+
+    // If the normals spread by 90 degrees or more, some triangle faces every viewpoint.
+    if (minimumDot <= 0.0f)
+        return;
+
+    // Every triangle faces away if the direction to the viewpoint is more than 90 degrees plus the spread from the
+    // axis, so the cutoff is cos(90 - spread) = sin(spread).
+    meshlet.coneAxis[0] = axis[0];
+    meshlet.coneAxis[1] = axis[1];
+    meshlet.coneAxis[2] = axis[2];
+    meshlet.coneCutoff  = std::sqrt(1.0f - minimumDot * minimumDot);
+}
+
+// A symmetric 4x4 matrix Q such that p^T Q p is the sum of the squared distances from p to a set of planes
+struct Quadric
+{
+    double aa, ab, ac, ad, bb, bc, bd, cc, cd, dd;
+
+    // Adds the plane ax + by + cz + d = 0, where (a, b, c) is a unit vector
+    void addPlane(double a, double b, double c, double d)
+    {
+        aa += a * a; ab += a * b; ac += a * c; ad += a * d;
+        bb += b * b; bc += b * c; bd += b * d;
+        cc += c * c; cd += c * d;
+        dd += d * d;
+    }
+
+    void add(Quadric const & q)
+    {
+        aa += q.aa; ab += q.ab; ac += q.ac; ad += q.ad;
+        bb += q.bb; bc += q.bc; bd += q.bd;
+        cc += q.cc; cd += q.cd;
+        dd += q.dd;
+    }
+
+    double evaluate(float const * p) const
+    {
+        double x = p[0];
+        double y = p[1];
+        double z = p[2];
+        return aa * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+             + bb * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+             + cc * z * z + 2.0 * cd * z
+             + dd;
+    }
+};
+
+// Returns the vertices that must not be moved by simplification: those on an edge that is not shared by exactly two
+// triangles with opposite windings, which includes borders and attribute seams, and those that share their position
+// with another vertex.
+std::vector<bool> findLockedVertices(uint32_t const * indices,
+                                     size_t           indexCount,
+                                     void const *     positions,
+                                     size_t           stride,
+                                     size_t           vertexCount)
+{
+    std::vector<bool> locked(vertexCount, false);
+
+    std::vector<uint64_t> edges;
+    edges.reserve(indexCount);
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            uint64_t a = indices[i + k];
+            uint64_t b = indices[i + (k + 1) % 3];
+            edges.push_back((a << 32) | b);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for (size_t e = 0; e < edges.size(); ++e)
+    {
+        uint64_t edge = edges[e];
+        uint64_t twin = (edge << 32) | (edge >> 32);
+        bool     single = (e == 0 || edges[e - 1] != edge) && (e + 1 == edges.size() || edges[e + 1] != edge);
+        auto     range  = std::equal_range(edges.begin(), edges.end(), twin);
+        if (!single || range.second - range.first != 1)
+        {
+            locked[edge >> 32]        = true;
+            locked[edge & 0xffffffff] = true;
+        }
+    }
+
+    // Vertices with the same position are found by sorting them by position.
+    std::vector<uint32_t> order(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        order[v] = (uint32_t)v;
+    }
+    auto samePosition = [&] (uint32_t a, uint32_t b) {
+        return memcmp(position(positions, stride, a), position(positions, stride, b), 3 * sizeof(float)) == 0;
+    };
+    std::sort(order.begin(), order.end(), [&] (uint32_t a, uint32_t b) {
+        return memcmp(position(positions, stride, a), position(positions, stride, b), 3 * sizeof(float)) < 0;
+    });
+    for (size_t i = 1; i < vertexCount; ++i)
+    {
+        if (samePosition(order[i - 1], order[i]))
+        {
+            locked[order[i - 1]] = true;
+            locked[order[i]]     = true;
+        }
+    }
+
+    return locked;
+}
+
+// Returns true if moving `from` onto `to` would flip or collapse any of the remaining triangles around `from`
+bool collapseFlips(uint32_t const *  indices,
+                   Adjacency const & adjacency,
+                   void const *      positions,
+                   size_t            stride,
+                   uint32_t          from,
+                   uint32_t          to)
+{
+    for (uint32_t a = adjacency.offsets[from]; a < adjacency.offsets[from + 1]; ++a)
+    {
+        uint32_t const * triangle = indices + (size_t)adjacency.triangles[a] * 3;
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue;   // This triangle is removed by the collapse
+
+        float const * p[3];
+        float const * moved[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            p[k]     = position(positions, stride, triangle[k]);
+            moved[k] = triangle[k] == from ? position(positions, stride, to) : p[k];
+        }
+
+        float before[3];
+        float after[3];
+        triangleNormal(p[0], p[1], p[2], before);
+        triangleNormal(moved[0], moved[1], moved[2], after);
+        float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+        if (dot <= 0.0f && (before[0] != 0.0f || before[1] != 0.0f || before[2] != 0.0f))
+            return true;
+    }
+    return false;
+}
+} // anonymous namespace
+
+VertexCacheStatistics analyzeVertexCache(uint32_t const * indices,
+                                         size_t           indexCount,
+                                         size_t           vertexCount,
+                                         unsigned         cacheSize)
+{
+    // A vertex is in the cache if it was added within the last `cacheSize` additions.
+    std::vector<size_t> addedAt(vertexCount, 0);
+    std::vector<bool>   used(vertexCount, false);
+    size_t misses = 0;
+    size_t unique = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t v = indices[i];
+        if (!used[v])
+        {
+            used[v] = true;
+            ++unique;
+        }
+        if (addedAt[v] == 0 || misses + 1 - addedAt[v] > cacheSize)
+        {
+            ++misses;
+            addedAt[v] = misses;
+        }
+    }
+
+    VertexCacheStatistics statistics;
+    statistics.misses = misses;
+    statistics.acmr   = indexCount > 0 ? (float)misses / (float)(indexCount / 3) : 0.0f;
+    statistics.atvr   = unique > 0 ? (float)misses / (float)unique : 0.0f;
+    return statistics;
+}
+
+void optimizeVertexCache(uint32_t * indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+    size_t const triangleCount = indexCount / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+        return;
+
+    Adjacency adjacency(indices, triangleCount * 3, vertexCount);
+
+    std::vector<uint32_t> live(vertexCount);        // Number of triangles using the vertex not yet emitted
+    std::vector<size_t>   cacheTime(vertexCount, 0); // Time stamp of the vertex's last entry into the cache
+    std::vector<bool>     emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;                  // Recently used vertices, to find a new fan nearby
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indexCount);
+
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+
+    size_t time   = cacheSize + 1;
+    size_t cursor = 0;                              // Next vertex to consider when the dead-end stack is empty
+
+    // Start at the first vertex that is used
+    int64_t fan = -1;
+    while (cursor < vertexCount && live[cursor] == 0)
+    {
+        ++cursor;
+    }
+    if (cursor < vertexCount)
+        fan = (int64_t)cursor;
+
+    while (fan >= 0)
+    {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = adjacency.offsets[fan]; a < adjacency.offsets[fan + 1]; ++a)
+        {
+            uint32_t t = adjacency.triangles[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = true;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+        }
+
+        // The next fan is the candidate with remaining triangles that will still be in the cache after they have
+        // been emitted, preferring the one that has been in the cache longest.
+        fan = -1;
+        size_t best = 0;
+        for (uint32_t v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+
+            size_t priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (fan < 0 || priority > best)
+            {
+                best = priority;
+                fan  = v;
+            }
+        }
+
+        // Otherwise, pick a recently used vertex, and failing that, the next vertex in order with triangles left.
+        while (fan < 0 && !deadEnd.empty())
+        {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+                fan = v;
+        }
+        while (fan < 0 && cursor < vertexCount)
+        {
+            if (live[cursor] > 0)
+                fan = (int64_t)cursor;
+            ++cursor;
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+VertexFetchStatistics analyzeVertexFetch(uint32_t const * indices,
+                                         size_t           indexCount,
+                                         size_t           vertexCount,
+                                         size_t           vertexSize,
+                                         size_t           lineSize,
+                                         unsigned         cacheLines)
+{
+    unsigned constexpr VERTEX_CACHE_SIZE = 16;
+
+    size_t const lineCount = (vertexCount * vertexSize + lineSize - 1) / lineSize;
+    std::vector<size_t> vertexAddedAt(vertexCount, 0);
+    std::vector<size_t> lineAddedAt(lineCount, 0);
+    std::vector<bool>   used(vertexCount, false);
+    size_t vertexMisses = 0;
+    size_t lineMisses   = 0;
+    size_t unique       = 0;
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t v = indices[i];
+        if (!used[v])
+        {
+            used[v] = true;
+            ++unique;
+        }
+
+        // Only a post-transform cache miss fetches the vertex
+        if (vertexAddedAt[v] != 0 && vertexMisses + 1 - vertexAddedAt[v] <= VERTEX_CACHE_SIZE)
+            continue;
+        vertexAddedAt[v] = ++vertexMisses;
+
+        // The vertex may straddle more than one line
+        size_t first = v * vertexSize / lineSize;
+        size_t last  = ((size_t)v * vertexSize + vertexSize - 1) / lineSize;
+        for (size_t line = first; line <= last; ++line)
+        {
+            if (lineAddedAt[line] == 0 || lineMisses + 1 - lineAddedAt[line] > cacheLines)
+                lineAddedAt[line] = ++lineMisses;
+        }
+    }
+
+    VertexFetchStatistics statistics;
+    statistics.bytesFetched = lineMisses * lineSize;
+    statistics.overfetch    = unique > 0 ? (float)statistics.bytesFetched / (float)(unique * vertexSize) : 0.0f;
+    return statistics;
+}
+
+size_t optimizeVertexFetch(void * vertices, size_t vertexCount, size_t vertexSize, uint32_t * indices, size_t indexCount)
+{
+    uint32_t constexpr UNUSED = 0xffffffff;
+
+    // Number the vertices in order of first use
+    std::vector<uint32_t> remap(vertexCount, UNUSED);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t & r = remap[indices[i]];
+        if (r == UNUSED)
+            r = next++;
+        indices[i] = r;
+    }
+
+    // Move the vertices to their new positions. A copy is needed because the permutation can have cycles.
+    char const * source = static_cast<char const *>(vertices);
+    std::vector<char> reordered((size_t)next * vertexSize);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        if (remap[v] != UNUSED)
+            memcpy(&reordered[(size_t)remap[v] * vertexSize], source + v * vertexSize, vertexSize);
+    }
+    if (!reordered.empty())
+        memcpy(vertices, reordered.data(), reordered.size());
+
+    return next;
+}
+
+std::vector<IndexRange> splitIndexRanges(uint32_t const * indices, size_t indexCount, uint32_t maxSpan)
+{
+    std::vector<IndexRange> ranges;
+    size_t const triangleCount = indexCount / 3;
+
+    size_t   first   = 0;
+    uint32_t minimum = 0;
+    uint32_t maximum = 0;
+    bool     wide    = false;   // The current range holds triangles that are too wide by themselves
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        uint32_t const * triangle = indices + t * 3;
+        uint32_t low  = std::min(triangle[0], std::min(triangle[1], triangle[2]));
+        uint32_t high = std::max(triangle[0], std::max(triangle[1], triangle[2]));
+        bool     tooWide = (uint64_t)high - low + 1 > maxSpan;
+
+        if (t > first)
+        {
+            uint32_t newMinimum = std::min(minimum, low);
+            uint32_t newMaximum = std::max(maximum, high);
+            bool     fits = wide ? tooWide : (uint64_t)newMaximum - newMinimum + 1 <= maxSpan;
+            if (fits)
+            {
+                minimum = newMinimum;
+                maximum = newMaximum;
+                continue;
+            }
+            ranges.push_back({ first * 3, (t - first) * 3, minimum, maximum - minimum + 1 });
+        }
+
+        first   = t;
+        minimum = low;
+        maximum = high;
+        wide    = tooWide;
+    }
+    if (triangleCount > first)
+        ranges.push_back({ first * 3, (triangleCount - first) * 3, minimum, maximum - minimum + 1 });
+
+    return ranges;
+}
+
+std::vector<Meshlet> buildMeshlets(uint32_t const * indices,
+                                   size_t           indexCount,
+                                   void const *     positions,
+                                   size_t           stride,
+                                   size_t           vertexCount,
+                                   size_t           maxVertices,
+                                   size_t           maxTriangles)
+{
+    std::vector<Meshlet>  meshlets;
+    std::vector<uint32_t> vertices;                     // Unique vertices of the current meshlet
+    std::vector<uint32_t> owner(vertexCount, 0);        // Number of the last meshlet to use the vertex, plus 1
+    size_t const triangleCount = indexCount / 3;
+    size_t       first = 0;
+
+    auto finish = [&] (size_t end) {
+        Meshlet meshlet;
+        meshlet.firstIndex  = first * 3;
+        meshlet.indexCount  = (end - first) * 3;
+        meshlet.vertexCount = vertices.size();
+        computeMeshletBounds(meshlet, indices, positions, stride, vertices);
+        meshlets.push_back(meshlet);
+        vertices.clear();
+        first = end;
+    };
+
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        uint32_t const * triangle = indices + t * 3;
+        uint32_t const   id       = (uint32_t)meshlets.size() + 1;
+
+        // Count the vertices that are new to the meshlet, taking care not to count a repeated vertex twice
+        size_t added = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            bool repeated = (k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]);
+            if (owner[triangle[k]] != id && !repeated)
+                ++added;
+        }
+        if (vertices.size() + added > maxVertices || t - first >= maxTriangles)
+            finish(t);
+
+        uint32_t const current = (uint32_t)meshlets.size() + 1;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (owner[triangle[k]] != current)
+            {
+                owner[triangle[k]] = current;
+                vertices.push_back(triangle[k]);
+            }
+        }
+    }
+    if (triangleCount > first)
+        finish(triangleCount);
+
+    return meshlets;
+}
+
+size_t simplify(uint32_t *       destination,
+                uint32_t const * indices,
+                size_t           indexCount,
+                void const *     positions,
+                size_t           stride,
+                size_t           vertexCount,
+                size_t           targetIndexCount,
+                float *          resultError)
+{
+    size_t count = indexCount / 3 * 3;
+    std::copy(indices, indices + count, destination);
+
+    std::vector<bool> locked = findLockedVertices(indices, count, positions, stride, vertexCount);
+
+    // Each vertex starts with the planes of the triangles around it.
+    std::vector<Quadric> quadrics(vertexCount, Quadric());
+    for (size_t i = 0; i < count; i += 3)
+    {
+        float const * p0 = position(positions, stride, indices[i]);
+        float n[3];
+        triangleNormal(p0, position(positions, stride, indices[i + 1]), position(positions, stride, indices[i + 2]), n);
+        double length = std::sqrt((double)n[0] * n[0] + (double)n[1] * n[1] + (double)n[2] * n[2]);
+        if (length == 0.0)
+            continue;
+        double a = n[0] / length;
+        double b = n[1] / length;
+        double c = n[2] / length;
+        double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+        for (int k = 0; k < 3; ++k)
+        {
+            quadrics[indices[i + k]].addPlane(a, b, c, d);
+        }
+    }
+
+    struct Collapse
+    {
+        double   cost;
+        uint32_t from;
+        uint32_t to;
+    };
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool>     touched(vertexCount);
+    double                maxCost = 0.0;
+
+    // Each pass collapses the cheapest edges whose neighborhoods do not overlap, so that the costs and the flip tests
+    // of the collapses in a pass are independent of each other.
+    while (count > targetIndexCount)
+    {
+        Adjacency adjacency(destination, count, vertexCount);
+
+        // Every half-edge is a candidate for collapsing its first vertex onto its second
+        collapses.clear();
+        for (size_t i = 0; i < count; i += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t from = destination[i + k];
+                uint32_t to   = destination[i + (k + 1) % 3];
+                if (locked[from])
+                    continue;
+                float const * p    = position(positions, stride, to);
+                double        cost = std::max(0.0, quadrics[from].evaluate(p) + quadrics[to].evaluate(p));
+                collapses.push_back({ cost, from, to });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [] (Collapse const & a, Collapse const & b) {
+            if (a.cost != b.cost)
+                return a.cost < b.cost;
+            return a.from != b.from ? a.from < b.from : a.to < b.to;
+        });
+
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            remap[v] = (uint32_t)v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t removed   = 0;
+        size_t collapsed = 0;
+        for (auto const & collapse : collapses)
+        {
+            if (count - removed * 3 <= targetIndexCount)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+            if (collapseFlips(destination, adjacency, positions, stride, collapse.from, collapse.to))
+                continue;
+
+            for (uint32_t a = adjacency.offsets[collapse.from]; a < adjacency.offsets[collapse.from + 1]; ++a)
+            {
+                uint32_t const * triangle = destination + (size_t)adjacency.triangles[a] * 3;
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    ++removed;
+                for (int k = 0; k < 3; ++k)
+                {
+                    touched[triangle[k]] = true;
+                }
+            }
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            maxCost = std::max(maxCost, collapse.cost);
+            ++collapsed;
+        }
+        if (collapsed == 0)
+            break;
+
+        // Apply the collapses and remove the triangles that have become degenerate
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i += 3)
+        {
+            uint32_t a = remap[destination[i + 0]];
+            uint32_t b = remap[destination[i + 1]];
+            uint32_t c = remap[destination[i + 2]];
+            if (a != b && b != c && c != a)
+            {
+                destination[kept++] = a;
+                destination[kept++] = b;
+                destination[kept++] = c;
+            }
+        }
+        count = kept;
+    }
+
+    if (resultError)
+        *resultError = (float)std::sqrt(maxCost);
+    return count;
+}
@@ -0,0 +1,105 @@
+#if !defined(MESHOPTIMIZER_H)
+#define MESHOPTIMIZER_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Post-transform vertex cache efficiency of an index buffer, measured by simulating a FIFO cache
+struct VertexCacheStatistics
+{
+    size_t misses;  // Number of vertex shader invocations
+    float acmr;     // Average cache miss ratio: invocations per triangle (0.5 is ideal for a large regular grid)
+    float atvr;     // Average transformed vertex ratio: invocations per unique vertex (1.0 is ideal)
+};
+
+// Vertex fetch efficiency of an index buffer, measured by simulating a cache of memory lines
+struct VertexFetchStatistics
+{
+    size_t bytesFetched;    // Number of bytes read from the vertex buffer
+    float overfetch;        // Bytes fetched per byte of vertex data referenced (1.0 is ideal)
+};
+
+// A range of consecutive triangles in an index buffer and the vertices it references
+struct IndexRange
+{
+    size_t   firstIndex;
+    size_t   indexCount;
+    uint32_t baseVertex;    // Lowest vertex referenced
+    uint32_t vertexSpan;    // Highest vertex referenced - baseVertex + 1
+};
+
+// A cluster of consecutive triangles in an index buffer that is culled as a unit
+struct Meshlet
+{
+    size_t firstIndex;
+    size_t indexCount;
+    size_t vertexCount;     // Number of unique vertices
+    float  center[3];       // Bounding sphere
+    float  radius;
+    float  coneAxis[3];     // Normal cone: every triangle faces away from a viewpoint p if
+    float  coneCutoff;      // dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius
+};
+
+// Simulates a FIFO post-transform cache of `cacheSize` entries on a triangle list
+VertexCacheStatistics analyzeVertexCache(uint32_t const * indices,
+                                         size_t           indexCount,
+                                         size_t           vertexCount,
+                                         unsigned         cacheSize = 16);
+
+// Reorders the triangles of a triangle list to reduce post-transform cache misses, using the Tipsify algorithm
+// (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007). The
+// triangles themselves and their winding are unchanged.
+void optimizeVertexCache(uint32_t * indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = 16);
+
+// Simulates vertex fetch through a FIFO cache of `cacheLines` memory lines of `lineSize` bytes, assuming every
+// post-transform cache miss (with a 16-entry cache) fetches its vertex.
+VertexFetchStatistics analyzeVertexFetch(uint32_t const * indices,
+                                         size_t           indexCount,
+                                         size_t           vertexCount,
+                                         size_t           vertexSize,
+                                         size_t           lineSize = 64,
+                                         unsigned         cacheLines = 64);
+
+// Reorders the vertices into the order in which the index buffer first references them and rewrites the indices to
+// match, so that vertex fetch follows the triangle order. Vertices that are not referenced are removed. Returns the
+// new number of vertices. This should be done after any reordering of the triangles.
+size_t optimizeVertexFetch(void * vertices, size_t vertexCount, size_t vertexSize, uint32_t * indices, size_t indexCount);
+
+// Splits a triangle list into ranges of consecutive triangles whose vertices span at most `maxSpan` vertices, so that
+// each range can use narrower indices relative to its base vertex. A triangle that spans more than `maxSpan` vertices
+// by itself is put in a range with any adjacent triangles like it, and that range's span exceeds `maxSpan`. Ranges are
+// much larger if the vertices are ordered by first use (see optimizeVertexFetch).
+std::vector<IndexRange> splitIndexRanges(uint32_t const * indices, size_t indexCount, uint32_t maxSpan = 65536);
+
+// Splits a triangle list into meshlets of consecutive triangles with no more than `maxVertices` unique vertices and
+// `maxTriangles` triangles each, and computes their bounding spheres and normal cones. `positions` points to the
+// position (three floats) of the first vertex and `stride` is the size of a vertex. Front faces are assumed to be
+// counter-clockwise. The triangles are not reordered, so the meshlets are only as compact as the triangle order
+// (see optimizeVertexCache). A meshlet whose normals spread too widely to be culled by its cone has a cutoff of 1.
+std::vector<Meshlet> buildMeshlets(uint32_t const * indices,
+                                   size_t           indexCount,
+                                   void const *     positions,
+                                   size_t           stride,
+                                   size_t           vertexCount,
+                                   size_t           maxVertices = 64,
+                                   size_t           maxTriangles = 124);
+
+// Reduces the number of triangles in a triangle list to no more than `targetIndexCount` / 3 by collapsing edges in
+// order of increasing quadric error (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics",
+// 1997). A vertex is only ever moved onto another vertex, so the result uses the same vertex buffer. Vertices on
+// borders and attribute seams are locked, so the target may not be reached. `destination` must have room for
+// `indexCount` indices. Returns the number of indices written, and the largest error of any collapse, which is
+// roughly a distance in the units of the positions, is returned in `resultError`.
+size_t simplify(uint32_t *       destination,
+                uint32_t const * indices,
+                size_t           indexCount,
+                void const *     positions,
+                size_t           stride,
+                size_t           vertexCount,
+                size_t           targetIndexCount,
+                float *          resultError = nullptr);
+
+#endif // !defined(MESHOPTIMIZER_H)
@@ -0,0 +1,328 @@
+#include "MipGenerator.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// The filters run 8 floats (two texels) at a time with AVX2, or 4 (one texel) with SSE2. Define MIPGENERATOR_NO_SIMD to
+// use the scalar loops only.
+#if !defined(MIPGENERATOR_NO_SIMD)
+#if defined(__AVX2__)
+#define MIPGENERATOR_USE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPGENERATOR_USE_SSE2
+#include <emmintrin.h>
+#endif
+#endif
+
+namespace
+{
+// Half the width of the windowed sinc filters, in texels of the smaller level
+double constexpr SINC_RADIUS  = 3.0;
+double constexpr KAISER_ALPHA = 4.0;
+
+// Size of the table used to convert linear values back to sRGB. It is fine enough near black, where sRGB is steepest,
+// to round to the nearest 8-bit value.
+int constexpr ENCODE_TABLE_SIZE = 16384;
+
+// The taps of a 1D filter from one size to a smaller one. Every destination texel has the same number of taps, from
+// `count` consecutive source texels starting at first[x], so the loops have no special cases at the edges. The
+// weights of the taps beyond an edge are folded onto the edge texel. Each weight is repeated once per channel.
+struct Taps
+{
+    size_t count;
+    std::vector<uint32_t> first;
+    std::vector<float> weights;   // count * 4 per destination texel
+};
+
+double sinc(double x)
+{
+    if (x == 0.0)
+        return 1.0;
+    x *= 3.14159265358979323846;
+    return std::sin(x) / x;
+}
+
+// Modified Bessel function of the first kind, order 0, by its power series
+double besselI0(double x)
+{
+    double sum  = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50 && term > sum * 1e-12; ++k)
+    {
+        double f = x / (2.0 * k);
+        term *= f * f;
+        sum  += term;
+    }
+    return sum;
+}
+
+// Returns the weight of a windowed sinc filter at a distance of t texels of the smaller level
+double sincWeight(MipFilter filter, double t)
+{
+    if (std::abs(t) >= SINC_RADIUS)
+        return 0.0;
+    if (filter == MipFilter::eLanczos)
+        return sinc(t) * sinc(t / SINC_RADIUS);
+    double r = t / SINC_RADIUS;
+    return sinc(t) * besselI0(KAISER_ALPHA * std::sqrt(1.0 - r * r)) / besselI0(KAISER_ALPHA);
+}
+
+Taps computeTaps(MipFilter filter, uint32_t sourceSize, uint32_t destinationSize)
+{
+    double scale  = (double)sourceSize / (double)destinationSize;
+    double radius = filter == MipFilter::eBox ? scale * 0.5 : SINC_RADIUS * scale;
+
+    // The AVX2 loop reads two taps at a time.
+    size_t span = (size_t)std::ceil(radius * 2.0) + 1;
+    Taps   taps;
+    taps.count = std::min<size_t>((span + 1) & ~(size_t)1, sourceSize);
+    taps.first.resize(destinationSize);
+    taps.weights.assign(destinationSize * taps.count * 4, 0.0f);
+
+    std::vector<double> weights(taps.count);
+    for (uint32_t x = 0; x < destinationSize; ++x)
+    {
+        double  center = (x + 0.5) * scale;
+        int64_t start  = (int64_t)std::floor(center - radius);
+        int64_t first  = std::min<int64_t>(std::max<int64_t>(start, 0), (int64_t)(sourceSize - taps.count));
+
+        std::fill(weights.begin(), weights.end(), 0.0);
+        double sum = 0.0;
+        for (int64_t i = start; i < start + (int64_t)span; ++i)
+        {
+            double w;
+            if (filter == MipFilter::eBox)
+                w = std::max(0.0, std::min(i + 1.0, center + radius) - std::max((double)i, center - radius));
+            else
+                w = sincWeight(filter, (i + 0.5 - center) / scale);
+            int64_t clamped = std::min<int64_t>(std::max<int64_t>(i, 0), sourceSize - 1);
+            weights[(size_t)(clamped - first)] += w;
+            sum += w;
+        }
+
+        taps.first[x] = (uint32_t)first;
+        float * out = &taps.weights[x * taps.count * 4];
+        for (size_t k = 0; k < taps.count; ++k)
+        {
+            std::fill(out + k * 4, out + k * 4 + 4, (float)(weights[k] / sum));
+        }
+    }
+    return taps;
+}
+
+// Filters each row of `source` (width x rows texels) horizontally into `destination` (taps.first.size() x rows)
+void filterRows(float const * source, uint32_t width, float * destination, size_t rows, Taps const & taps, unsigned threads)
+{
+    size_t const destinationWidth = taps.first.size();
+    parallelForRanges(rows, threads, [&] (size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y)
+        {
+            float const * row = source + y * width * 4;
+            float *       out = destination + y * destinationWidth * 4;
+            for (size_t x = 0; x < destinationWidth; ++x)
+            {
+                float const * in = row + (size_t)taps.first[x] * 4;
+                float const * w  = &taps.weights[x * taps.count * 4];
+                size_t k = 0;
+#if defined(MIPGENERATOR_USE_AVX2)
+                // Two adjacent texels are two adjacent taps.
+                __m256 sum8 = _mm256_setzero_ps();
+                for (; k + 2 <= taps.count; k += 2)
+                {
+                    sum8 = _mm256_add_ps(sum8, _mm256_mul_ps(_mm256_loadu_ps(w + k * 4), _mm256_loadu_ps(in + k * 4)));
+                }
+                __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+                for (; k < taps.count; ++k)
+                {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(w + k * 4), _mm_loadu_ps(in + k * 4)));
+                }
+                _mm_storeu_ps(out + x * 4, sum);
+#elif defined(MIPGENERATOR_USE_SSE2)
+                __m128 sum = _mm_setzero_ps();
+                for (; k < taps.count; ++k)
+                {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(w + k * 4), _mm_loadu_ps(in + k * 4)));
+                }
+                _mm_storeu_ps(out + x * 4, sum);
+#else
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (; k < taps.count; ++k)
+                {
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        sum[c] += w[k * 4 + c] * in[k * 4 + c];
+                    }
+                }
+                memcpy(out + x * 4, sum, sizeof(sum));
+#endif
+            }
+        }
+    });
+}
+
+// Filters `source` (width x sourceHeight texels) vertically into `destination` (width x taps.first.size()). Every
+// texel of a destination row has the same weights, so the rows are processed as flat arrays of floats.
+void filterColumns(float const * source, uint32_t width, float * destination, Taps const & taps, unsigned threads)
+{
+    size_t const rowSize = (size_t)width * 4;
+    parallelForRanges(taps.first.size(), threads, [&] (size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y)
+        {
+            float const * in  = source + (size_t)taps.first[y] * rowSize;
+            float const * w   = &taps.weights[y * taps.count * 4];
+            float *       out = destination + y * rowSize;
+            size_t i = 0;
+#if defined(MIPGENERATOR_USE_AVX2)
+            for (; i + 8 <= rowSize; i += 8)
+            {
+                __m256 sum = _mm256_setzero_ps();
+                for (size_t k = 0; k < taps.count; ++k)
+                {
+                    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(w[k * 4]), _mm256_loadu_ps(in + k * rowSize + i)));
+                }
+                _mm256_storeu_ps(out + i, sum);
+            }
+#endif
+#if defined(MIPGENERATOR_USE_AVX2) || defined(MIPGENERATOR_USE_SSE2)
+            // A row is a whole number of texels, so this is at most one texel with AVX2.
+            for (; i < rowSize; i += 4)
+            {
+                __m128 sum = _mm_setzero_ps();
+                for (size_t k = 0; k < taps.count; ++k)
+                {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(w + k * 4), _mm_loadu_ps(in + k * rowSize + i)));
+                }
+                _mm_storeu_ps(out + i, sum);
+            }
+#else
+            for (; i < rowSize; ++i)
+            {
+                float sum = 0.0f;
+                for (size_t k = 0; k < taps.count; ++k)
+                {
+                    sum += w[k * 4] * in[k * rowSize + i];
+                }
+                out[i] = sum;
+            }
+#endif
+        }
+    });
+}
+
+float srgbToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// Converts RGBA8 texels to linear floats with the color premultiplied by alpha
+void decode(uint8_t const * texels, size_t count, float * linear, unsigned threads)
+{
+    static float const * const table = [] {
+        static float values[256];
+        for (int i = 0; i < 256; ++i)
+        {
+            values[i] = srgbToLinear(i / 255.0f);
+        }
+        return values;
+    }();
+
+    parallelForRanges(count, threads, [&] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint8_t const * in    = texels + i * 4;
+            float *         out   = linear + i * 4;
+            float           alpha = in[3] / 255.0f;
+            out[0] = table[in[0]] * alpha;
+            out[1] = table[in[1]] * alpha;
+            out[2] = table[in[2]] * alpha;
+            out[3] = alpha;
+        }
+    });
+}
+
+// Converts linear floats with premultiplied color back to RGBA8 texels. Ringing can push the values out of range, so
+// they are clamped.
+void encode(float const * linear, size_t count, uint8_t * texels, unsigned threads)
+{
+    static uint8_t const * const table = [] {
+        static uint8_t values[ENCODE_TABLE_SIZE];
+        for (int i = 0; i < ENCODE_TABLE_SIZE; ++i)
+        {
+            values[i] = (uint8_t)(linearToSrgb(i / (float)(ENCODE_TABLE_SIZE - 1)) * 255.0f + 0.5f);
+        }
+        return values;
+    }();
+
+    parallelForRanges(count, threads, [&] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            float const * in    = linear + i * 4;
+            uint8_t *     out   = texels + i * 4;
+            float         alpha = std::min(std::max(in[3], 0.0f), 1.0f);
+            float         scale = alpha > 0.0f ? (float)(ENCODE_TABLE_SIZE - 1) / alpha : 0.0f;
+            for (int c = 0; c < 3; ++c)
+            {
+                float v = std::min(std::max(in[c] * scale, 0.0f), (float)(ENCODE_TABLE_SIZE - 1));
+                out[c] = table[(int)(v + 0.5f)];
+            }
+            out[3] = (uint8_t)(alpha * 255.0f + 0.5f);
+        }
+    });
+}
+} // anonymous namespace
+
+std::vector<MipLevel> mipChainLevels(uint32_t width, uint32_t height, size_t * size)
+{
+    std::vector<MipLevel> levels;
+    size_t                total = 0;
+    for (uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+    {
+        levels.push_back({ total, w, h });
+        total += (size_t)w * h * 4;
+        if (w == 1 && h == 1)
+            break;
+    }
+    *size = total;
+    return levels;
+}
+
+void generateMipChain(uint8_t * texels, std::vector<MipLevel> const & levels, MipFilter filter, unsigned threads)
+{
+    // Each level is filtered from the unrounded linear values of the one before it.
+    std::vector<float> current((size_t)levels[0].width * levels[0].height * 4);
+    std::vector<float> rows;
+    std::vector<float> next;
+    decode(texels, (size_t)levels[0].width * levels[0].height, current.data(), threads);
+    for (size_t l = 1; l < levels.size(); ++l)
+    {
+        MipLevel const & source      = levels[l - 1];
+        MipLevel const & destination = levels[l];
+
+        // The horizontal pass goes first, because it shrinks the rows that the vertical pass reads.
+        rows.resize((size_t)destination.width * source.height * 4);
+        next.resize((size_t)destination.width * destination.height * 4);
+        filterRows(current.data(),
+                   source.width,
+                   rows.data(),
+                   source.height,
+                   computeTaps(filter, source.width, destination.width),
+                   threads);
+        filterColumns(rows.data(),
+                      destination.width,
+                      next.data(),
+                      computeTaps(filter, source.height, destination.height),
+                      threads);
+
+        encode(next.data(), (size_t)destination.width * destination.height, texels + destination.offset, threads);
+        current.swap(next);
+    }
+}
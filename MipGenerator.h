@@ -0,0 +1,37 @@
+#if !defined(MIPGENERATOR_H)
+#define MIPGENERATOR_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The filter used to reduce each level of a mip chain to the next
+enum class MipFilter : uint32_t
+{
+    eBox     = 0,   // Average of the texels covered, which blurs least but aliases most
+    eKaiser  = 1,   // Kaiser-windowed sinc, three texels wide (alpha 4)
+    eLanczos = 2    // Lanczos-windowed sinc, three texels wide, which is the sharpest but rings the most
+};
+
+// A level of a mip chain
+struct MipLevel
+{
+    size_t   offset;    // Offset of the level's first texel from the start of the chain
+    uint32_t width;
+    uint32_t height;
+};
+
+// Returns the levels of the mip chain of an RGBA8 image, from the full-size level down to 1x1, stored one level after
+// the other, and the size of the whole chain in bytes. Each level is half the size of the one before it, rounded down.
+std::vector<MipLevel> mipChainLevels(uint32_t width, uint32_t height, size_t * size);
+
+// Fills in the mip chain of an RGBA8 image whose full-size level has already been written to the start of `texels`,
+// laid out as returned by mipChainLevels, so the image can be decoded straight into place. Each level is filtered from
+// the one before it. The color channels are treated as sRGB and filtered in linear space, weighted by alpha so that
+// transparent texels do not bleed into their neighbors. The filtering is separable, and the rows of each pass are
+// spread across `threads` threads (0 means one per hardware thread).
+void generateMipChain(uint8_t * texels, std::vector<MipLevel> const & levels, MipFilter filter, unsigned threads);
+
+#endif // !defined(MIPGENERATOR_H)
@@ -0,0 +1,220 @@
+#if !defined(PARALLEL_H)
+#define PARALLEL_H
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Returns the number of threads to use for a requested count, where 0 means one per hardware thread
+inline unsigned threadCount(unsigned requested)
+{
+    if (requested > 0)
+        return requested;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls f(i) for every i in [0, count), spread across up to `threads` threads. Work is handed out one index at a time,
+// so each index should represent a reasonably large piece of work. Returns when all calls have completed. If a call
+// throws, no more indices are handed out, and the first exception is rethrown once the threads have stopped.
+template <typename F>
+void parallelFor(size_t count, unsigned threads, F && f)
+{
+    threads = threadCount(threads);
+    if (threads == 1 || count <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            f(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::mutex          errorMutex;
+    std::exception_ptr  error;
+    auto worker = [&] () {
+        try
+        {
+            for (size_t i = next++; i < count; i = next++)
+            {
+                f(i);
+            }
+        }
+        catch (...)
+        {
+            next = count;
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+                error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    size_t n = std::min(count, (size_t)threads) - 1;
+    workers.reserve(n);
+    for (size_t t = 0; t < n; ++t)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto & w : workers)
+    {
+        w.join();
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Calls f(begin, end) for consecutive ranges covering [0, count), one range per thread
+template <typename F>
+void parallelForRanges(size_t count, unsigned threads, F && f)
+{
+    size_t n = std::max<size_t>(1, std::min<size_t>(threadCount(threads), count));
+    parallelFor(n, (unsigned)n, [&] (size_t i) {
+        f(count * i / n, count * (i + 1) / n);
+    });
+}
+
+// A fixed set of threads that run a function together, for work that is split the same way over and over, such as
+// the recording of every frame. Unlike parallelFor, the threads are only started once, so a run costs a wakeup.
+class ThreadTeam
+{
+public:
+    // Starts threads - 1 threads. The thread calling run() is the first member of the team.
+    explicit ThreadTeam(unsigned threads)
+    {
+        for (unsigned t = 1; t < threads; ++t)
+        {
+            threads_.emplace_back([this, t] { work(t); });
+        }
+    }
+
+    // Stops the threads
+    ~ThreadTeam()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        start_.notify_all();
+        for (auto & thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    ThreadTeam(ThreadTeam const &) = delete;
+    ThreadTeam & operator =(ThreadTeam const &) = delete;
+
+    // Returns the number of threads in the team, including the caller of run()
+    unsigned size() const { return (unsigned)threads_.size() + 1; }
+
+    // Calls f(i) for every i in [0, count) on member i of the team, where count is at most size(). Returns when all
+    // calls have completed, and rethrows the first exception thrown by any of them.
+    void run(size_t count, std::function<void(size_t)> const & f)
+    {
+        count = std::min<size_t>(count, size());
+        if (count <= 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                f(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_      = &f;
+            count_     = count;
+            remaining_ = count - 1;
+            error_     = nullptr;
+            ++generation_;
+        }
+        start_.notify_all();
+
+        std::exception_ptr error;
+        try
+        {
+            f(0);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this] { return remaining_ == 0; });
+            task_ = nullptr;
+            if (!error)
+                error = error_;
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    void work(size_t member)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            std::function<void(size_t)> const * task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+                if (stopping_)
+                    return;
+                seen = generation_;
+                if (member >= count_)
+                    continue;
+                task = task_;
+            }
+
+            std::exception_ptr error;
+            try
+            {
+                (*task)(member);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (error && !error_)
+                    error_ = error;
+                last = --remaining_ == 0;
+            }
+            if (last)
+                done_.notify_one();
+        }
+    }
+
+    // Guarded by mutex_
+    std::mutex                          mutex_;
+    std::condition_variable             start_;
+    std::condition_variable             done_;
+    std::function<void(size_t)> const * task_       = nullptr;
+    size_t                              count_      = 0;
+    size_t                              remaining_  = 0;   // Members other than the caller still running the task
+    uint64_t                            generation_ = 0;   // Incremented for every run
+    std::exception_ptr                  error_;
+    bool                                stopping_   = false;
+
+    std::vector<std::thread> threads_;
+};
+
+#endif // !defined(PARALLEL_H)
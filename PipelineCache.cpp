@@ -0,0 +1,46 @@
+#include "PipelineCache.h"
+
+#include "MappedFile.h"
+
+#include <cstring>
+
+namespace
+{
+// Size of VkPipelineCacheHeaderVersionOne, and the value of VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+size_t constexpr   HEADER_SIZE    = 16 + PipelineCache::UUID_SIZE;
+uint32_t constexpr HEADER_VERSION = 1;
+
+// The header's fields are written least significant byte first, whatever the byte order of the host.
+uint32_t readUint32(char const * p)
+{
+    uint8_t const * bytes = reinterpret_cast<uint8_t const *>(p);
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+} // anonymous namespace
+
+std::vector<char> PipelineCache::load(char const * path, Device const & device)
+{
+    MappedFile file;
+    if (!file.open(path) || !validate(file.data(), file.size(), device))
+        return std::vector<char>();
+    return std::vector<char>(file.data(), file.data() + file.size());
+}
+
+bool PipelineCache::save(char const * path, void const * data, size_t size)
+{
+    return replaceFile(path, { { data, size } });
+}
+
+bool PipelineCache::validate(char const * data, size_t size, Device const & device)
+{
+    if (size < HEADER_SIZE)
+        return false;
+
+    uint32_t headerSize = readUint32(data);
+    return headerSize >= HEADER_SIZE &&
+           headerSize <= size &&
+           readUint32(data + 4) == HEADER_VERSION &&
+           readUint32(data + 8) == device.vendorId &&
+           readUint32(data + 12) == device.deviceId &&
+           memcmp(data + 16, device.uuid, UUID_SIZE) == 0;
+}
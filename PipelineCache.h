@@ -0,0 +1,41 @@
+#if !defined(PIPELINECACHE_H)
+#define PIPELINECACHE_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The contents of a Vulkan pipeline cache, saved between runs so the pipelines do not have to be compiled again.
+//
+// The data is written exactly as vkGetPipelineCacheData returns it. It starts with the header defined by the Vulkan
+// specification (VkPipelineCacheHeaderVersionOne), which identifies the driver and the device that created it. Drivers
+// are supposed to reject data that is not theirs, but not all of them do it safely, so the header is checked before the
+// data is given to the driver.
+class PipelineCache
+{
+public:
+    static size_t constexpr UUID_SIZE = 16;     // VK_UUID_SIZE
+
+    // Identifies the device and the driver, from VkPhysicalDeviceProperties
+    struct Device
+    {
+        uint32_t vendorId;
+        uint32_t deviceId;
+        uint8_t  uuid[UUID_SIZE];   // pipelineCacheUUID
+    };
+
+    // Reads the data saved in a file. Returns an empty vector if the file does not exist, or if its header is malformed
+    // or was not written for the given device, in which case the pipelines are compiled from scratch.
+    static std::vector<char> load(char const * path, Device const & device);
+
+    // Writes the data to a file, replacing it only once the data is completely written. Returns false if the file
+    // cannot be written.
+    static bool save(char const * path, void const * data, size_t size);
+
+    // Returns true if the data starts with a valid header for the given device
+    static bool validate(char const * data, size_t size, Device const & device);
+};
+
+#endif // !defined(PIPELINECACHE_H)
@@ -0,0 +1,175 @@
+#include "TextureCache.h"
+
+#include "MeshCache.h"
+
+#include <cstring>
+
+namespace
+{
+char constexpr MAGIC[8] = { 'V', 'K', 'T', 'T', 'E', 'X', 'C', '\0' };
+size_t constexpr ALIGNMENT = 16;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t levelCount;
+    TextureCache::Key key;
+    uint32_t format;        // TextureFormat
+    uint32_t reserved;
+    uint64_t texelOffset;   // Offset of the texel data from the start of the image
+    uint64_t texelSize;
+};
+
+size_t alignUp(size_t x)
+{
+    return (x + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+bool operator ==(TextureCache::Key const & a, TextureCache::Key const & b)
+{
+    return a.sourceHash == b.sourceHash &&
+           a.sourceSize == b.sourceSize &&
+           a.filter == b.filter &&
+           a.options == b.options;
+}
+} // anonymous namespace
+
+std::string TextureCache::pathFor(char const * sourcePath)
+{
+    return std::string(sourcePath) + ".texcache";
+}
+
+bool TextureCache::keyFor(char const * sourcePath, MipFilter filter, uint32_t options, Key & key)
+{
+    MappedFile source;
+    if (!source.open(sourcePath))
+        return false;
+
+    key.sourceHash = MeshCache::hash(source.data(), source.size());
+    key.sourceSize = source.size();
+    key.filter     = (uint32_t)filter;
+    key.options    = options;
+    return true;
+}
+
+bool TextureCache::write(char const *                 path,
+                         Key const &                  key,
+                         TextureFormat                format,
+                         std::vector<MipLevel> const & levels,
+                         void const *                 texels,
+                         size_t                       size)
+{
+    std::vector<Level> table;
+    table.reserve(levels.size());
+    for (auto const & level : levels)
+    {
+        table.push_back({ level.offset, textureSize(format, level.width, level.height), level.width, level.height });
+    }
+
+    // The header and the table are built in memory, padded to the start of the texels.
+    size_t            texelOffset = alignUp(sizeof(Header) + table.size() * sizeof(Level));
+    std::vector<char> head(texelOffset, 0);
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version     = VERSION;
+    header.levelCount  = (uint32_t)table.size();
+    header.key         = key;
+    header.format      = (uint32_t)format;
+    header.reserved    = 0;
+    header.texelOffset = texelOffset;
+    header.texelSize   = size;
+    memcpy(head.data(), &header, sizeof(header));
+    if (!table.empty())
+        memcpy(head.data() + sizeof(Header), table.data(), table.size() * sizeof(Level));
+
+    return replaceFile(path, { { head.data(), head.size() }, { texels, size } });
+}
+
+bool TextureCache::open(char const * path, Key const & key)
+{
+    close();
+
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    if (!validate(file.data(), file.size(), key))
+        return false;
+
+    file_  = std::move(file);
+    image_ = file_.data();
+    size_  = file_.size();
+    return true;
+}
+
+void TextureCache::close()
+{
+    file_.close();
+    image_ = nullptr;
+    size_  = 0;
+}
+
+TextureFormat TextureCache::format() const
+{
+    return image_ ? (TextureFormat)reinterpret_cast<Header const *>(image_)->format : TextureFormat::eRGBA8;
+}
+
+TextureCache::Level const * TextureCache::levels(size_t * count) const
+{
+    *count = 0;
+    if (!image_)
+        return nullptr;
+
+    *count = reinterpret_cast<Header const *>(image_)->levelCount;
+    return reinterpret_cast<Level const *>(image_ + sizeof(Header));
+}
+
+void const * TextureCache::texels(size_t * size) const
+{
+    *size = 0;
+    if (!image_)
+        return nullptr;
+
+    Header const * header = reinterpret_cast<Header const *>(image_);
+    *size = (size_t)header->texelSize;
+    return image_ + header->texelOffset;
+}
+
+bool TextureCache::validate(char const * image, size_t size, Key const & key)
+{
+    if (size < sizeof(Header))
+        return false;
+
+    Header header;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || !(header.key == key))
+        return false;
+
+    size_t tableEnd = sizeof(Header) + (size_t)header.levelCount * sizeof(Level);
+    if (header.format > (uint32_t)TextureFormat::eBC7 ||
+        header.levelCount == 0 ||
+        tableEnd > size ||
+        header.texelOffset % ALIGNMENT != 0 ||
+        header.texelOffset < tableEnd ||
+        header.texelOffset > size ||
+        header.texelSize > size - header.texelOffset)
+    {
+        return false;
+    }
+
+    // Every level must lie within the texel data and be the size its dimensions require.
+    Level const * table = reinterpret_cast<Level const *>(image + sizeof(Header));
+    for (uint32_t i = 0; i < header.levelCount; ++i)
+    {
+        if (table[i].width == 0 ||
+            table[i].height == 0 ||
+            table[i].size != textureSize((TextureFormat)header.format, table[i].width, table[i].height) ||
+            table[i].offset > header.texelSize ||
+            table[i].size > header.texelSize - table[i].offset)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+#if !defined(TEXTURECACHE_H)
+#define TEXTURECACHE_H
+
+#pragma once
+
+#include "BlockCompressor.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A versioned binary image of a texture's complete mip chain, stored next to its source file.
+//
+// The image is a header followed by a table of levels and then the texels or blocks of every level, one after the
+// other, exactly as they are copied to the GPU. A cache is only used if its key matches the current source file and
+// settings, and it is memory-mapped so the texels can be copied straight into a staging buffer. The image is in native
+// byte order.
+class TextureCache
+{
+public:
+    // Increment this whenever the layout or the contents of the image changes.
+    static uint32_t constexpr VERSION = 2;
+
+    // A level of the mip chain
+    struct Level
+    {
+        uint64_t offset;    // Offset of the level's texels from the start of the texel data
+        uint64_t size;      // Size of the level in bytes
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Identifies the source file and the settings that a cache was built from
+    struct Key
+    {
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+        uint32_t filter;    // MipFilter
+        uint32_t options;   // Application-defined bits for settings that change the contents
+    };
+
+    // Returns the path of the cache for the given source file
+    static std::string pathFor(char const * sourcePath);
+
+    // Computes the key for a source file. Returns false if the source cannot be read.
+    static bool keyFor(char const * sourcePath, MipFilter filter, uint32_t options, Key & key);
+
+    // Writes the cache of a mip chain in the given format, laid out as returned by compressedLevels. The texels are
+    // written straight from where they are, so they can be in a staging buffer. Returns false if the file cannot be
+    // written.
+    static bool write(char const *                 path,
+                      Key const &                  key,
+                      TextureFormat                format,
+                      std::vector<MipLevel> const & levels,
+                      void const *                 texels,
+                      size_t                       size);
+
+    // Maps the cache file. Returns false if it does not exist, is malformed, or does not match the key.
+    bool open(char const * path, Key const & key);
+
+    // Releases the image
+    void close();
+
+    // Returns true if an image is loaded
+    bool isOpen() const { return image_ != nullptr; }
+
+    // Returns the format of the texels
+    TextureFormat format() const;
+
+    // Returns the levels, from the full-size level down to 1x1, and the number of levels
+    Level const * levels(size_t * count) const;
+
+    // Returns the texels or blocks of all of the levels and their size in bytes
+    void const * texels(size_t * size) const;
+
+private:
+    bool validate(char const * image, size_t size, Key const & key);
+
+    MappedFile file_;
+    char const * image_ = nullptr;
+    size_t size_        = 0;
+};
+
+#endif // !defined(TEXTURECACHE_H)
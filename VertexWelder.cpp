@@ -0,0 +1,329 @@
+#include "VertexWelder.h"
+
+#include "Parallel.h"
+
+#include <cstring>
+
+namespace
+{
+// Returns the smallest power of two that is at least twice n, so the table is never more than half full
+size_t tableCapacity(size_t n)
+{
+    size_t capacity = 16;
+    while (capacity < n * 2)
+    {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Returns the shift that homePosition() needs for a table with the given capacity, which is a power of two
+unsigned positionShift(size_t capacity)
+{
+    unsigned shift = 64;
+    while (capacity > 1)
+    {
+        capacity >>= 1;
+        --shift;
+    }
+    return shift;
+}
+
+// Returns the slot where the search for a hash starts. The low 32 bits of the vertex hash are kept in the slot to
+// avoid most comparisons, so the position is taken from the high bits of their product with a 64-bit odd constant,
+// which depend on every bit of the hash (Fibonacci hashing).
+size_t homePosition(uint32_t h, unsigned shift)
+{
+    return (size_t)(((uint64_t)h * 0x9e3779b97f4a7c15ull) >> shift);
+}
+
+// Stable LSD radix sort of (hash << 32 | index) keys by their upper 32 bits, 8 bits per pass. Each thread counts and
+// scatters one contiguous block of the input.
+void radixSortByHash(std::vector<uint64_t> & keys, unsigned threads)
+{
+    size_t const count  = keys.size();
+    size_t const blocks = std::max<size_t>(1, std::min<size_t>(threadCount(threads), count / 4096));
+
+    std::vector<uint64_t> temp(count);
+    std::vector<size_t> histograms(blocks * 256);
+
+    for (int shift = 32; shift < 64; shift += 8)
+    {
+        parallelFor(blocks, (unsigned)blocks, [&] (size_t b) {
+            size_t * histogram = &histograms[b * 256];
+            std::fill(histogram, histogram + 256, 0);
+            for (size_t i = count * b / blocks; i < count * (b + 1) / blocks; ++i)
+            {
+                ++histogram[(keys[i] >> shift) & 0xff];
+            }
+        });
+
+        // Turn the counts into starting offsets, ordered by digit and then by block to keep the sort stable.
+        size_t offset = 0;
+        for (size_t digit = 0; digit < 256; ++digit)
+        {
+            for (size_t b = 0; b < blocks; ++b)
+            {
+                size_t n = histograms[b * 256 + digit];
+                histograms[b * 256 + digit] = offset;
+                offset += n;
+            }
+        }
+
+        parallelFor(blocks, (unsigned)blocks, [&] (size_t b) {
+            size_t * next = &histograms[b * 256];
+            for (size_t i = count * b / blocks; i < count * (b + 1) / blocks; ++i)
+            {
+                temp[next[(keys[i] >> shift) & 0xff]++] = keys[i];
+            }
+        });
+
+        keys.swap(temp);
+    }
+}
+} // anonymous namespace
+
+VertexWelder::VertexWelder(size_t vertexSize, size_t expectedCount)
+    : vertexSize_(vertexSize)
+    , table_(tableCapacity(expectedCount), { 0, EMPTY })
+    , mask_(table_.size() - 1)
+    , shift_(positionShift(table_.size()))
+{
+    vertices_.reserve(expectedCount * vertexSize);
+}
+
+uint32_t VertexWelder::add(void const * vertex)
+{
+    uint64_t h    = hash(vertex, vertexSize_);
+    Slot *   slot = &find(vertex, (uint32_t)h);
+    if (slot->index != EMPTY)
+        return slot->index;
+
+    uint32_t index = (uint32_t)size();
+    if ((size_t)index * 2 >= table_.size())
+    {
+        grow();
+        slot = &find(vertex, (uint32_t)h);
+    }
+
+    char const * bytes = static_cast<char const *>(vertex);
+    vertices_.insert(vertices_.end(), bytes, bytes + vertexSize_);
+    *slot = { (uint32_t)h, index };
+    return index;
+}
+
+std::vector<char> VertexWelder::release()
+{
+    std::vector<char> vertices;
+    vertices.swap(vertices_);
+    std::vector<Slot>().swap(table_);
+    table_.resize(tableCapacity(0), { 0, EMPTY });
+    mask_  = table_.size() - 1;
+    shift_ = positionShift(table_.size());
+    return vertices;
+}
+
+size_t VertexWelder::weld(void * vertices, size_t count, size_t vertexSize, uint32_t * indices, unsigned threads)
+{
+    if (threadCount(threads) > 1)
+        return weldWithSort(static_cast<char *>(vertices), count, vertexSize, indices, threads);
+    else
+        return weldWithTable(static_cast<char *>(vertices), count, vertexSize, indices);
+}
+
+uint64_t VertexWelder::hash(void const * vertex, size_t size)
+{
+    uint64_t constexpr M = 0x9e3779b97f4a7c15ull;
+
+    char const * p = static_cast<char const *>(vertex);
+    uint64_t     h = size * M;
+    while (size >= 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h     = (h ^ w) * M;
+        h    ^= h >> 29;
+        p    += 8;
+        size -= 8;
+    }
+    while (size > 0)
+    {
+        h = (h ^ (uint8_t)*p) * M;
+        ++p;
+        --size;
+    }
+
+    // Final avalanche so that both halves of the result are usable
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+VertexWelder::Slot & VertexWelder::find(void const * vertex, uint32_t h)
+{
+    size_t position = homePosition(h, shift_);
+    for (;;)
+    {
+        Slot & slot = table_[position];
+        if (slot.index == EMPTY)
+            return slot;
+        if (slot.hash == h && memcmp(&vertices_[slot.index * vertexSize_], vertex, vertexSize_) == 0)
+            return slot;
+        position = (position + 1) & mask_;
+    }
+}
+
+void VertexWelder::grow()
+{
+    std::vector<Slot> old(table_.size() * 2, { 0, EMPTY });
+    old.swap(table_);
+    mask_  = table_.size() - 1;
+    shift_ = positionShift(table_.size());
+    for (auto const & slot : old)
+    {
+        if (slot.index != EMPTY)
+        {
+            size_t position = homePosition(slot.hash, shift_);
+            while (table_[position].index != EMPTY)
+            {
+                position = (position + 1) & mask_;
+            }
+            table_[position] = slot;
+        }
+    }
+}
+
+size_t VertexWelder::weldWithTable(char * vertices, size_t count, size_t vertexSize, uint32_t * indices)
+{
+    std::vector<Slot> table(tableCapacity(count), { 0, EMPTY });
+    size_t const   mask  = table.size() - 1;
+    unsigned const shift = positionShift(table.size());
+
+    // Unique vertices are moved down as they are found. A vertex is never moved to a position after its own, so the
+    // vertices that have not been visited yet are never overwritten.
+    size_t unique = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        char const * vertex   = vertices + i * vertexSize;
+        uint32_t     h        = (uint32_t)hash(vertex, vertexSize);
+        size_t       position = homePosition(h, shift);
+        for (;;)
+        {
+            Slot & slot = table[position];
+            if (slot.index == EMPTY)
+            {
+                if (unique != i)
+                    memcpy(vertices + unique * vertexSize, vertex, vertexSize);
+                slot       = { h, (uint32_t)unique };
+                indices[i] = (uint32_t)unique++;
+                break;
+            }
+            if (slot.hash == h && memcmp(vertices + slot.index * vertexSize, vertex, vertexSize) == 0)
+            {
+                indices[i] = slot.index;
+                break;
+            }
+            position = (position + 1) & mask;
+        }
+    }
+    return unique;
+}
+
+size_t VertexWelder::weldWithSort(char * vertices, size_t count, size_t vertexSize, uint32_t * indices, unsigned threads)
+{
+    if (count == 0)
+        return 0;
+
+    // Sort the corners by hash. The sort is stable, so corners with the same hash remain in ascending order.
+    std::vector<uint64_t> keys(count);
+    parallelForRanges(count, threads, [&] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint64_t h = hash(vertices + i * vertexSize, vertexSize);
+            keys[i] = (h & 0xffffffff00000000ull) | i;
+        }
+    });
+    radixSortByHash(keys, threads);
+
+    // Within each run of equal hashes, map every corner to the first corner with identical contents. Runs are
+    // nearly always a single vertex, so the list of distinct vertices in a run is searched linearly. The work is
+    // divided at run boundaries.
+    std::vector<uint32_t> first(count);
+    parallelForRanges(count, threads, [&] (size_t begin, size_t end) {
+        while (begin > 0 && begin < count && (keys[begin] >> 32) == (keys[begin - 1] >> 32))
+        {
+            ++begin;
+        }
+        while (end < count && (keys[end] >> 32) == (keys[end - 1] >> 32))
+        {
+            ++end;
+        }
+
+        std::vector<uint32_t> distinct;
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (i == begin || (keys[i] >> 32) != (keys[i - 1] >> 32))
+                distinct.clear();
+
+            uint32_t corner = (uint32_t)keys[i];
+            uint32_t match  = corner;
+            for (uint32_t d : distinct)
+            {
+                if (memcmp(vertices + (size_t)d * vertexSize, vertices + (size_t)corner * vertexSize, vertexSize) == 0)
+                {
+                    match = d;
+                    break;
+                }
+            }
+            if (match == corner)
+                distinct.push_back(corner);
+            first[corner] = match;
+        }
+    });
+
+    // Number the unique vertices in order of their first corner. The counts per range are scanned to get each
+    // range's starting number.
+    size_t const ranges = std::max<size_t>(1, std::min<size_t>(threadCount(threads), count));
+    std::vector<size_t> starts(ranges + 1, 0);
+    parallelFor(ranges, (unsigned)ranges, [&] (size_t r) {
+        size_t n = 0;
+        for (size_t i = count * r / ranges; i < count * (r + 1) / ranges; ++i)
+        {
+            if (first[i] == i)
+                ++n;
+        }
+        starts[r + 1] = n;
+    });
+    for (size_t r = 0; r < ranges; ++r)
+    {
+        starts[r + 1] += starts[r];
+    }
+    parallelFor(ranges, (unsigned)ranges, [&] (size_t r) {
+        size_t id = starts[r];
+        for (size_t i = count * r / ranges; i < count * (r + 1) / ranges; ++i)
+        {
+            if (first[i] == i)
+                indices[i] = (uint32_t)id++;
+        }
+    });
+
+    // Every other corner takes the number of its first corner, which always precedes it.
+    parallelForRanges(count, threads, [&] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (first[i] != i)
+                indices[i] = indices[first[i]];
+        }
+    });
+
+    // Compact the unique vertices in place. This must be done in order, because a vertex may be moved into a
+    // position that another range has not read yet.
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (first[i] == i && indices[i] != i)
+            memcpy(vertices + (size_t)indices[i] * vertexSize, vertices + i * vertexSize, vertexSize);
+    }
+
+    return starts[ranges];
+}
@@ -0,0 +1,69 @@
+#if !defined(VERTEXWELDER_H)
+#define VERTEXWELDER_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Merges identical vertices into a single vertex referenced by multiple indices.
+//
+// Vertices are compared and hashed as raw bytes, so any padding must be zeroed and values that compare equal but have
+// different representations (such as 0.0 and -0.0) are considered different. Unique vertices are numbered in the
+// order in which they are first seen.
+class VertexWelder
+{
+public:
+    // Creates a welder for vertices of `vertexSize` bytes. The table is sized to hold `expectedCount` unique vertices
+    // without growing.
+    VertexWelder(size_t vertexSize, size_t expectedCount);
+
+    // Adds a vertex and returns its index. Adding a vertex identical to one already added returns the same index.
+    uint32_t add(void const * vertex);
+
+    // Returns the number of unique vertices
+    size_t size() const { return vertices_.size() / vertexSize_; }
+
+    // Returns the unique vertices
+    void const * vertices() const { return vertices_.data(); }
+
+    // Frees the table and returns the unique vertices, leaving the welder empty
+    std::vector<char> release();
+
+    // Welds an array of `count` vertices of `vertexSize` bytes, one per triangle corner. One index per corner is
+    // written to `indices`, and the unique vertices are moved to the front of `vertices`. Returns the number of unique
+    // vertices.
+    //
+    // With more than one thread, a sort-based method is used instead of a hash table: the corners are radix-sorted by
+    // hash, equal runs are merged, and the results are compacted. The output is identical either way.
+    static size_t weld(void * vertices, size_t count, size_t vertexSize, uint32_t * indices, unsigned threads = 1);
+
+    // Returns a hash of the bytes of a vertex
+    static uint64_t hash(void const * vertex, size_t size);
+
+private:
+    static uint32_t constexpr EMPTY = 0xffffffff;
+
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t index;
+    };
+
+    // Returns the slot containing the vertex, or the empty slot where it belongs
+    Slot & find(void const * vertex, uint32_t h);
+
+    void grow();
+
+    static size_t weldWithTable(char * vertices, size_t count, size_t vertexSize, uint32_t * indices);
+    static size_t weldWithSort(char * vertices, size_t count, size_t vertexSize, uint32_t * indices, unsigned threads);
+
+    size_t vertexSize_;
+    std::vector<Slot> table_;
+    size_t mask_;
+    unsigned shift_;    // 64 - log2 of the capacity of the table (see homePosition)
+    std::vector<char> vertices_;
+};
+
+#endif // !defined(VERTEXWELDER_H)
@@ -0,0 +1,406 @@
+#include "VirtualTextures.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+// Largest number of pages that have been read and are waiting to be put in slots. The threads wait when there are more.
+size_t constexpr MAX_READ_PAGES = 256;
+
+uint32_t levelSize(uint32_t size, uint32_t level)
+{
+    return std::max(size >> level, 1u);
+}
+
+uint32_t pageCount(uint32_t size)
+{
+    return (size + VirtualTextures::PAGE_SIZE - 1) / VirtualTextures::PAGE_SIZE;
+}
+
+// Returns the page of a level `toSize` texels wide that contains the center of page p of a level `fromSize` texels wide.
+// The shader computes this the same way.
+uint32_t ancestor(uint32_t p, uint32_t fromSize, uint32_t toSize)
+{
+    uint64_t page = ((2 * (uint64_t)p + 1) * toSize) / (2 * (uint64_t)fromSize);
+    return std::min((uint32_t)page, pageCount(toSize) - 1);
+}
+
+// Returns the range of pages [first, last) of a level `fromSize` texels wide whose ancestor in a level `toSize` texels
+// wide is page p
+void descendants(uint32_t p, uint32_t fromSize, uint32_t toSize, uint32_t & first, uint32_t & last)
+{
+    uint32_t count = pageCount(fromSize);
+    first = std::min((uint32_t)((uint64_t)p * fromSize / toSize), count - 1);
+    while (first > 0 && ancestor(first - 1, fromSize, toSize) >= p)
+    {
+        --first;
+    }
+    while (first < count && ancestor(first, fromSize, toSize) < p)
+    {
+        ++first;
+    }
+    last = first;
+    while (last < count && ancestor(last, fromSize, toSize) == p)
+    {
+        ++last;
+    }
+}
+
+// Returns i modulo n for a possibly negative i
+uint32_t wrap(int64_t i, uint32_t n)
+{
+    int64_t r = i % (int64_t)n;
+    return (uint32_t)(r < 0 ? r + n : r);
+}
+} // anonymous namespace
+
+VirtualTextures::VirtualTextures(TextureFormat format, uint32_t slotCount, unsigned threads)
+    : format_(format)
+    , slots_(slotCount)
+    , threadCount_(std::max(threads, 1u))
+{
+    if (slotCount == 0 || slotCount > SLOT_MASK + 1)
+        throw std::runtime_error("VirtualTextures: invalid number of slots");
+}
+
+VirtualTextures::~VirtualTextures()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto & thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+bool VirtualTextures::add(char const * cachePath, TextureCache::Key const & key)
+{
+    if (!threads_.empty())
+        throw std::runtime_error("VirtualTextures::add: textures cannot be added after start()");
+
+    caches_.emplace_back();
+    TextureCache & cache = caches_.back();
+    size_t levelCount = 0;
+    if (cache.open(cachePath, key))
+        cache.levels(&levelCount);
+    if (levelCount == 0 || cache.format() != format_)
+    {
+        caches_.pop_back();
+        return false;
+    }
+
+    TextureCache::Level const * levels = cache.levels(&levelCount);
+    Texture texture = {};
+    texture.width  = levels[0].width;
+    texture.height = levels[0].height;
+    uint32_t entry = (uint32_t)table_.size();
+    for (uint32_t l = 0; l < levelCount && texture.levelCount < MAX_LEVELS; ++l)
+    {
+        uint32_t pagesX = pageCount(levels[l].width);
+        uint32_t pagesY = pageCount(levels[l].height);
+        texture.levelOffsets[l] = entry;
+        texture.levelCount      = l + 1;
+        entry += pagesX * pagesY;
+        if (pagesX == 1 && pagesY == 1)
+            break;
+    }
+
+    // A texture too large to reach a single page within MAX_LEVELS levels cannot be paged.
+    if (pageCount(levelSize(texture.width, texture.levelCount - 1)) > 1 ||
+        pageCount(levelSize(texture.height, texture.levelCount - 1)) > 1)
+    {
+        caches_.pop_back();
+        return false;
+    }
+
+    textures_.push_back(texture);
+    table_.resize(entry, NONE);
+    residentSlots_.resize(entry, NONE);
+    queued_.resize(entry, false);
+    return true;
+}
+
+std::vector<VirtualTextures::Page> VirtualTextures::start()
+{
+    if (textures_.size() > slots_.size())
+        throw std::runtime_error("VirtualTextures::start: more textures than slots");
+
+    size_t slotBytes = textureSize(format_, SLOT_SIZE, SLOT_SIZE);
+    std::vector<Page> pages;
+    for (uint32_t t = 0; t < (uint32_t)textures_.size(); ++t)
+    {
+        Location coarsest = { t, textures_[t].levelCount - 1, 0, 0 };
+        uint32_t slot     = (uint32_t)pages.size();
+        pages.push_back({ slot, std::vector<uint8_t>(slotBytes) });
+        readPage(coarsest, pages.back().texels.data());
+        slots_[slot].pinned = true;
+        assign(entryOf(coarsest), slot);
+    }
+
+    for (unsigned i = 0; i < threadCount_; ++i)
+    {
+        threads_.emplace_back([this] { stream(); });
+    }
+    return pages;
+}
+
+void VirtualTextures::request(uint32_t const * feedback, uint64_t frame)
+{
+    std::vector<uint32_t> missing;
+    for (uint32_t e = 0; e < (uint32_t)table_.size(); ++e)
+    {
+        if (feedback[e] == 0)
+            continue;
+
+        // The page drawn in place of a missing page is in use as well.
+        slots_[table_[e] & SLOT_MASK].lastUsed = frame;
+        if (residentSlots_[e] == NONE && !queued_[e])
+        {
+            queued_[e] = true;
+            missing.push_back(e);
+        }
+    }
+    if (missing.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (uint32_t e : missing)
+        {
+            requests_[locate(e).level].push_back(e);
+        }
+    }
+    wake_.notify_all();
+}
+
+std::vector<VirtualTextures::Page> VirtualTextures::update(size_t     maxCount,
+                                                           uint64_t   frame,
+                                                           size_t &   dirtyBegin,
+                                                           size_t &   dirtyEnd)
+{
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> read;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!read_.empty() && read.size() < maxCount)
+        {
+            read.push_back(std::move(read_.front()));
+            read_.pop_front();
+        }
+    }
+    if (!read.empty())
+        wake_.notify_all();
+
+    dirtyBegin_ = table_.size();
+    dirtyEnd_   = 0;
+    std::vector<Page> pages;
+    for (auto & page : read)
+    {
+        uint32_t entry = page.first;
+        queued_[entry] = false;
+        if (residentSlots_[entry] != NONE)
+            continue;
+
+        uint32_t slot = takeSlot(frame);
+        if (slot == NONE)
+            continue;
+        if (slots_[slot].entry != NONE)
+            evict(slot);
+        assign(entry, slot);
+        slots_[slot].lastUsed = frame;
+        pages.push_back({ slot, std::move(page.second) });
+    }
+
+    dirtyBegin = std::min(dirtyBegin_, dirtyEnd_);
+    dirtyEnd   = dirtyEnd_;
+    return pages;
+}
+
+VirtualTextures::Location VirtualTextures::locate(uint32_t entry) const
+{
+    // The textures' entries are in the order they were added, and so are their levels'.
+    auto texture = std::upper_bound(textures_.begin(),
+                                    textures_.end(),
+                                    entry,
+                                    [] (uint32_t e, Texture const & t) { return e < t.levelOffsets[0]; }) - 1;
+    uint32_t level = texture->levelCount - 1;
+    while (texture->levelOffsets[level] > entry)
+    {
+        --level;
+    }
+    uint32_t page   = entry - texture->levelOffsets[level];
+    uint32_t pagesX = pageCount(levelSize(texture->width, level));
+    return { (uint32_t)(texture - textures_.begin()), level, page % pagesX, page / pagesX };
+}
+
+uint32_t VirtualTextures::entryOf(Location const & location) const
+{
+    Texture const & texture = textures_[location.texture];
+    uint32_t        pagesX  = pageCount(levelSize(texture.width, location.level));
+    return texture.levelOffsets[location.level] + location.y * pagesX + location.x;
+}
+
+// Returns a free slot, or else the unpinned slot used the longest ago if it was not used by `frame`, or else NONE
+uint32_t VirtualTextures::takeSlot(uint64_t frame)
+{
+    uint32_t oldest = NONE;
+    for (uint32_t s = 0; s < (uint32_t)slots_.size(); ++s)
+    {
+        Slot const & slot = slots_[s];
+        if (slot.entry == NONE)
+            return s;
+        if (!slot.pinned && slot.lastUsed < frame && (oldest == NONE || slot.lastUsed < slots_[oldest].lastUsed))
+            oldest = s;
+    }
+    return oldest;
+}
+
+// Puts an entry's page in a slot, and points the entries that fall back to a coarser page at it
+void VirtualTextures::assign(uint32_t entry, uint32_t slot)
+{
+    Location location = locate(entry);
+    uint32_t value    = slot | location.level << LEVEL_SHIFT;
+    residentSlots_[entry] = slot;
+    slots_[slot].entry    = entry;
+    forEachDescendant(location, [&] (uint32_t e, Location const &) {
+        if (e == entry || (table_[e] >> LEVEL_SHIFT) > location.level)
+            setEntry(e, value);
+    });
+}
+
+// Removes the page from a slot, and points the entries that used it at their next coarser resident page
+void VirtualTextures::evict(uint32_t slot)
+{
+    uint32_t entry    = slots_[slot].entry;
+    Location location = locate(entry);
+    uint32_t value    = slot | location.level << LEVEL_SHIFT;
+    residentSlots_[entry] = NONE;
+    slots_[slot].entry    = NONE;
+    forEachDescendant(location, [&] (uint32_t e, Location const & descendant) {
+        if (table_[e] == value)
+            setEntry(e, fallback(descendant, location.level + 1));
+    });
+}
+
+// Returns the entry value of the nearest resident page containing the center of a page, starting at `level`
+uint32_t VirtualTextures::fallback(Location const & location, uint32_t level) const
+{
+    Texture const & texture = textures_[location.texture];
+    uint32_t        width   = levelSize(texture.width, location.level);
+    uint32_t        height  = levelSize(texture.height, location.level);
+    for (; level < texture.levelCount; ++level)
+    {
+        Location coarser = { location.texture,
+                             level,
+                             ancestor(location.x, width, levelSize(texture.width, level)),
+                             ancestor(location.y, height, levelSize(texture.height, level)) };
+        uint32_t slot = residentSlots_[entryOf(coarser)];
+        if (slot != NONE)
+            return slot | level << LEVEL_SHIFT;
+    }
+    throw std::runtime_error("VirtualTextures::fallback: the coarsest page is not resident");
+}
+
+void VirtualTextures::setEntry(uint32_t entry, uint32_t value)
+{
+    table_[entry] = value;
+    dirtyBegin_   = std::min(dirtyBegin_, (size_t)entry);
+    dirtyEnd_     = std::max(dirtyEnd_, (size_t)entry + 1);
+}
+
+// Calls visit(entry, location) for a page and for every page of the finer levels whose center it contains
+template <typename Visit>
+void VirtualTextures::forEachDescendant(Location const & location, Visit visit) const
+{
+    Texture const & texture = textures_[location.texture];
+    uint32_t        width   = levelSize(texture.width, location.level);
+    uint32_t        height  = levelSize(texture.height, location.level);
+    for (int32_t level = (int32_t)location.level; level >= 0; --level)
+    {
+        uint32_t levelWidth  = levelSize(texture.width, level);
+        uint32_t levelHeight = levelSize(texture.height, level);
+        uint32_t x0, x1, y0, y1;
+        descendants(location.x, levelWidth, width, x0, x1);
+        descendants(location.y, levelHeight, height, y0, y1);
+        for (uint32_t y = y0; y < y1; ++y)
+        {
+            for (uint32_t x = x0; x < x1; ++x)
+            {
+                Location descendant = { location.texture, (uint32_t)level, x, y };
+                visit(entryOf(descendant), descendant);
+            }
+        }
+    }
+}
+
+// Copies a page and its border out of its level, wrapping around the edges as the textures repeat. Block-compressed
+// levels are copied a block at a time.
+void VirtualTextures::readPage(Location const & location, uint8_t * out) const
+{
+    TextureCache const &        cache = caches_[location.texture];
+    size_t                      count;
+    size_t                      size;
+    TextureCache::Level const & level  = cache.levels(&count)[location.level];
+    uint8_t const *             texels = static_cast<uint8_t const *>(cache.texels(&size)) + level.offset;
+
+    uint32_t unit      = format_ == TextureFormat::eRGBA8 ? 1 : 4;
+    size_t   unitBytes = textureSize(format_, unit, unit);
+    uint32_t columns   = (level.width + unit - 1) / unit;
+    uint32_t rows      = (level.height + unit - 1) / unit;
+    uint32_t slotUnits = SLOT_SIZE / unit;
+    int64_t  originX   = ((int64_t)location.x * PAGE_SIZE - BORDER) / unit;
+    int64_t  originY   = ((int64_t)location.y * PAGE_SIZE - BORDER) / unit;
+    for (uint32_t r = 0; r < slotUnits; ++r)
+    {
+        uint8_t const * row = texels + (size_t)wrap(originY + r, rows) * columns * unitBytes;
+        for (uint32_t c = 0; c < slotUnits;)
+        {
+            uint32_t x = wrap(originX + c, columns);
+            uint32_t n = std::min(slotUnits - c, columns - x);
+            memcpy(out + ((size_t)r * slotUnits + c) * unitBytes, row + x * unitBytes, n * unitBytes);
+            c += n;
+        }
+    }
+}
+
+// Reads the requested pages, coarsest first, until stopped
+void VirtualTextures::stream()
+{
+    size_t slotBytes = textureSize(format_, SLOT_SIZE, SLOT_SIZE);
+    for (;;)
+    {
+        uint32_t entry = NONE;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] {
+                if (stopping_)
+                    return true;
+                if (read_.size() >= MAX_READ_PAGES)
+                    return false;
+                return std::any_of(std::begin(requests_), std::end(requests_), [] (auto const & r) { return !r.empty(); });
+            });
+            if (stopping_)
+                return;
+            for (int level = MAX_LEVELS - 1; level >= 0; --level)
+            {
+                if (!requests_[level].empty())
+                {
+                    entry = requests_[level].front();
+                    requests_[level].pop_front();
+                    break;
+                }
+            }
+        }
+
+        // The cache is mapped, so this is where the page is read from the disk if it is not in memory.
+        std::vector<uint8_t> texels(slotBytes);
+        readPage(locate(entry), texels.data());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        read_.emplace_back(entry, std::move(texels));
+    }
+}
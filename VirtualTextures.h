@@ -0,0 +1,143 @@
+#if !defined(VIRTUALTEXTURES_H)
+#define VIRTUALTEXTURES_H
+
+#pragma once
+
+#include "BlockCompressor.h"
+#include "TextureCache.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Textures that are streamed from their caches a page at a time into the slots of a physical cache of fixed size, so
+// the memory they use on the GPU is bounded no matter how large they are.
+//
+// Each level of a texture is divided into pages of PAGE_SIZE x PAGE_SIZE texels, and the page table has an entry for
+// every page of every level of every texture. An entry holds the slot of its page, or, if the page is not resident, the
+// slot and the level of the nearest coarser page that is. The coarser page is always the one containing the center of
+// the page, so the shader can find where to sample it from the entry alone. Only the levels down to the first one that
+// fits in a single page are paged, and that page is never evicted, so every entry has a page.
+//
+// The renderer reports the pages it samples in a feedback buffer with an element per entry. The missing pages are read
+// from the memory-mapped caches by background threads, coarsest first, and each frame the pages that have been read are
+// put in free slots or in the slots of the pages that were used the longest ago.
+class VirtualTextures
+{
+public:
+    static uint32_t constexpr PAGE_SIZE   = 128;    // Texels along each side of a page
+    static uint32_t constexpr BORDER      = 4;      // Texels of the neighboring pages around a page, a multiple of 4
+    static uint32_t constexpr SLOT_SIZE   = PAGE_SIZE + 2 * BORDER;
+    static uint32_t constexpr MAX_LEVELS  = 16;
+    static uint32_t constexpr LEVEL_SHIFT = 16;     // An entry is its page's slot | the page's level << LEVEL_SHIFT
+    static uint32_t constexpr SLOT_MASK   = (1u << LEVEL_SHIFT) - 1;
+
+    // A texture's paged levels and where their entries are. This must match VirtualTexture in virtual.frag (std430).
+    struct Texture
+    {
+        uint32_t width;                     // Size of level 0 in texels
+        uint32_t height;
+        uint32_t levelCount;                // The last level is a single page
+        uint32_t reserved;
+        uint32_t levelOffsets[MAX_LEVELS];  // Index of the entry of each level's first page. The pages are in rows.
+    };
+
+    // A page that has been read and the slot it goes in
+    struct Page
+    {
+        uint32_t             slot;
+        std::vector<uint8_t> texels;    // SLOT_SIZE x SLOT_SIZE texels or blocks, including the border
+    };
+
+    // The textures are stored in the given format in `slotCount` slots, and their pages are read by `threads` threads.
+    VirtualTextures(TextureFormat format, uint32_t slotCount, unsigned threads);
+
+    // Stops the threads
+    ~VirtualTextures();
+
+    VirtualTextures(VirtualTextures const &) = delete;
+    VirtualTextures & operator =(VirtualTextures const &) = delete;
+
+    // Adds a texture, whose cache stays mapped until this is destroyed. Returns false if the cache cannot be opened or
+    // is not in the format of the textures. Textures can only be added before start() is called.
+    bool add(char const * cachePath, TextureCache::Key const & key);
+
+    // Puts the coarsest page of every texture in a slot and starts reading pages in the background. Returns the pages to
+    // be copied to the physical cache.
+    std::vector<Page> start();
+
+    // Returns the format of the pages
+    TextureFormat format() const { return format_; }
+
+    // Returns the textures in the order they were added
+    std::vector<Texture> const & textures() const { return textures_; }
+
+    // Returns the entries of every page of every texture
+    std::vector<uint32_t> const & pageTable() const { return table_; }
+
+    // Marks the pages sampled by a frame as used, and queues the ones that are not resident to be read. `feedback` has
+    // an element per entry, which is not 0 if the frame sampled the entry's page.
+    void request(uint32_t const * feedback, uint64_t frame);
+
+    // Puts up to maxCount pages that have been read in slots, and points their entries and the entries falling back to
+    // them at the slots. Slots used by `frame` are not taken, so pages that do not fit are dropped and requested again
+    // later. Returns the pages, and the entries that changed in [dirtyBegin, dirtyEnd).
+    std::vector<Page> update(size_t maxCount, uint64_t frame, size_t & dirtyBegin, size_t & dirtyEnd);
+
+private:
+    static uint32_t constexpr NONE = ~0u;
+
+    // A page of a level of a texture
+    struct Location
+    {
+        uint32_t texture;
+        uint32_t level;
+        uint32_t x;
+        uint32_t y;
+    };
+
+    struct Slot
+    {
+        uint32_t entry    = NONE;   // The page in the slot, or NONE if it is free
+        uint64_t lastUsed = 0;      // The last frame that sampled the page or fell back to it
+        bool     pinned   = false;  // The page is the coarsest of its texture
+    };
+
+    Location locate(uint32_t entry) const;
+    uint32_t entryOf(Location const & location) const;
+    uint32_t takeSlot(uint64_t frame);
+    void     assign(uint32_t entry, uint32_t slot);
+    void     evict(uint32_t slot);
+    uint32_t fallback(Location const & location, uint32_t level) const;
+    void     setEntry(uint32_t entry, uint32_t value);
+    template <typename Visit>
+    void     forEachDescendant(Location const & location, Visit visit) const;
+    void     readPage(Location const & location, uint8_t * out) const;
+    void     stream();
+
+    TextureFormat             format_;
+    std::deque<TextureCache>  caches_;      // A deque, so adding a cache does not move the others
+    std::vector<Texture>      textures_;
+    std::vector<uint32_t>     table_;
+    std::vector<uint32_t>     residentSlots_;   // The slot of each entry's own page, or NONE
+    std::vector<char>         queued_;          // The entry's page is waiting to be read or put in a slot
+    std::vector<Slot>         slots_;
+    size_t                    dirtyBegin_ = 0;
+    size_t                    dirtyEnd_   = 0;
+
+    // Shared with the threads and guarded by mutex_
+    std::mutex                                          mutex_;
+    std::condition_variable                             wake_;
+    std::deque<uint32_t>                                requests_[MAX_LEVELS];  // By level, read coarsest first
+    std::deque<std::pair<uint32_t, std::vector<uint8_t>>> read_;
+    bool                                                stopping_ = false;
+
+    unsigned                 threadCount_;
+    std::vector<std::thread> threads_;
+};
+
+#endif // !defined(VIRTUALTEXTURES_H)
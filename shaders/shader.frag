@@ -1,14 +1,21 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 1) uniform sampler2D texSampler;
+// The number of textures in the model, set when the pipeline is created
+layout(constant_id = 0) const uint TEXTURE_COUNT = 1;
 
-layout(location = 0) in vec3 fragColor;
-layout(location = 1) in vec2 fragTexCoord;
+layout(binding = 1) uniform sampler2D textures[TEXTURE_COUNT];
+
+// The texture of the draw range being drawn
+layout(push_constant) uniform Material {
+    uint textureIndex;
+} material;
+
+layout(location = 0) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
 void main()
 {
-    outColor = texture(texSampler, fragTexCoord);
+    outColor = texture(textures[material.textureIndex], fragTexCoord);
 }
@@ -5,18 +5,19 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 projection;
+    vec4 positionScale;         // Restores a quantized position: position = input * scale + offset
+    vec4 positionOffset;
+    vec4 texCoordScaleOffset;   // Restores quantized texture coordinates: coordinates = input * xy + zw
 } ubo;
 
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec2 inTexCoord;
+layout(location = 1) in vec2 inTexCoord;
 
-layout(location = 0) out vec3 fragColor;
-layout(location = 1) out vec2 fragTexCoord;
+layout(location = 0) out vec2 fragTexCoord;
 
 void main()
 {
-    gl_Position = ubo.projection * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragColor = inColor;
-    fragTexCoord = inTexCoord;
+    vec3 position = inPosition * ubo.positionScale.xyz + ubo.positionOffset.xyz;
+    gl_Position = ubo.projection * ubo.view * ubo.model * vec4(position, 1.0);
+    fragTexCoord = inTexCoord * ubo.texCoordScaleOffset.xy + ubo.texCoordScaleOffset.zw;
 }
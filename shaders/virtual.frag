@@ -0,0 +1,116 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// The fragments that fail the depth test must not request pages.
+layout(early_fragment_tests) in;
+
+// These must match VirtualTextures.
+const uint PAGE_SIZE   = 128;
+const uint BORDER      = 4;
+const uint SLOT_SIZE   = PAGE_SIZE + 2 * BORDER;
+const uint MAX_LEVELS  = 16;
+const uint LEVEL_SHIFT = 16;
+const uint SLOT_MASK   = (1u << LEVEL_SHIFT) - 1;
+
+// The number of slots along each side of the page cache, set when the pipeline is created
+layout(constant_id = 0) const uint SLOTS_PER_SIDE = 1;
+
+struct VirtualTexture {
+    uint width;                     // Size of level 0 in texels
+    uint height;
+    uint levelCount;                // The last level is a single page
+    uint reserved;
+    uint levelOffsets[MAX_LEVELS];  // Index of the entry of each level's first page
+};
+
+layout(binding = 1) uniform sampler2D pageCache;
+
+layout(std430, binding = 2) readonly buffer VirtualTextures {
+    VirtualTexture textures[];
+};
+
+// Each entry holds the slot of its page, or of the nearest coarser resident page containing its center, and the level
+// of the page in the slot.
+layout(std430, binding = 3) readonly buffer PageTable {
+    uint entries[];
+};
+
+// Set to 1 for each page that is sampled
+layout(std430, binding = 4) writeonly buffer Feedback {
+    uint requested[];
+};
+
+// The texture of the draw range being drawn
+layout(push_constant) uniform Material {
+    uint textureIndex;
+} material;
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+uvec2 levelSize(uint t, uint level)
+{
+    return max(uvec2(textures[t].width, textures[t].height) >> level, uvec2(1));
+}
+
+uvec2 pageCount(uvec2 size)
+{
+    return (size + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+// Returns the index of the entry of the page of a level that contains uv
+uint pageEntry(uint t, uint level, vec2 uv, out uvec2 page)
+{
+    uvec2 size  = levelSize(t, level);
+    uvec2 pages = pageCount(size);
+    page = min(uvec2(uv * vec2(size)) / PAGE_SIZE, pages - 1);
+    return textures[t].levelOffsets[level] + page.y * pages.x + page.x;
+}
+
+// Samples a level bilinearly from the page cache, or the nearest coarser level that is resident
+vec4 sampleLevel(uint t, uint level, vec2 uv, uint entryIndex, uvec2 page)
+{
+    uint  entry    = entries[entryIndex];
+    uint  slot     = entry & SLOT_MASK;
+    uint  resident = entry >> LEVEL_SHIFT;
+    uvec2 size     = levelSize(t, level);
+
+    // The resident page is the one that contains the center of the requested page.
+    uvec2 residentSize = levelSize(t, resident);
+    uvec2 residentPage = min(((2 * page + 1) * residentSize) / (2 * size), pageCount(residentSize) - 1);
+
+    // Within a few texels of the page, which the border covers
+    vec2 texel  = uv * vec2(residentSize) - vec2(residentPage * PAGE_SIZE);
+    vec2 origin = vec2(uvec2(slot % SLOTS_PER_SIDE, slot / SLOTS_PER_SIDE) * SLOT_SIZE + BORDER);
+    return textureLod(pageCache, (origin + texel) / float(SLOTS_PER_SIDE * SLOT_SIZE), 0.0);
+}
+
+void main()
+{
+    uint t  = material.textureIndex;
+    vec2 uv = fract(fragTexCoord);
+
+    // The level of detail is computed as the sampler would, and the two nearest levels are blended.
+    vec2  size0 = vec2(levelSize(t, 0));
+    vec2  dx    = dFdx(fragTexCoord) * size0;
+    vec2  dy    = dFdy(fragTexCoord) * size0;
+    float lod   = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, float(textures[t].levelCount - 1));
+    uint  fine   = uint(lod);
+    uint  coarse = min(fine + 1, textures[t].levelCount - 1);
+
+    uvec2 finePage;
+    uvec2 coarsePage;
+    uint  fineEntry   = pageEntry(t, fine, uv, finePage);
+    uint  coarseEntry = pageEntry(t, coarse, uv, coarsePage);
+    outColor = mix(sampleLevel(t, fine, uv, fineEntry, finePage),
+                   sampleLevel(t, coarse, uv, coarseEntry, coarsePage),
+                   fract(lod));
+
+    // One pixel in 16 reports the pages it needs, which is plenty for pages that cover about 128x128 pixels.
+    if ((uint(gl_FragCoord.x) & 3u) == 0u && (uint(gl_FragCoord.y) & 3u) == 0u)
+    {
+        requested[fineEntry]   = 1;
+        requested[coarseEntry] = 1;
+    }
+}
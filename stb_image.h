@@ -160,7 +160,9 @@ Blazej Dariusz Roszkowski                                     github:Michaelange
 // stbi_failure_reason() can be queried for an extremely brief, end-user
 // unfriendly explanation of why the load failed. Define STBI_NO_FAILURE_STRINGS
 // to avoid compiling these strings at all, and STBI_FAILURE_USERMSG to get slightly
-// more user-friendly ones.
+// more user-friendly ones. The reason is kept per thread, so images can be loaded
+// on several threads at once; define STBI_NO_THREAD_LOCALS to use one shared
+// reason on compilers without thread-local storage.
 //
 // Paletted PNG, BMP, GIF, and PIC images are automatically depalettized.
 //
@@ -226,6 +228,11 @@ Blazej Dariusz Roszkowski                                     github:Michaelange
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// On x86 with GCC, Clang or VC++ 2015 and later, AVX2 versions of the JPEG
+// IDCT, color conversion and 2x2 upsampling and of the PNG "up" filter are
+// compiled as well, without needing -mavx2, and are used when a run-time test
+// finds AVX2. define STBI_NO_AVX2 to leave them out.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
@@ -373,6 +380,12 @@ extern "C" {
     STBIDEF stbi_uc *stbi_load_from_memory   (stbi_uc           const *buffer, int len   , int *x, int *y, int *channels_in_file, int desired_channels);
     STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *channels_in_file, int desired_channels);
 
+    // decode into a caller-provided buffer of output_size bytes instead of allocating the image. the buffer must hold
+    // x*y*desired_channels bytes, and desired_channels must not be 0. returns output, or NULL on failure, including
+    // when the buffer is too small; stb_image never frees the buffer. JPEGs are decoded directly into it; other
+    // formats are decoded as usual and copied.
+    STBIDEF stbi_uc *stbi_load_from_memory_into(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_uc *output, size_t output_size);
+
 #ifndef STBI_NO_STDIO
     STBIDEF stbi_uc *stbi_load            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
     STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
@@ -467,6 +480,19 @@ extern "C" {
     // flip the image vertically, so the first pixel in the output array is the bottom left
     STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+    // use the AVX2 kernels when the CPU has AVX2 (the default), or always use the SSE2 or scalar code instead.
+    // returns whether the AVX2 kernels are used from now on, which is never when they are compiled out.
+    STBIDEF int stbi_set_use_avx2(int flag_true_if_should_use_avx2);
+
+    // run independent parts of a decode on several threads. stb_image calls func(user, count, task, task_data),
+    // which must call task(task_data, i) exactly once for every i in [0, count), in any order and on any threads,
+    // and return when all of the calls have returned. currently only JPEGs loaded from memory use it: the restart
+    // intervals of baseline scans are decoded in parallel, as are the IDCT of progressive images and the
+    // upsampling and color conversion of all images. pass NULL (the default) to decode on the calling thread.
+    typedef void stbi_parallel_task(void *task_data, int index);
+    typedef void stbi_parallel_for_func(void *user, int count, stbi_parallel_task *task, void *task_data);
+    STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func *func, void *user);
+
     // ZLIB client - used by PNG, available for other purposes
 
     STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -563,6 +589,24 @@ extern "C" {
 #define stbi_inline __forceinline
 #endif
 
+#ifndef STBI_NO_THREAD_LOCALS
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define STBI_THREAD_LOCAL       thread_local
+#elif defined(__GNUC__) && __GNUC__ < 5
+#define STBI_THREAD_LOCAL       __thread
+#elif defined(_MSC_VER)
+#define STBI_THREAD_LOCAL       __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define STBI_THREAD_LOCAL       _Thread_local
+#endif
+
+#ifndef STBI_THREAD_LOCAL
+#if defined(__GNUC__)
+#define STBI_THREAD_LOCAL       __thread
+#endif
+#endif
+#endif
+
 
 #ifdef _MSC_VER
 typedef unsigned short stbi__uint16;
@@ -676,7 +720,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
     int info3 = stbi__cpuid3();
@@ -687,7 +731,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
     // If we're even attempting to compile this on GCC/Clang, that means
@@ -697,6 +741,45 @@ static int stbi__sse2_available(void)
 }
 #endif
 
+#endif
+
+// AVX2 kernels are compiled for their own functions with a target attribute, so the rest of the
+// file doesn't need -mavx2, and are chosen at run time. clang-cl is left out, since it needs the
+// attribute but has neither __builtin_cpu_supports nor an _xgetbv that works without -mxsave.
+#if !defined(STBI_NO_AVX2) && (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG))
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#ifndef _MSC_VER
+#define STBI_AVX2
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#elif defined(_MSC_VER) && _MSC_VER >= 1900
+#define STBI_AVX2
+#define STBI__AVX2_TARGET
+#endif
+#endif
+
+#ifdef STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+static int stbi__avx2_available(void)
+{
+    // the OS must also save the upper halves of the ymm registers (OSXSAVE, then XCR0 bits 1 and 2)
+    int info[4];
+    __cpuid(info,0);
+    if (info[0] < 7) return 0;
+    __cpuid(info,1);
+    if (((info[2] >> 27) & 1) == 0 || (_xgetbv(0) & 6) != 6) return 0;
+    __cpuidex(info,7,0);
+    return ((info[1] >> 5) & 1) != 0;
+}
+#else
+static int stbi__avx2_available(void)
+{
+    // this checks that the OS saves the ymm registers, too
+    return __builtin_cpu_supports("avx2");
+}
+#endif
 #endif
 #endif
 
@@ -735,6 +818,10 @@ typedef struct
 
     stbi_uc *img_buffer, *img_buffer_end;
     stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+    // caller-provided buffer to decode into, if the loader supports it (see stbi_load_from_memory_into)
+    stbi_uc *output;
+    size_t output_size;
 } stbi__context;
 
 
@@ -747,6 +834,8 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
     s->read_from_callbacks = 0;
     s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
     s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+    s->output = NULL;
+    s->output_size = 0;
 }
 
 // initialize a callback-based context
@@ -756,6 +845,8 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
     s->io_user_data = user;
     s->buflen = sizeof(s->buffer_start);
     s->read_from_callbacks = 1;
+    s->output = NULL;
+    s->output_size = 0;
     s->img_buffer_original = s->buffer_start;
     stbi__refill_buffer(s);
     s->img_buffer_original_end = s->img_buffer_end;
@@ -873,8 +964,13 @@ static void    *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
-static const char *stbi__g_failure_reason;
+// each thread has its own failure reason, unless STBI_NO_THREAD_LOCALS is defined or the compiler has no thread-local
+// storage
+static
+#ifdef STBI_THREAD_LOCAL
+STBI_THREAD_LOCAL
+#endif
+const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -1002,6 +1098,45 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
     stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
+static int stbi__avx2_enabled = 1;
+
+#ifdef STBI_AVX2
+static int stbi__use_avx2(void)
+{
+    return stbi__avx2_enabled && stbi__avx2_available();
+}
+#endif
+
+STBIDEF int stbi_set_use_avx2(int flag_true_if_should_use_avx2)
+{
+    stbi__avx2_enabled = flag_true_if_should_use_avx2;
+#ifdef STBI_AVX2
+    return stbi__use_avx2();
+#else
+    return 0;
+#endif
+}
+
+static stbi_parallel_for_func *stbi__parallel_for = NULL;
+static void *stbi__parallel_for_user = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func *func, void *user)
+{
+    stbi__parallel_for = func;
+    stbi__parallel_for_user = user;
+}
+
+// call task(task_data, i) for every i in [0, count), on several threads if a parallel-for has been set
+static void stbi__parallel(int count, stbi_parallel_task *task, void *task_data)
+{
+    int i;
+    if (stbi__parallel_for && count > 1)
+        stbi__parallel_for(stbi__parallel_for_user, count, task, task_data);
+    else
+        for (i=0; i < count; ++i)
+            task(task_data, i);
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
     memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1296,6 +1431,30 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
     return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_into(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_uc *output, size_t output_size)
+{
+    stbi__context s;
+    stbi_uc *result;
+    size_t size;
+    if (req_comp <= 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+    stbi__start_mem(&s,buffer,len);
+    s.output = output;
+    s.output_size = output_size;
+    result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+    if (result == NULL || result == output)
+        return result;
+
+    // the loader allocated the image, so copy it
+    size = (size_t) *x * *y * req_comp;
+    if (size > output_size) {
+        STBI_FREE(result);
+        return stbi__errpuc("buffer too small", "Output buffer is too small for the image");
+    }
+    memcpy(output, result, size);
+    STBI_FREE(result);
+    return output;
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -2508,6 +2667,181 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 version of the sse2 IDCT above. each row's 32-bit intermediates, which sse2 keeps in
+// a lo/hi pair of registers, are held in one ymm register, which halves the wide arithmetic.
+// the results are bit-identical.
+STBI__AVX2_TARGET
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+    __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+    __m128i tmp;
+
+    // dot product constant: even elems=x, odd elems=y
+#define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+    // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+    // out(1) = c1[even]*x + c1[odd]*y
+#define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+    // out = in << 12  (in 16-bit, out 32-bit)
+#define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+    // wide add
+#define dct_wadd(out, a, b) \
+      __m256i out = _mm256_add_epi32(a, b)
+
+    // wide sub
+#define dct_wsub(out, a, b) \
+      __m256i out = _mm256_sub_epi32(a, b)
+
+    // butterfly a/b, add bias, then shift by "s" and pack. packs works within 128-bit lanes,
+    // so the qwords are put back in order afterwards.
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srai_epi32(sum, s), _mm256_srai_epi32(dif, s)), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+    // 8-bit interleave step (for transposes)
+#define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+    // 16-bit interleave step (for transposes)
+#define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+#define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+    __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+    __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+    __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+    __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+    __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+    __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+    __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+    __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+    // rounding biases in column/row passes, see stbi__idct_block for explanation.
+    __m256i bias_0 = _mm256_set1_epi32(512);
+    __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+    // load
+    row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+    row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+    row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+    row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+    row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+    row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+    row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+    row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+    // column pass
+    dct_pass(bias_0, 10);
+
+    {
+        // 16bit 8x8 transpose pass 1
+        dct_interleave16(row0, row4);
+        dct_interleave16(row1, row5);
+        dct_interleave16(row2, row6);
+        dct_interleave16(row3, row7);
+
+        // transpose pass 2
+        dct_interleave16(row0, row2);
+        dct_interleave16(row1, row3);
+        dct_interleave16(row4, row6);
+        dct_interleave16(row5, row7);
+
+        // transpose pass 3
+        dct_interleave16(row0, row1);
+        dct_interleave16(row2, row3);
+        dct_interleave16(row4, row5);
+        dct_interleave16(row6, row7);
+    }
+
+    // row pass
+    dct_pass(bias_1, 17);
+
+    {
+        // pack
+        __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+        __m128i p1 = _mm_packus_epi16(row2, row3);
+        __m128i p2 = _mm_packus_epi16(row4, row5);
+        __m128i p3 = _mm_packus_epi16(row6, row7);
+
+        // 8bit 8x8 transpose pass 1
+        dct_interleave8(p0, p2); // a0e0a1e1...
+        dct_interleave8(p1, p3); // c0g0c1g1...
+
+        // transpose pass 2
+        dct_interleave8(p0, p1); // a0c0e0g0...
+        dct_interleave8(p2, p3); // b0d0f0h0...
+
+        // transpose pass 3
+        dct_interleave8(p0, p2); // a0b0c0d0...
+        dct_interleave8(p1, p3); // a4b4c4d4...
+
+        // store
+        _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+        _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+        _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+        _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+        _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+        _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+        _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+        _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+    }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2750,8 +3084,162 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
     // since we don't even allow 1<<30 pixels
 }
 
+// restart segments of baseline scans are decoded in parallel. each segment begins with the entropy decoder
+// and the dc prediction reset, so once its start is found, it can be decoded independently of the others.
+// the image must be in memory, so the segments can be found by scanning for their markers.
+#define STBI__JPEG_MAX_SEGMENT_TASKS 256
+
+typedef struct
+{
+    stbi__jpeg *z;
+    stbi_uc **segments;     // start of each segment's entropy-coded data
+    int segment_count;
+    int mcu_count;          // number of MCUs in the scan
+    int task_count;
+    int segments_per_task;
+    stbi_uc ok[STBI__JPEG_MAX_SEGMENT_TASKS];
+    const char *failure[STBI__JPEG_MAX_SEGMENT_TASKS]; // failure reason of each task, which may run on another thread
+} stbi__jpeg_segments;
+
+// decode MCUs [first, first+count) of a baseline scan, starting at the current position of the stream
+static int stbi__jpeg_decode_mcus(stbi__jpeg *z, int first, int count)
+{
+    int m;
+    STBI_SIMD_ALIGN(short, data[64]);
+    if (z->scan_n == 1) {
+        int n = z->order[0];
+        int w = (z->img_comp[n].x+7) >> 3;
+        int ha = z->img_comp[n].ha;
+        for (m=first; m < first+count; ++m) {
+            int i = m % w, j = m / w;
+            if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+        }
+    } else {
+        int k,x,y;
+        for (m=first; m < first+count; ++m) {
+            int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+            for (k=0; k < z->scan_n; ++k) {
+                int n = z->order[k];
+                for (y=0; y < z->img_comp[n].v; ++y) {
+                    for (x=0; x < z->img_comp[n].h; ++x) {
+                        int x2 = (i*z->img_comp[n].h + x)*8;
+                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int ha = z->img_comp[n].ha;
+                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                    }
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+// decode one task's run of consecutive segments, with private copies of the decoder and the stream
+static void stbi__jpeg_decode_segments_task(void *task_data, int index)
+{
+    stbi__jpeg_segments *t = (stbi__jpeg_segments *) task_data;
+    int first = index * t->segments_per_task;
+    int last = first + t->segments_per_task < t->segment_count ? first + t->segments_per_task : t->segment_count;
+    int seg;
+    stbi__context s = *t->z->s;
+    stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+    t->ok[index] = 0;
+    if (!z) {
+        stbi__err("outofmem", "Out of memory");
+        t->failure[index] = stbi__g_failure_reason;
+        return;
+    }
+    memcpy(z, t->z, sizeof(stbi__jpeg));
+    z->s = &s;
+    for (seg=first; seg < last; ++seg) {
+        int first_mcu = seg * z->restart_interval;
+        int count = t->mcu_count - first_mcu < z->restart_interval ? t->mcu_count - first_mcu : z->restart_interval;
+        s.img_buffer = t->segments[seg];
+        stbi__jpeg_reset(z);
+        if (!stbi__jpeg_decode_mcus(z, first_mcu, count)) break;
+    }
+    t->ok[index] = seg == last;
+    if (!t->ok[index]) t->failure[index] = stbi__g_failure_reason;
+    STBI_FREE(z);
+}
+
+// find the start of each segment of the scan at the current position of the stream, and the marker that ends
+// the scan. returns 0 if there is not the expected number of segments.
+static int stbi__jpeg_find_segments(stbi__jpeg *z, stbi_uc **segments, int expected, stbi_uc **end)
+{
+    stbi_uc *p = z->s->img_buffer, *e = z->s->img_buffer_end;
+    int n = 0;
+    segments[n++] = p;
+    for (;;) {
+        p = (stbi_uc *) memchr(p, 0xff, e - p);
+        if (!p || p+1 >= e) return 0;
+        if (p[1] == 0x00) { // stuffed zero byte
+            p += 2;
+        } else if (p[1] == 0xff) { // fill byte
+            p += 1;
+        } else if (STBI__RESTART(p[1])) {
+            if (n == expected) return 0;
+            segments[n++] = p+2;
+            p += 2;
+        } else {
+            *end = p;
+            return n == expected;
+        }
+    }
+}
+
+// decode a baseline scan's restart segments in parallel. returns -1 if the scan cannot be decoded this way,
+// and otherwise whether it was decoded, leaving the stream after the marker that ends it.
+static int stbi__parse_restart_segments(stbi__jpeg *z)
+{
+    stbi__jpeg_segments t;
+    stbi_uc *end;
+    int n;
+    if (z->progressive || z->restart_interval == 0 || z->s->io.read != NULL || stbi__parallel_for == NULL)
+        return -1;
+
+    if (z->scan_n == 1) {
+        n = z->order[0];
+        t.mcu_count = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+    } else {
+        t.mcu_count = z->img_mcu_x * z->img_mcu_y;
+    }
+    t.segment_count = (t.mcu_count + z->restart_interval-1) / z->restart_interval;
+    if (t.segment_count < 2)
+        return -1;
+
+    t.segments = (stbi_uc **) stbi__malloc(sizeof(stbi_uc *) * t.segment_count);
+    if (!t.segments)
+        return -1;
+    if (!stbi__jpeg_find_segments(z, t.segments, t.segment_count, &end)) {
+        STBI_FREE(t.segments);
+        return -1;
+    }
+
+    t.z = z;
+    t.task_count = t.segment_count < STBI__JPEG_MAX_SEGMENT_TASKS ? t.segment_count : STBI__JPEG_MAX_SEGMENT_TASKS;
+    t.segments_per_task = (t.segment_count + t.task_count-1) / t.task_count;
+    t.task_count = (t.segment_count + t.segments_per_task-1) / t.segments_per_task;
+    stbi__parallel(t.task_count, stbi__jpeg_decode_segments_task, &t);
+    STBI_FREE(t.segments);
+
+    for (n=0; n < t.task_count; ++n) {
+        if (!t.ok[n]) {
+            stbi__g_failure_reason = t.failure[n];
+            return 0;
+        }
+    }
+    z->marker = end[1];
+    z->s->img_buffer = end+2;
+    return 1;
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
+    int parallel = stbi__parse_restart_segments(z);
+    if (parallel >= 0) return parallel;
     stbi__jpeg_reset(z);
     if (!z->progressive) {
         if (z->scan_n == 1) {
@@ -2881,22 +3369,42 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
         data[i] *= dequant[i];
 }
 
+// each task of the final idct of a progressive image does this many rows of blocks of one component
+#define STBI__JPEG_BLOCK_ROWS_PER_TASK 8
+
+static void stbi__jpeg_finish_task(void *task_data, int index)
+{
+    stbi__jpeg *z = (stbi__jpeg *) task_data;
+    int i,j,n;
+    for (n=0; n < z->s->img_n; ++n) {
+        int w = (z->img_comp[n].x+7) >> 3;
+        int h = (z->img_comp[n].y+7) >> 3;
+        int tasks = (h + STBI__JPEG_BLOCK_ROWS_PER_TASK-1) / STBI__JPEG_BLOCK_ROWS_PER_TASK;
+        if (index >= tasks) {
+            index -= tasks;
+            continue;
+        }
+        for (j=index*STBI__JPEG_BLOCK_ROWS_PER_TASK; j < h && j < (index+1)*STBI__JPEG_BLOCK_ROWS_PER_TASK; ++j) {
+            for (i=0; i < w; ++i) {
+                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+                z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+            }
+        }
+        return;
+    }
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
     if (z->progressive) {
-        // dequantize and idct the data
-        int i,j,n;
+        // dequantize and idct the data, spread across tasks by rows of blocks
+        int n, tasks = 0;
         for (n=0; n < z->s->img_n; ++n) {
-            int w = (z->img_comp[n].x+7) >> 3;
             int h = (z->img_comp[n].y+7) >> 3;
-            for (j=0; j < h; ++j) {
-                for (i=0; i < w; ++i) {
-                    short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-                    stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-                    z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-                }
-            }
+            tasks += (h + STBI__JPEG_BLOCK_ROWS_PER_TASK-1) / STBI__JPEG_BLOCK_ROWS_PER_TASK;
         }
+        stbi__parallel(tasks, stbi__jpeg_finish_task, z);
     }
 }
 
@@ -3418,6 +3926,67 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// avx2 version of stbi__resample_row_hv_2_simd, 16 pixels at a time
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+    int i=0,t0,t1;
+
+    if (w == 1) {
+        out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+        return out;
+    }
+
+    t1 = 3*in_near[0] + in_far[0];
+    for (; i < ((w-1) & ~15); i += 16) {
+        // vertical pass: 3*x + y = 4*x + (y - x)
+        __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+        __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+        __m256i curr  = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2), _mm256_sub_epi16(farw, nearw));
+
+        // "prev" and "next" are the current row shifted by one pixel across the 128-bit lanes,
+        // with the pixels before and after this block put in the ends.
+        __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+        __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+        __m256i prev = _mm256_or_si256(prv0, _mm256_setr_epi16((short) t1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0));
+        __m256i next = _mm256_or_si256(nxt0, _mm256_setr_epi16(0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,(short) (3*in_near[i+16] + in_far[i+16])));
+
+        // horizontal filter, polyphase:
+        // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+        // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+        __m256i curb = _mm256_add_epi16(_mm256_slli_epi16(curr, 2), _mm256_set1_epi16(8));
+        __m256i even = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+        __m256i odd  = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+        // interleave even and odd pixels, undo scaling, pack and write output. the unpacks
+        // and packs both work within 128-bit lanes, so the bytes come out in order.
+        __m256i de0  = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+        __m256i de1  = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+        _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+        // "previous" value for next iter
+        t1 = 3*in_near[i+15] + in_far[i+15];
+    }
+
+    t0 = t1;
+    t1 = 3*in_near[i] + in_far[i];
+    out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+    for (++i; i < w; ++i) {
+        t0 = t1;
+        t1 = 3*in_near[i]+in_far[i];
+        out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+        out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+    }
+    out[w*2-1] = stbi__div4(t1+2);
+
+    STBI_NOTUSED(hs);
+
+    return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
     // resample with nearest-neighbor
@@ -3592,6 +4161,74 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// avx2 version of stbi__YCbCr_to_RGB_simd, 16 pixels at a time. as there, only step == 4 is
+// accelerated.
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+    int i = 0;
+
+    if (step == 4) {
+        __m256i signflip  = _mm256_set1_epi8(-0x80);
+        __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+        __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+        __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+        __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+        __m256i y_bias = _mm256_set1_epi8((char) (unsigned char) 128);
+        __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+        for (; i+15 < count; i += 16) {
+            // load, with pixels 0-7 in the low half of the low lane and 8-15 in the low half of
+            // the high lane, so each lane then does what the sse2 version does for 8 pixels
+            __m256i y_bytes  = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((__m128i *) (y+i))), 0x50);
+            __m256i cr_bytes = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((__m128i *) (pcr+i))), 0x50);
+            __m256i cb_bytes = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((__m128i *) (pcb+i))), 0x50);
+            __m256i cr_biased = _mm256_xor_si256(cr_bytes, signflip); // -128
+            __m256i cb_biased = _mm256_xor_si256(cb_bytes, signflip); // -128
+
+            // unpack to short (and left-shift cr, cb by 8)
+            __m256i yw  = _mm256_unpacklo_epi8(y_bias, y_bytes);
+            __m256i crw = _mm256_unpacklo_epi8(_mm256_setzero_si256(), cr_biased);
+            __m256i cbw = _mm256_unpacklo_epi8(_mm256_setzero_si256(), cb_biased);
+
+            // color transform
+            __m256i yws = _mm256_srli_epi16(yw, 4);
+            __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+            __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+            __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+            __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+            __m256i rws = _mm256_add_epi16(cr0, yws);
+            __m256i gwt = _mm256_add_epi16(cb0, yws);
+            __m256i bws = _mm256_add_epi16(yws, cb1);
+            __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+            // descale
+            __m256i rw = _mm256_srai_epi16(rws, 4);
+            __m256i bw = _mm256_srai_epi16(bws, 4);
+            __m256i gw = _mm256_srai_epi16(gws, 4);
+
+            // back to byte, set up for transpose
+            __m256i brb = _mm256_packus_epi16(rw, bw);
+            __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+            // transpose to interleave channels. o0 holds pixels 0-3 and 8-11, o1 4-7 and 12-15.
+            __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+            __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+            __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+            __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+            // store
+            _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+            _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+            out += 64;
+        }
+    }
+
+    stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3607,6 +4244,14 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
     }
 #endif
 
+#ifdef STBI_AVX2
+    if (stbi__use_avx2()) {
+        j->idct_block_kernel = stbi__idct_avx2;
+        j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+        j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+    }
+#endif
+
 #ifdef STBI_NEON
     j->idct_block_kernel = stbi__idct_simd;
     j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -3637,6 +4282,155 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
     return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// sets up the resampling of a component for the given output row, as if the rows before it had been resampled
+static void stbi__resample_seek(stbi__resample *r, stbi__jpeg *z, int k, int row)
+{
+    int t = row + (r->vs >> 1);
+    int q = t / r->vs;
+    int last = z->img_comp[k].y - 1;
+    r->ystep = t % r->vs;
+    r->ypos  = q;
+    r->line1 = z->img_comp[k].data + (q < last ? q : last) * z->img_comp[k].w2;
+    r->line0 = z->img_comp[k].data + (q == 0 ? 0 : q-1 < last ? q-1 : last) * z->img_comp[k].w2;
+}
+
+// the output rows are resampled and color-converted in bands of this many rows, which are spread across tasks
+#define STBI__JPEG_OUTPUT_ROWS_PER_TASK 64
+
+typedef struct
+{
+    stbi__jpeg *z;
+    stbi__resample res_comp[4];
+    stbi_uc *output;
+    stbi_uc *buffers;    // decode_n line buffers and a scratch row for each task
+    size_t buffer_size;  // size of each task's buffers
+    unsigned int rows_per_task;
+    int n, decode_n, is_rgb;
+} stbi__jpeg_convert;
+
+static void stbi__jpeg_convert_task(void *task_data, int index)
+{
+    stbi__jpeg_convert *t = (stbi__jpeg_convert *) task_data;
+    stbi__jpeg *z = t->z;
+    int n = t->n, decode_n = t->decode_n, is_rgb = t->is_rgb;
+    unsigned int w = z->s->img_x;
+    unsigned int first = (unsigned int) index * t->rows_per_task;
+    unsigned int last = first + t->rows_per_task < z->s->img_y ? first + t->rows_per_task : z->s->img_y;
+    stbi__resample res_comp[4];
+    stbi_uc *linebuf[4];
+    stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+    stbi_uc *scratch = t->buffers + (size_t) index * t->buffer_size + (size_t) decode_n * (w + 3);
+    unsigned int i,j;
+    int k;
+
+    for (k=0; k < decode_n; ++k) {
+        res_comp[k] = t->res_comp[k];
+        stbi__resample_seek(&res_comp[k], z, k, first);
+        linebuf[k] = t->buffers + (size_t) index * t->buffer_size + (size_t) k * (w + 3);
+    }
+
+    for (j=first; j < last; ++j) {
+        // the 3-component conversions write a fourth byte after each pixel, which for the last row of a band would
+        // be the first byte of the next band, so that row is converted into the scratch row and copied.
+        stbi_uc *row = t->output + (size_t) n * w * j;
+        stbi_uc *target = (n == 3 && j == last-1 && last < z->s->img_y) ? scratch : row;
+        stbi_uc *out = target;
+        for (k=0; k < decode_n; ++k) {
+            stbi__resample *r = &res_comp[k];
+            int y_bot = r->ystep >= (r->vs >> 1);
+            coutput[k] = r->resample(linebuf[k],
+                y_bot ? r->line1 : r->line0,
+                y_bot ? r->line0 : r->line1,
+                r->w_lores, r->hs);
+            if (++r->ystep >= r->vs) {
+                r->ystep = 0;
+                r->line0 = r->line1;
+                if (++r->ypos < z->img_comp[k].y)
+                    r->line1 += z->img_comp[k].w2;
+            }
+        }
+        if (n >= 3) {
+            stbi_uc *y = coutput[0];
+            if (z->s->img_n == 3) {
+                if (is_rgb) {
+                    for (i=0; i < w; ++i) {
+                        out[0] = y[i];
+                        out[1] = coutput[1][i];
+                        out[2] = coutput[2][i];
+                        out[3] = 255;
+                        out += n;
+                    }
+                } else {
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+                }
+            } else if (z->s->img_n == 4) {
+                if (z->app14_color_transform == 0) { // CMYK
+                    for (i=0; i < w; ++i) {
+                        stbi_uc m = coutput[3][i];
+                        out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                        out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                        out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                        out[3] = 255;
+                        out += n;
+                    }
+                } else if (z->app14_color_transform == 2) { // YCCK
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+                    for (i=0; i < w; ++i) {
+                        stbi_uc m = coutput[3][i];
+                        out[0] = stbi__blinn_8x8(255 - out[0], m);
+                        out[1] = stbi__blinn_8x8(255 - out[1], m);
+                        out[2] = stbi__blinn_8x8(255 - out[2], m);
+                        out += n;
+                    }
+                } else { // YCbCr + alpha?  Ignore the fourth channel for now
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+                }
+            } else
+                for (i=0; i < w; ++i) {
+                    out[0] = out[1] = out[2] = y[i];
+                    out[3] = 255; // not used if n==3
+                    out += n;
+                }
+        } else {
+            if (is_rgb) {
+                if (n == 1)
+                    for (i=0; i < w; ++i)
+                        *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                else {
+                    for (i=0; i < w; ++i, out += 2) {
+                        out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                        out[1] = 255;
+                    }
+                }
+            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+                for (i=0; i < w; ++i) {
+                    stbi_uc m = coutput[3][i];
+                    stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+                    stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+                    stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+                    out[0] = stbi__compute_y(r, g, b);
+                    out[1] = 255;
+                    out += n;
+                }
+            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+                for (i=0; i < w; ++i) {
+                    out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+                    out[1] = 255;
+                    out += n;
+                }
+            } else {
+                stbi_uc *y = coutput[0];
+                if (n == 1)
+                    for (i=0; i < w; ++i) out[i] = y[i];
+                else
+                    for (i=0; i < w; ++i) { *out++ = y[i]; *out++ = 255; }
+            }
+        }
+        if (target != row)
+            memcpy(row, scratch, (size_t) n * w);
+    }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
     int n, decode_n, is_rgb;
@@ -3660,27 +4454,16 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
     // resample and color-convert
     {
-        int k;
-        unsigned int i,j;
+        int k, tasks;
         stbi_uc *output;
-        stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
-
-        stbi__resample res_comp[4];
+        stbi__jpeg_convert t;
 
         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-
-            // allocate line buffer big enough for upsampling off the edges
-            // with upsample factor of 4
-            z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-            if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+            stbi__resample *r = &t.res_comp[k];
 
             r->hs      = z->img_h_max / z->img_comp[k].h;
             r->vs      = z->img_v_max / z->img_comp[k].v;
-            r->ystep   = r->vs >> 1;
             r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-            r->ypos    = 0;
-            r->line0   = r->line1 = z->img_comp[k].data;
 
             if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
             else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
@@ -3689,105 +4472,30 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
             else                               r->resample = stbi__resample_row_generic;
         }
 
-        // can't error after this so, this is safe
-        output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-        if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+        // allocate line buffers big enough for upsampling off the edges with upsample factor of 4, and a scratch
+        // row, for each task. without a parallel-for, one task does all of the rows.
+        t.rows_per_task = stbi__parallel_for ? STBI__JPEG_OUTPUT_ROWS_PER_TASK : z->s->img_y;
+        tasks = (int) ((z->s->img_y + t.rows_per_task-1) / t.rows_per_task);
+        t.buffer_size = (size_t) decode_n * (z->s->img_x + 3) + (size_t) 4 * z->s->img_x;
+        t.buffers = (stbi_uc *) stbi__malloc((size_t) tasks * t.buffer_size);
+        if (!t.buffers) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+
+        // can't error after this so, this is safe. decode into the caller's buffer if there is one and it is big
+        // enough; otherwise stbi_load_from_memory_into reports the error.
+        if (z->s->output && (size_t) n * z->s->img_x * z->s->img_y <= z->s->output_size)
+            output = z->s->output;
+        else
+            output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+        if (!output) { STBI_FREE(t.buffers); stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
         // now go ahead and resample
-        for (j=0; j < z->s->img_y; ++j) {
-            stbi_uc *out = output + n * z->s->img_x * j;
-            for (k=0; k < decode_n; ++k) {
-                stbi__resample *r = &res_comp[k];
-                int y_bot = r->ystep >= (r->vs >> 1);
-                coutput[k] = r->resample(z->img_comp[k].linebuf,
-                    y_bot ? r->line1 : r->line0,
-                    y_bot ? r->line0 : r->line1,
-                    r->w_lores, r->hs);
-                if (++r->ystep >= r->vs) {
-                    r->ystep = 0;
-                    r->line0 = r->line1;
-                    if (++r->ypos < z->img_comp[k].y)
-                        r->line1 += z->img_comp[k].w2;
-                }
-            }
-            if (n >= 3) {
-                stbi_uc *y = coutput[0];
-                if (z->s->img_n == 3) {
-                    if (is_rgb) {
-                        for (i=0; i < z->s->img_x; ++i) {
-                            out[0] = y[i];
-                            out[1] = coutput[1][i];
-                            out[2] = coutput[2][i];
-                            out[3] = 255;
-                            out += n;
-                        }
-                    } else {
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                    }
-                } else if (z->s->img_n == 4) {
-                    if (z->app14_color_transform == 0) { // CMYK
-                        for (i=0; i < z->s->img_x; ++i) {
-                            stbi_uc m = coutput[3][i];
-                            out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                            out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                            out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                            out[3] = 255;
-                            out += n;
-                        }
-                    } else if (z->app14_color_transform == 2) { // YCCK
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                        for (i=0; i < z->s->img_x; ++i) {
-                            stbi_uc m = coutput[3][i];
-                            out[0] = stbi__blinn_8x8(255 - out[0], m);
-                            out[1] = stbi__blinn_8x8(255 - out[1], m);
-                            out[2] = stbi__blinn_8x8(255 - out[2], m);
-                            out += n;
-                        }
-                    } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                    }
-                } else
-                    for (i=0; i < z->s->img_x; ++i) {
-                        out[0] = out[1] = out[2] = y[i];
-                        out[3] = 255; // not used if n==3
-                        out += n;
-                    }
-            } else {
-                if (is_rgb) {
-                    if (n == 1)
-                        for (i=0; i < z->s->img_x; ++i)
-                            *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                    else {
-                        for (i=0; i < z->s->img_x; ++i, out += 2) {
-                            out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                            out[1] = 255;
-                        }
-                    }
-                } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-                    for (i=0; i < z->s->img_x; ++i) {
-                        stbi_uc m = coutput[3][i];
-                        stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                        stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                        stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                        out[0] = stbi__compute_y(r, g, b);
-                        out[1] = 255;
-                        out += n;
-                    }
-                } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-                    for (i=0; i < z->s->img_x; ++i) {
-                        out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                        out[1] = 255;
-                        out += n;
-                    }
-                } else {
-                    stbi_uc *y = coutput[0];
-                    if (n == 1)
-                        for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-                    else
-                        for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-                }
-            }
-        }
+        t.z = z;
+        t.output = output;
+        t.n = n;
+        t.decode_n = decode_n;
+        t.is_rgb = is_rgb;
+        stbi__parallel(tasks, stbi__jpeg_convert_task, &t);
+        STBI_FREE(t.buffers);
         stbi__cleanup_jpeg(z);
         *out_x = z->s->img_x;
         *out_y = z->s->img_y;
@@ -4393,6 +5101,116 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_AVX2
+// the "up" filter over n bytes, 32 at a time. returns the number of bytes done.
+STBI__AVX2_TARGET
+static int stbi__png_unfilter_up_avx2(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int n)
+{
+    int k;
+    for (k=0; k+32 <= n; k += 32)
+        _mm256_storeu_si256((__m256i *) (cur+k), _mm256_add_epi8(_mm256_loadu_si256((__m256i const *) (raw+k)), _mm256_loadu_si256((__m256i const *) (prior+k))));
+    return k;
+}
+#endif
+
+#ifdef STBI_SSE2
+static __m128i stbi__png_load_pixel(stbi_uc const *p, int n)
+{
+    stbi__uint32 v = p[0] | (p[1] << 8) | (p[2] << 16);
+    if (n == 4) v |= (stbi__uint32) p[3] << 24;
+    return _mm_cvtsi32_si128((int) v);
+}
+
+static void stbi__png_store_pixel(stbi_uc *p, __m128i pixel, int n)
+{
+    stbi__uint32 v = (stbi__uint32) _mm_cvtsi128_si32(pixel);
+    p[0] = (stbi_uc) v;
+    p[1] = (stbi_uc) (v >> 8);
+    p[2] = (stbi_uc) (v >> 16);
+    if (n == 4) p[3] = (stbi_uc) (v >> 24);
+}
+
+// paeth predictor of the 16-bit channels of a pixel, its left neighbor a, the one above b and
+// the one above left c, matching stbi__paeth
+static __m128i stbi__png_paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i bc = _mm_sub_epi16(b, c);
+    __m128i ac = _mm_sub_epi16(a, c);
+    __m128i abc = _mm_add_epi16(bc, ac);
+    __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc)); // |p-a|
+    __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac)); // |p-b|
+    __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc)); // |p-c|
+    __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    __m128i use_c = _mm_cmpgt_epi16(pb, pc);
+    __m128i b_or_c = _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, b));
+    return _mm_or_si128(_mm_and_si128(not_a, b_or_c), _mm_andnot_si128(not_a, a));
+}
+
+// unfilter the pixels after the first in an 8-bit row with 3 or 4 channels. each pixel depends
+// on the one to its left, so they're done one at a time with the channels in parallel, except
+// for "up". pixels are read from raw every filter_bytes bytes and written to cur, and read from
+// the row above, prior, every output_bytes bytes; a fourth output channel is alpha, set to 255.
+static void stbi__png_unfilter_row_simd(int filter, stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int count, int filter_bytes, int output_bytes, int avx2)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i alpha = _mm_cvtsi32_si128(output_bytes > filter_bytes ? (int) 0xff000000 : 0);
+    __m128i a = stbi__png_load_pixel(cur - output_bytes, filter_bytes);
+    __m128i b, c, x;
+    int i, k;
+    STBI_NOTUSED(avx2);
+
+    switch (filter) {
+    case STBI__F_up:
+        if (filter_bytes == output_bytes) {
+            // the whole row at once
+            int n = count*filter_bytes;
+            k = 0;
+#ifdef STBI_AVX2
+            if (avx2) k = stbi__png_unfilter_up_avx2(cur, prior, raw, n);
+#endif
+            for (; k+16 <= n; k += 16)
+                _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(_mm_loadu_si128((__m128i *) (raw+k)), _mm_loadu_si128((__m128i *) (prior+k))));
+            for (; k < n; ++k)
+                cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+            break;
+        }
+        for (i=0; i < count; ++i, raw += filter_bytes, cur += output_bytes, prior += output_bytes) {
+            x = _mm_add_epi8(stbi__png_load_pixel(raw, filter_bytes), stbi__png_load_pixel(prior, filter_bytes));
+            stbi__png_store_pixel(cur, _mm_or_si128(x, alpha), output_bytes);
+        }
+        break;
+    case STBI__F_sub:
+    case STBI__F_paeth_first: // paeth(a,0,0) is a
+        for (i=0; i < count; ++i, raw += filter_bytes, cur += output_bytes) {
+            a = _mm_add_epi8(stbi__png_load_pixel(raw, filter_bytes), a);
+            stbi__png_store_pixel(cur, _mm_or_si128(a, alpha), output_bytes);
+        }
+        break;
+    case STBI__F_avg:
+    case STBI__F_avg_first:
+        // (a+b)>>1 is the rounded-up average minus the bit that was rounded up
+        for (i=0; i < count; ++i, raw += filter_bytes, cur += output_bytes, prior += output_bytes) {
+            b = filter == STBI__F_avg ? stbi__png_load_pixel(prior, filter_bytes) : zero;
+            x = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            a = _mm_add_epi8(stbi__png_load_pixel(raw, filter_bytes), x);
+            stbi__png_store_pixel(cur, _mm_or_si128(a, alpha), output_bytes);
+        }
+        break;
+    case STBI__F_paeth:
+        c = _mm_unpacklo_epi8(stbi__png_load_pixel(prior - output_bytes, filter_bytes), zero);
+        for (i=0; i < count; ++i, raw += filter_bytes, cur += output_bytes, prior += output_bytes) {
+            b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior, filter_bytes), zero);
+            x = stbi__png_paeth_sse2(_mm_unpacklo_epi8(a, zero), b, c);
+            a = _mm_add_epi8(stbi__png_load_pixel(raw, filter_bytes), _mm_packus_epi16(x, x));
+            stbi__png_store_pixel(cur, _mm_or_si128(a, alpha), output_bytes);
+            c = b;
+        }
+        break;
+    }
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4406,6 +5224,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
     int output_bytes = out_n*bytes;
     int filter_bytes = img_n*bytes;
     int width = x;
+#ifdef STBI_SSE2
+    int simd = stbi__sse2_available();
+#ifdef STBI_AVX2
+    int avx2 = stbi__use_avx2();
+#else
+    int avx2 = 0;
+#endif
+#endif
 
     STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
     a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4472,6 +5298,12 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
             prior += 1;
         }
 
+#ifdef STBI_SSE2
+        if (simd && depth == 8 && (img_n == 3 || img_n == 4) && filter != STBI__F_none) {
+            stbi__png_unfilter_row_simd(filter, cur, prior, raw, x-1, img_n, out_n, avx2);
+            raw += (x-1)*img_n;
+        } else
+#endif
         // this is a little gross, so that we don't switch per-pixel or per-component
         if (depth < 8 || img_n == out_n) {
             int nk = (width - 1)*filter_bytes;
@@ -345,6 +345,7 @@ private:
 };
 
 /// Loads .obj from a file.
+/// The file is memory-mapped and tokenized in place.
 /// 'attrib', 'shapes' and 'materials' will be filled with parsed shape data
 /// 'shapes' will be filled with parsed shape data
 /// Returns true when loading .obj become success.
@@ -373,6 +374,22 @@ bool LoadObjWithCallback(std::istream &inStream, const callback_t &callback,
     MaterialReader *readMatFn = NULL,
     std::string *warn = NULL, std::string *err = NULL);
 
+/// Loads .obj from a buffer of `len` bytes with custom user callback.
+/// The buffer is tokenized in place and need not be terminated.
+bool LoadObjWithCallback(const char *buf, size_t len,
+    const callback_t &callback, void *user_data = NULL,
+    MaterialReader *readMatFn = NULL,
+    std::string *warn = NULL, std::string *err = NULL);
+
+/// Loads .obj from a memory-mapped file with custom user callback.
+/// 'mtl_basedir' is the same as for LoadObj().
+/// If 'mmap_populate' is true, the whole file is read in when it is mapped
+/// (Linux only). Otherwise pages are read as the parser reaches them.
+bool LoadObjWithCallback(const char *filename, const callback_t &callback,
+    void *user_data = NULL, const char *mtl_basedir = NULL,
+    std::string *warn = NULL, std::string *err = NULL,
+    bool mmap_populate = false);
+
 /// Loads object from a std::istream, uses GetMtlIStreamFn to retrieve
 /// std::istream for materials.
 /// Returns true when loading .obj become success.
@@ -383,6 +400,29 @@ bool LoadObj(attrib_t *attrib, std::vector<shape_t> *shapes,
     MaterialReader *readMatFn = NULL, bool triangulate = true,
     bool default_vcols_fallback = true);
 
+/// Loads .obj from a file, parsing it on multiple threads.
+/// The file is split at line boundaries into chunks which are tokenized in
+/// parallel. The results are identical to LoadObj().
+/// 'num_threads' is the number of threads to use. In default(`0'), one thread
+/// per hardware thread is used.
+/// The file is memory-mapped. If 'mmap_populate' is true, the whole file is
+/// read in when it is mapped (Linux only).
+bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+    std::vector<material_t> *materials, std::string *warn,
+    std::string *err, const char *filename,
+    const char *mtl_basedir = NULL, bool triangulate = true,
+    bool default_vcols_fallback = true,
+    unsigned int num_threads = 0, bool mmap_populate = false);
+
+/// Loads .obj from a buffer of `len` bytes, parsing it on multiple threads.
+/// Uses `readMatFn` to retrieve materials.
+bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+    std::vector<material_t> *materials, std::string *warn,
+    std::string *err, const char *buf, size_t len,
+    MaterialReader *readMatFn = NULL, bool triangulate = true,
+    bool default_vcols_fallback = true,
+    unsigned int num_threads = 0);
+
 /// Loads materials into std::map
 void LoadMtl(std::map<std::string, int> *material_map,
     std::vector<material_t> *materials, std::istream *inStream,
@@ -403,17 +443,49 @@ bool ParseTextureNameAndOption(std::string *texname, texture_option_t *texopt,
 #endif  // TINY_OBJ_LOADER_H_
 
 #ifdef TINYOBJLOADER_IMPLEMENTATION
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cctype>
 #include <cmath>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <limits>
+#include <mutex>
 #include <utility>
 
 #include <fstream>
 #include <sstream>
+#include <streambuf>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The in-place tokenizer finds line ends 16 or 32 bytes at a time when SSE2 or
+// AVX2 is available. Define TINYOBJLOADER_NO_SIMD to use the scalar loop only.
+#if !defined(TINYOBJLOADER_NO_SIMD)
+#if defined(__AVX2__)
+#define TINYOBJLOADER_USE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TINYOBJLOADER_USE_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && \
+    (defined(TINYOBJLOADER_USE_AVX2) || defined(TINYOBJLOADER_USE_SSE2))
+#include <intrin.h>
+#endif
+#endif
 
 namespace tinyobj {
 
@@ -679,11 +751,91 @@ fail:
     return false;
 }
 
+// Same as tryParseDouble(), except that the result is correctly rounded and a
+// number may start with '.'. A mantissa of up to 15 digits with a decimal
+// exponent of up to 22 is converted with one exact multiplication or division,
+// which covers nearly every number in an .obj file. Anything else falls back to
+// tryParseDouble(). Every parser, serial or not, converts numbers with this
+// function, so they all give the same values.
+static bool fastParseDouble(const char *s, const char *s_end, double *result) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    const int max_digits = 15;  // Every 15 digit integer is exact in a double
+
+    const char *p = s;
+    bool negative = false;
+    if (p < s_end && (*p == '+' || *p == '-')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0;     // significant digits in the mantissa
+    int exponent = 0;   // decimal exponent of the mantissa
+    bool any = false;   // any digit at all
+    bool exact = true;  // no digits were dropped
+
+    for (; p < s_end && IS_DIGIT(*p); ++p) {
+        any = true;
+        if (digits < max_digits) {
+            mantissa = mantissa * 10 + static_cast<unsigned int>(*p - '0');
+            digits += (mantissa != 0);
+        } else {
+            ++exponent;
+            exact = exact && (*p == '0');
+        }
+    }
+    if (p < s_end && *p == '.') {
+        for (++p; p < s_end && IS_DIGIT(*p); ++p) {
+            any = true;
+            if (digits < max_digits) {
+                mantissa = mantissa * 10 + static_cast<unsigned int>(*p - '0');
+                digits += (mantissa != 0);
+                --exponent;
+            } else if (*p != '0') {
+                exact = false;
+            }
+        }
+    }
+    if (!any) return false;
+
+    if (p < s_end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool exp_negative = false;
+        if (p < s_end && (*p == '+' || *p == '-')) {
+            exp_negative = (*p == '-');
+            ++p;
+        }
+        // Empty E is not allowed.
+        if (p >= s_end || !IS_DIGIT(*p)) return false;
+        int e = 0;
+        for (; p < s_end && IS_DIGIT(*p); ++p) {
+            if (e < 100000) e = e * 10 + (*p - '0');
+        }
+        exponent += exp_negative ? -e : e;
+    }
+
+    if (mantissa == 0) {
+        *result = negative ? -0.0 : 0.0;
+        return true;
+    }
+    if (!exact || exponent < -22 || exponent > 22) {
+        return tryParseDouble(s, s_end, result);
+    }
+
+    double value = static_cast<double>(mantissa);
+    value = exponent < 0 ? value / pow10[-exponent] : value * pow10[exponent];
+    *result = negative ? -value : value;
+    return true;
+}
+
 static inline real_t parseReal(const char **token, double default_value = 0.0) {
     (*token) += strspn((*token), " \t");
     const char *end = (*token) + strcspn((*token), " \t\r");
     double val = default_value;
-    tryParseDouble((*token), end, &val);
+    fastParseDouble((*token), end, &val);
     real_t f = static_cast<real_t>(val);
     (*token) = end;
     return f;
@@ -693,7 +845,7 @@ static inline bool parseReal(const char **token, real_t *out) {
     (*token) += strspn((*token), " \t");
     const char *end = (*token) + strcspn((*token), " \t\r");
     double val;
-    bool ret = tryParseDouble((*token), end, &val);
+    bool ret = fastParseDouble((*token), end, &val);
     if (ret) {
         real_t f = static_cast<real_t>(val);
         (*out) = f;
@@ -718,17 +870,6 @@ static inline void parseReal3(real_t *x, real_t *y, real_t *z,
     (*z) = parseReal(token, default_z);
 }
 
-static inline void parseV(real_t *x, real_t *y, real_t *z, real_t *w,
-    const char **token, const double default_x = 0.0,
-    const double default_y = 0.0,
-    const double default_z = 0.0,
-    const double default_w = 1.0) {
-    (*x) = parseReal(token, default_x);
-    (*y) = parseReal(token, default_y);
-    (*z) = parseReal(token, default_z);
-    (*w) = parseReal(token, default_w);
-}
-
 // Extension: parse vertex with colors(6 items)
 static inline bool parseVertexWithColor(real_t *x, real_t *y, real_t *z,
     real_t *r, real_t *g, real_t *b,
@@ -750,6 +891,167 @@ static inline bool parseVertexWithColor(real_t *x, real_t *y, real_t *z,
     return found_color;
 }
 
+// In-place tokenizer.
+//
+// These functions parse a line directly in the file buffer. Every function
+// takes the end of the line, so the buffer need not be terminated and no line
+// is copied. Numbers are parsed with a single pass over their digits.
+
+#if defined(TINYOBJLOADER_USE_AVX2) || defined(TINYOBJLOADER_USE_SSE2)
+// Returns the index of the lowest set bit of a non-zero mask.
+static inline int lowestBit(unsigned int mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Returns the first '\n' or '\r' in [p, end), or end if there is none.
+static inline const char *findLineEnd(const char *p, const char *end) {
+#if defined(TINYOBJLOADER_USE_AVX2)
+    const __m256i nl32 = _mm256_set1_epi8('\n');
+    const __m256i cr32 = _mm256_set1_epi8('\r');
+    while (end - p >= 32) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(c, nl32), _mm256_cmpeq_epi8(c, cr32))));
+        if (mask) return p + lowestBit(mask);
+        p += 32;
+    }
+#endif
+#if defined(TINYOBJLOADER_USE_AVX2) || defined(TINYOBJLOADER_USE_SSE2)
+    const __m128i nl16 = _mm_set1_epi8('\n');
+    const __m128i cr16 = _mm_set1_epi8('\r');
+    while (end - p >= 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(c, nl16), _mm_cmpeq_epi8(c, cr16))));
+        if (mask) return p + lowestBit(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\n' && *p != '\r') ++p;
+    return p;
+}
+
+static inline const char *skipSpace(const char *p, const char *end) {
+    while (p < end && IS_SPACE(*p)) ++p;
+    return p;
+}
+
+// Returns the end of the token starting at p. Same as strcspn(p, " \t\r").
+static inline const char *findTokenEnd(const char *p, const char *end) {
+    while (p < end && !IS_SPACE(*p) && !IS_NEW_LINE(*p)) ++p;
+    return p;
+}
+
+// Returns the end of a face index starting at p. Same as
+// strcspn(p, "/ \t\r").
+static inline const char *findIndexEnd(const char *p, const char *end) {
+    while (p < end && *p != '/' && !IS_SPACE(*p) && !IS_NEW_LINE(*p)) ++p;
+    return p;
+}
+
+static inline real_t fastParseReal(const char **token, const char *end,
+    double default_value = 0.0) {
+    const char *p = skipSpace(*token, end);
+    const char *e = findTokenEnd(p, end);
+    double val = default_value;
+    fastParseDouble(p, e, &val);
+    (*token) = e;
+    return static_cast<real_t>(val);
+}
+
+static inline bool fastParseReal(const char **token, const char *end,
+    real_t *out) {
+    const char *p = skipSpace(*token, end);
+    const char *e = findTokenEnd(p, end);
+    double val;
+    bool ret = fastParseDouble(p, e, &val);
+    if (ret) {
+        (*out) = static_cast<real_t>(val);
+    }
+    (*token) = e;
+    return ret;
+}
+
+// Same as parseVertexWithColor().
+static inline bool fastParseVertexWithColor(real_t *x, real_t *y, real_t *z,
+    real_t *r, real_t *g, real_t *b,
+    const char **token, const char *end) {
+    (*x) = fastParseReal(token, end);
+    (*y) = fastParseReal(token, end);
+    (*z) = fastParseReal(token, end);
+
+    const bool found_color = fastParseReal(token, end, r) &&
+        fastParseReal(token, end, g) &&
+        fastParseReal(token, end, b);
+
+    if (!found_color) {
+        (*r) = (*g) = (*b) = 1.0;
+    }
+
+    return found_color;
+}
+
+// Same as atoi() for the digits of a face index.
+static inline int fastParseInt(const char **token, const char *end) {
+    const char *p = *token;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    unsigned int value = 0;
+    for (; p < end && IS_DIGIT(*p); ++p) {
+        value = value * 10 + static_cast<unsigned int>(*p - '0');
+    }
+    (*token) = p;
+    return negative ? -static_cast<int>(value) : static_cast<int>(value);
+}
+
+// Parses a raw triple: i, i/j/k, i//k, i/j. The indices are returned as
+// written, and a missing index is `absent`.
+static vertex_index_t fastParseRawTriple(const char **token, const char *end,
+    int absent) {
+    vertex_index_t vi(absent);
+    const char *p = *token;
+
+    vi.v_idx = fastParseInt(&p, end);
+    p = findIndexEnd(p, end);
+    if (p >= end || *p != '/') {
+        (*token) = p;
+        return vi;
+    }
+    p++;
+
+    // i//k
+    if (p < end && *p == '/') {
+        p++;
+        vi.vn_idx = fastParseInt(&p, end);
+        (*token) = findIndexEnd(p, end);
+        return vi;
+    }
+
+    // i/j/k or i/j
+    vi.vt_idx = fastParseInt(&p, end);
+    p = findIndexEnd(p, end);
+    if (p >= end || *p != '/') {
+        (*token) = p;
+        return vi;
+    }
+
+    // i/j/k
+    p++;  // skip '/'
+    vi.vn_idx = fastParseInt(&p, end);
+    (*token) = findIndexEnd(p, end);
+    return vi;
+}
+
 static inline bool parseOnOff(const char **token, bool default_value = true) {
     (*token) += strspn((*token), " \t");
     const char *end = (*token) + strcspn((*token), " \t\r");
@@ -870,39 +1172,6 @@ static bool parseTriple(const char **token, int vsize, int vnsize, int vtsize,
     return true;
 }
 
-// Parse raw triples: i, i/j/k, i//k, i/j
-static vertex_index_t parseRawTriple(const char **token) {
-    vertex_index_t vi(static_cast<int>(0));  // 0 is an invalid index in OBJ
-
-    vi.v_idx = atoi((*token));
-    (*token) += strcspn((*token), "/ \t\r");
-    if ((*token)[0] != '/') {
-        return vi;
-    }
-    (*token)++;
-
-    // i//k
-    if ((*token)[0] == '/') {
-        (*token)++;
-        vi.vn_idx = atoi((*token));
-        (*token) += strcspn((*token), "/ \t\r");
-        return vi;
-    }
-
-    // i/j/k or i/j
-    vi.vt_idx = atoi((*token));
-    (*token) += strcspn((*token), "/ \t\r");
-    if ((*token)[0] != '/') {
-        return vi;
-    }
-
-    // i/j/k
-    (*token)++;  // skip '/'
-    vi.vn_idx = atoi((*token));
-    (*token) += strcspn((*token), "/ \t\r");
-    return vi;
-}
-
 bool ParseTextureNameAndOption(std::string *texname, texture_option_t *texopt,
     const char *linebuf) {
     // @todo { write more robust lexer and parser. }
@@ -1727,6 +1996,194 @@ void LoadMtl(std::map<std::string, int> *material_map,
     }
 }
 
+// A read-only view of a whole file. The file is memory-mapped where possible,
+// so the parser tokenizes it directly from the page cache, and read into memory
+// otherwise.
+class file_view_t {
+public:
+    file_view_t() : data_(NULL), size_(0), mapped_(false) {
+#ifdef _WIN32
+        file_ = INVALID_HANDLE_VALUE;
+        mapping_ = NULL;
+#endif
+    }
+    ~file_view_t() { close(); }
+
+    // Opens the file. The mapping is advised to be read sequentially. If
+    // `populate` is true, all of the pages are read in up front (Linux only).
+    bool open(const char *filename, bool populate);
+    void close();
+
+    // Tells the system that the first `size` bytes will not be read again, so
+    // their pages no longer count toward the process's memory use.
+    void discard(size_t size);
+
+    const char *data() const { return data_ ? data_ : ""; }
+    size_t size() const { return size_; }
+
+private:
+    file_view_t(const file_view_t &);
+    file_view_t &operator=(const file_view_t &);
+
+    bool read(const char *filename);
+
+    const char *data_;
+    size_t size_;
+    bool mapped_;
+    std::vector<char> buffer_;
+#ifdef _WIN32
+    HANDLE file_;
+    HANDLE mapping_;
+#endif
+};
+
+#ifdef _WIN32
+
+bool file_view_t::open(const char *filename, bool populate) {
+    (void)populate;
+    close();
+
+    file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_ == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size)) {
+        close();
+        return false;
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0) return true;  // An empty file cannot be mapped.
+
+    mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_) {
+        data_ = static_cast<const char *>(
+            MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (data_) {
+        mapped_ = true;
+        return true;
+    }
+
+    close();
+    return read(filename);
+}
+
+void file_view_t::discard(size_t size) { (void)size; }
+
+void file_view_t::close() {
+    if (mapped_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = false;
+    std::vector<char>().swap(buffer_);
+}
+
+#else  // _WIN32
+
+bool file_view_t::open(const char *filename, bool populate) {
+    close();
+
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ == 0) {  // An empty file cannot be mapped.
+        ::close(fd);
+        return true;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populate) flags |= MAP_POPULATE;
+#else
+    (void)populate;
+#endif
+    void *data = mmap(NULL, size_, PROT_READ, flags, fd, 0);
+    ::close(fd);  // The mapping remains valid after the descriptor is closed.
+    if (data == MAP_FAILED) {
+        size_ = 0;
+        return read(filename);
+    }
+
+    // The parser reads the file once from start to end, so the kernel may read
+    // ahead aggressively and drop the pages behind.
+    madvise(data, size_, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const char *>(data);
+    mapped_ = true;
+    return true;
+}
+
+void file_view_t::discard(size_t size) {
+    if (!mapped_) return;
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = (std::min)(size, size_) / page * page;
+    if (size > 0) madvise(const_cast<char *>(data_), size, MADV_DONTNEED);
+}
+
+void file_view_t::close() {
+    if (mapped_) munmap(const_cast<char *>(data_), size_);
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = false;
+    std::vector<char>().swap(buffer_);
+}
+
+#endif  // _WIN32
+
+// Reads the whole file into memory when it cannot be mapped.
+bool file_view_t::read(const char *filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) return false;
+
+    ifs.seekg(0, std::ios::end);
+    std::streamoff size = ifs.tellg();
+    ifs.seekg(0, std::ios::beg);
+    buffer_.resize(static_cast<size_t>(size > 0 ? size : 0));
+    if (!buffer_.empty() && !ifs.read(&buffer_[0], size)) {
+        std::vector<char>().swap(buffer_);
+        return false;
+    }
+    data_ = buffer_.empty() ? NULL : &buffer_[0];
+    size_ = buffer_.size();
+    return true;
+}
+
+// A stream buffer that reads directly from memory, so a file_view_t can be
+// parsed by the stream-based parsers without copying it.
+class memory_streambuf_t : public std::streambuf {
+public:
+    memory_streambuf_t(const char *data, size_t size) {
+        char *begin = const_cast<char *>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+
+// Returns the directory of the .mtl files with a trailing separator.
+static std::string materialBaseDir(const char *mtl_basedir) {
+    std::string baseDir = mtl_basedir ? mtl_basedir : "";
+    if (!baseDir.empty()) {
+#ifndef _WIN32
+        const char dirsep = '/';
+#else
+        const char dirsep = '\\';
+#endif
+        if (baseDir[baseDir.length() - 1] != dirsep) baseDir += dirsep;
+    }
+    return baseDir;
+}
+
 bool MaterialFileReader::operator()(const std::string &matId,
     std::vector<material_t> *materials,
     std::map<std::string, int> *matMap,
@@ -1739,8 +2196,8 @@ bool MaterialFileReader::operator()(const std::string &matId,
         filepath = matId;
     }
 
-    std::ifstream matIStream(filepath.c_str());
-    if (!matIStream) {
+    file_view_t file;
+    if (!file.open(filepath.c_str(), false)) {
         std::stringstream ss;
         ss << "Material file [ " << filepath << " ] not found." << std::endl;
         if (warn) {
@@ -1749,6 +2206,8 @@ bool MaterialFileReader::operator()(const std::string &matId,
         return false;
     }
 
+    memory_streambuf_t buf(file.data(), file.size());
+    std::istream matIStream(&buf);
     LoadMtl(matMap, materials, &matIStream, warn, err);
 
     return true;
@@ -1786,8 +2245,8 @@ bool LoadObj(attrib_t *attrib, std::vector<shape_t> *shapes,
 
     std::stringstream errss;
 
-    std::ifstream ifs(filename);
-    if (!ifs) {
+    file_view_t file;
+    if (!file.open(filename, false)) {
         errss << "Cannot open file [" << filename << "]" << std::endl;
         if (err) {
             (*err) = errss.str();
@@ -1795,28 +2254,18 @@ bool LoadObj(attrib_t *attrib, std::vector<shape_t> *shapes,
         return false;
     }
 
-    std::string baseDir = mtl_basedir ? mtl_basedir : "";
-    if (!baseDir.empty()) {
-#ifndef _WIN32
-        const char dirsep = '/';
-#else
-        const char dirsep = '\\';
-#endif
-        if (baseDir[baseDir.length() - 1] != dirsep) baseDir += dirsep;
-    }
-    MaterialFileReader matFileReader(baseDir);
+    MaterialFileReader matFileReader(materialBaseDir(mtl_basedir));
 
-    return LoadObj(attrib, shapes, materials, warn, err, &ifs, &matFileReader,
-        trianglulate, default_vcols_fallback);
+    // The mapped file is tokenized in place by the chunk parser, which gives
+    // the same results on one thread.
+    return LoadObjParallel(attrib, shapes, materials, warn, err, file.data(),
+        file.size(), &matFileReader, trianglulate,
+        default_vcols_fallback, 1);
 }
 
-bool LoadObj(attrib_t *attrib, std::vector<shape_t> *shapes,
-    std::vector<material_t> *materials, std::string *warn,
-    std::string *err, std::istream *inStream,
-    MaterialReader *readMatFn /*= NULL*/, bool triangulate,
-    bool default_vcols_fallback) {
-    std::stringstream errss;
-
+// Parsing state of LoadObj(). It is shared by the serial and the parallel
+// parsers so that both produce identical results.
+struct obj_load_state_t {
     std::vector<real_t> v;
     std::vector<real_t> vn;
     std::vector<real_t> vt;
@@ -1828,475 +2277,387 @@ bool LoadObj(attrib_t *attrib, std::vector<shape_t> *shapes,
 
     // material
     std::map<std::string, int> material_map;
-    int material = -1;
+    int material;
 
     // smoothing group id
-    unsigned int current_smoothing_id =
-        0;  // Initial value. 0 means no smoothing.
+    unsigned int current_smoothing_id;
 
-    int greatest_v_idx = -1;
-    int greatest_vn_idx = -1;
-    int greatest_vt_idx = -1;
+    int greatest_v_idx;
+    int greatest_vn_idx;
+    int greatest_vt_idx;
 
     shape_t shape;
 
-    bool found_all_colors = true;
+    bool found_all_colors;
 
-    size_t line_num = 0;
-    std::string linebuf;
-    while (inStream->peek() != -1) {
-        safeGetline(*inStream, linebuf);
+    size_t line_num;
 
-        line_num++;
+    obj_load_state_t()
+        : material(-1),
+        current_smoothing_id(0),  // Initial value. 0 means no smoothing.
+        greatest_v_idx(-1),
+        greatest_vn_idx(-1),
+        greatest_vt_idx(-1),
+        found_all_colors(true),
+        line_num(0) {}
+};
 
-        // Trim newline '\r\n' or '\n'
-        if (linebuf.size() > 0) {
-            if (linebuf[linebuf.size() - 1] == '\n')
-                linebuf.erase(linebuf.size() - 1);
+// Handles every command other than 'v', 'vn', 'vt' and 'f'. `token` points
+// to the first non-space character of the line.
+static void parseObjCommand(obj_load_state_t *state, const char *token,
+    std::vector<shape_t> *shapes,
+    std::vector<material_t> *materials,
+    MaterialReader *readMatFn, bool triangulate,
+    std::string *warn, std::string *err) {
+    // line
+    if (token[0] == 'l' && IS_SPACE((token[1]))) {
+        token += 2;
+
+        line_t line_cache;
+        bool end_line_bit = 0;
+        while (!IS_NEW_LINE(token[0])) {
+            // get index from string
+            int idx;
+            fixIndex(parseInt(&token), 0, &idx);
+
+            size_t n = strspn(token, " \t\r");
+            token += n;
+
+            if (!end_line_bit) {
+                line_cache.idx0 = idx;
+            } else {
+                line_cache.idx1 = idx;
+                state->lineGroup.push_back(line_cache.idx0);
+                state->lineGroup.push_back(line_cache.idx1);
+                line_cache = line_t();
+            }
+            end_line_bit = !end_line_bit;
         }
-        if (linebuf.size() > 0) {
-            if (linebuf[linebuf.size() - 1] == '\r')
-                linebuf.erase(linebuf.size() - 1);
+
+        return;
+    }
+
+    // use mtl
+    if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
+        token += 7;
+        std::stringstream ss;
+        ss << token;
+        std::string namebuf = ss.str();
+
+        int newMaterialId = -1;
+        if (state->material_map.find(namebuf) != state->material_map.end()) {
+            newMaterialId = state->material_map[namebuf];
+        } else {
+            // { error!! material not found }
         }
 
-        // Skip if empty line.
-        if (linebuf.empty()) {
-            continue;
+        if (newMaterialId != state->material) {
+            // Create per-face material. Thus we don't add `shape` to `shapes` at
+            // this time.
+            // just clear `faceGroup` after `exportGroupsToShape()` call.
+            exportGroupsToShape(&state->shape, state->faceGroup, state->lineGroup,
+                state->tags, state->material, state->name,
+                triangulate, state->v);
+            state->faceGroup.clear();
+            state->material = newMaterialId;
         }
 
-        // Skip leading space.
-        const char *token = linebuf.c_str();
-        token += strspn(token, " \t");
+        return;
+    }
 
-        assert(token);
-        if (token[0] == '\0') continue;  // empty line
+    // load mtl
+    if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
+        if (readMatFn) {
+            token += 7;
 
-        if (token[0] == '#') continue;  // comment line
+            std::vector<std::string> filenames;
+            SplitString(std::string(token), ' ', filenames);
 
-                                        // vertex
-        if (token[0] == 'v' && IS_SPACE((token[1]))) {
-            token += 2;
-            real_t x, y, z;
-            real_t r, g, b;
+            if (filenames.empty()) {
+                if (warn) {
+                    std::stringstream ss;
+                    ss << "Looks like empty filename for mtllib. Use default "
+                        "material (line "
+                        << state->line_num << ".)\n";
 
-            found_all_colors &= parseVertexWithColor(&x, &y, &z, &r, &g, &b, &token);
+                    (*warn) += ss.str();
+                }
+            } else {
+                bool found = false;
+                for (size_t s = 0; s < filenames.size(); s++) {
+                    std::string warn_mtl;
+                    std::string err_mtl;
+                    bool ok = (*readMatFn)(filenames[s].c_str(), materials,
+                        &state->material_map, &warn_mtl, &err_mtl);
+                    if (warn && (!warn_mtl.empty())) {
+                        (*warn) += warn_mtl;
+                    }
 
-            v.push_back(x);
-            v.push_back(y);
-            v.push_back(z);
+                    if (err && (!err_mtl.empty())) {
+                        (*err) += err_mtl;
+                    }
 
-            if (found_all_colors || default_vcols_fallback) {
-                vc.push_back(r);
-                vc.push_back(g);
-                vc.push_back(b);
-            }
+                    if (ok) {
+                        found = true;
+                        break;
+                    }
+                }
 
-            continue;
-        }
-
-        // normal
-        if (token[0] == 'v' && token[1] == 'n' && IS_SPACE((token[2]))) {
-            token += 3;
-            real_t x, y, z;
-            parseReal3(&x, &y, &z, &token);
-            vn.push_back(x);
-            vn.push_back(y);
-            vn.push_back(z);
-            continue;
-        }
-
-        // texcoord
-        if (token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2]))) {
-            token += 3;
-            real_t x, y;
-            parseReal2(&x, &y, &token);
-            vt.push_back(x);
-            vt.push_back(y);
-            continue;
-        }
-
-        // line
-        if (token[0] == 'l' && IS_SPACE((token[1]))) {
-            token += 2;
-
-            line_t line_cache;
-            bool end_line_bit = 0;
-            while (!IS_NEW_LINE(token[0])) {
-                // get index from string
-                int idx;
-                fixIndex(parseInt(&token), 0, &idx);
-
-                size_t n = strspn(token, " \t\r");
-                token += n;
-
-                if (!end_line_bit) {
-                    line_cache.idx0 = idx;
-                } else {
-                    line_cache.idx1 = idx;
-                    lineGroup.push_back(line_cache.idx0);
-                    lineGroup.push_back(line_cache.idx1);
-                    line_cache = line_t();
+                if (!found) {
+                    if (warn) {
+                        (*warn) +=
+                            "Failed to load material file(s). Use default "
+                            "material.\n";
+                    }
                 }
-                end_line_bit = !end_line_bit;
             }
-
-            continue;
         }
-        // face
-        if (token[0] == 'f' && IS_SPACE((token[1]))) {
-            token += 2;
-            token += strspn(token, " \t");
-
-            face_t face;
-
-            face.smoothing_group_id = current_smoothing_id;
-            face.vertex_indices.reserve(3);
-
-            while (!IS_NEW_LINE(token[0])) {
-                vertex_index_t vi;
-                if (!parseTriple(&token, static_cast<int>(v.size() / 3),
-                    static_cast<int>(vn.size() / 3),
-                    static_cast<int>(vt.size() / 2), &vi)) {
-                    if (err) {
-                        std::stringstream ss;
-                        ss << "Failed parse `f' line(e.g. zero value for face index. line "
-                            << line_num << ".)\n";
-                        (*err) += ss.str();
-                    }
-                    return false;
-                }
 
-                greatest_v_idx = greatest_v_idx > vi.v_idx ? greatest_v_idx : vi.v_idx;
-                greatest_vn_idx =
-                    greatest_vn_idx > vi.vn_idx ? greatest_vn_idx : vi.vn_idx;
-                greatest_vt_idx =
-                    greatest_vt_idx > vi.vt_idx ? greatest_vt_idx : vi.vt_idx;
-
-                face.vertex_indices.push_back(vi);
-                size_t n = strspn(token, " \t\r");
-                token += n;
-            }
+        return;
+    }
 
-            // replace with emplace_back + std::move on C++11
-            faceGroup.push_back(face);
+    // group name
+    if (token[0] == 'g' && IS_SPACE((token[1]))) {
+        // flush previous face group.
+        bool ret = exportGroupsToShape(&state->shape, state->faceGroup,
+            state->lineGroup, state->tags,
+            state->material, state->name, triangulate,
+            state->v);
+        (void)ret;  // return value not used.
 
-            continue;
+        if (state->shape.mesh.indices.size() > 0) {
+            shapes->push_back(state->shape);
         }
 
-        // use mtl
-        if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
-            token += 7;
-            std::stringstream ss;
-            ss << token;
-            std::string namebuf = ss.str();
+        state->shape = shape_t();
 
-            int newMaterialId = -1;
-            if (material_map.find(namebuf) != material_map.end()) {
-                newMaterialId = material_map[namebuf];
-            } else {
-                // { error!! material not found }
-            }
+        // material = -1;
+        state->faceGroup.clear();
 
-            if (newMaterialId != material) {
-                // Create per-face material. Thus we don't add `shape` to `shapes` at
-                // this time.
-                // just clear `faceGroup` after `exportGroupsToShape()` call.
-                exportGroupsToShape(&shape, faceGroup, lineGroup, tags, material, name,
-                    triangulate, v);
-                faceGroup.clear();
-                material = newMaterialId;
-            }
+        std::vector<std::string> names;
 
-            continue;
+        while (!IS_NEW_LINE(token[0])) {
+            std::string str = parseString(&token);
+            names.push_back(str);
+            token += strspn(token, " \t\r");  // skip tag
         }
 
-        // load mtl
-        if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
-            if (readMatFn) {
-                token += 7;
+        // names[0] must be 'g'
 
-                std::vector<std::string> filenames;
-                SplitString(std::string(token), ' ', filenames);
-
-                if (filenames.empty()) {
-                    if (warn) {
-                        std::stringstream ss;
-                        ss << "Looks like empty filename for mtllib. Use default "
-                            "material (line "
-                            << line_num << ".)\n";
-
-                        (*warn) += ss.str();
-                    }
-                } else {
-                    bool found = false;
-                    for (size_t s = 0; s < filenames.size(); s++) {
-                        std::string warn_mtl;
-                        std::string err_mtl;
-                        bool ok = (*readMatFn)(filenames[s].c_str(), materials,
-                            &material_map, &warn_mtl, &err_mtl);
-                        if (warn && (!warn_mtl.empty())) {
-                            (*warn) += warn_mtl;
-                        }
-
-                        if (err && (!err_mtl.empty())) {
-                            (*err) += err_mtl;
-                        }
+        if (names.size() < 2) {
+            // 'g' with empty names
+            if (warn) {
+                std::stringstream ss;
+                ss << "Empty group name. line: " << state->line_num << "\n";
+                (*warn) += ss.str();
+                state->name = "";
+            }
+        } else {
+            std::stringstream ss;
+            ss << names[1];
 
-                        if (ok) {
-                            found = true;
-                            break;
-                        }
-                    }
+            // tinyobjloader does not support multiple groups for a primitive.
+            // Currently we concatinate multiple group names with a space to get
+            // single group name.
 
-                    if (!found) {
-                        if (warn) {
-                            (*warn) +=
-                                "Failed to load material file(s). Use default "
-                                "material.\n";
-                        }
-                    }
-                }
+            for (size_t i = 2; i < names.size(); i++) {
+                ss << " " << names[i];
             }
 
-            continue;
+            state->name = ss.str();
         }
 
-        // group name
-        if (token[0] == 'g' && IS_SPACE((token[1]))) {
-            // flush previous face group.
-            bool ret = exportGroupsToShape(&shape, faceGroup, lineGroup, tags,
-                material, name, triangulate, v);
-            (void)ret;  // return value not used.
+        return;
+    }
 
-            if (shape.mesh.indices.size() > 0) {
-                shapes->push_back(shape);
-            }
+    // object name
+    if (token[0] == 'o' && IS_SPACE((token[1]))) {
+        // flush previous face group.
+        bool ret = exportGroupsToShape(&state->shape, state->faceGroup,
+            state->lineGroup, state->tags,
+            state->material, state->name, triangulate,
+            state->v);
+        if (ret) {
+            shapes->push_back(state->shape);
+        }
 
-            shape = shape_t();
+        // material = -1;
+        state->faceGroup.clear();
+        state->shape = shape_t();
 
-            // material = -1;
-            faceGroup.clear();
+        // @todo { multiple object name? }
+        token += 2;
+        std::stringstream ss;
+        ss << token;
+        state->name = ss.str();
 
-            std::vector<std::string> names;
+        return;
+    }
 
-            while (!IS_NEW_LINE(token[0])) {
-                std::string str = parseString(&token);
-                names.push_back(str);
-                token += strspn(token, " \t\r");  // skip tag
-            }
+    if (token[0] == 't' && IS_SPACE(token[1])) {
+        const int max_tag_nums = 8192;  // FIXME(syoyo): Parameterize.
+        tag_t tag;
 
-            // names[0] must be 'g'
+        token += 2;
 
-            if (names.size() < 2) {
-                // 'g' with empty names
-                if (warn) {
-                    std::stringstream ss;
-                    ss << "Empty group name. line: " << line_num << "\n";
-                    (*warn) += ss.str();
-                    name = "";
-                }
-            } else {
-                std::stringstream ss;
-                ss << names[1];
-
-                // tinyobjloader does not support multiple groups for a primitive.
-                // Currently we concatinate multiple group names with a space to get
-                // single group name.
-
-                for (size_t i = 2; i < names.size(); i++) {
-                    ss << " " << names[i];
-                }
+        tag.name = parseString(&token);
 
-                name = ss.str();
-            }
+        tag_sizes ts = parseTagTriple(&token);
 
-            continue;
+        if (ts.num_ints < 0) {
+            ts.num_ints = 0;
         }
-
-        // object name
-        if (token[0] == 'o' && IS_SPACE((token[1]))) {
-            // flush previous face group.
-            bool ret = exportGroupsToShape(&shape, faceGroup, lineGroup, tags,
-                material, name, triangulate, v);
-            if (ret) {
-                shapes->push_back(shape);
-            }
-
-            // material = -1;
-            faceGroup.clear();
-            shape = shape_t();
-
-            // @todo { multiple object name? }
-            token += 2;
-            std::stringstream ss;
-            ss << token;
-            name = ss.str();
-
-            continue;
+        if (ts.num_ints > max_tag_nums) {
+            ts.num_ints = max_tag_nums;
         }
 
-        if (token[0] == 't' && IS_SPACE(token[1])) {
-            const int max_tag_nums = 8192;  // FIXME(syoyo): Parameterize.
-            tag_t tag;
-
-            token += 2;
-
-            tag.name = parseString(&token);
+        if (ts.num_reals < 0) {
+            ts.num_reals = 0;
+        }
+        if (ts.num_reals > max_tag_nums) {
+            ts.num_reals = max_tag_nums;
+        }
 
-            tag_sizes ts = parseTagTriple(&token);
+        if (ts.num_strings < 0) {
+            ts.num_strings = 0;
+        }
+        if (ts.num_strings > max_tag_nums) {
+            ts.num_strings = max_tag_nums;
+        }
 
-            if (ts.num_ints < 0) {
-                ts.num_ints = 0;
-            }
-            if (ts.num_ints > max_tag_nums) {
-                ts.num_ints = max_tag_nums;
-            }
+        tag.intValues.resize(static_cast<size_t>(ts.num_ints));
 
-            if (ts.num_reals < 0) {
-                ts.num_reals = 0;
-            }
-            if (ts.num_reals > max_tag_nums) {
-                ts.num_reals = max_tag_nums;
-            }
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
+            tag.intValues[i] = parseInt(&token);
+        }
 
-            if (ts.num_strings < 0) {
-                ts.num_strings = 0;
-            }
-            if (ts.num_strings > max_tag_nums) {
-                ts.num_strings = max_tag_nums;
-            }
+        tag.floatValues.resize(static_cast<size_t>(ts.num_reals));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_reals); ++i) {
+            tag.floatValues[i] = parseReal(&token);
+        }
 
-            tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+        tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
+            tag.stringValues[i] = parseString(&token);
+        }
 
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
-                tag.intValues[i] = parseInt(&token);
-            }
+        state->tags.push_back(tag);
 
-            tag.floatValues.resize(static_cast<size_t>(ts.num_reals));
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_reals); ++i) {
-                tag.floatValues[i] = parseReal(&token);
-            }
+        return;
+    }
 
-            tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
-                tag.stringValues[i] = parseString(&token);
-            }
+    if (token[0] == 's' && IS_SPACE(token[1])) {
+        // smoothing group id
+        token += 2;
 
-            tags.push_back(tag);
+        // skip space.
+        token += strspn(token, " \t");  // skip space
 
-            continue;
+        if (token[0] == '\0') {
+            return;
         }
 
-        if (token[0] == 's' && IS_SPACE(token[1])) {
-            // smoothing group id
-            token += 2;
-
-            // skip space.
-            token += strspn(token, " \t");  // skip space
-
-            if (token[0] == '\0') {
-                continue;
-            }
+        if (token[0] == '\r' || token[1] == '\n') {
+            return;
+        }
 
-            if (token[0] == '\r' || token[1] == '\n') {
-                continue;
+        if (strlen(token) >= 3) {
+            if (token[0] == 'o' && token[1] == 'f' && token[2] == 'f') {
+                state->current_smoothing_id = 0;
             }
-
-            if (strlen(token) >= 3) {
-                if (token[0] == 'o' && token[1] == 'f' && token[2] == 'f') {
-                    current_smoothing_id = 0;
-                }
+        } else {
+            // assume number
+            int smGroupId = parseInt(&token);
+            if (smGroupId < 0) {
+                // parse error. force set to 0.
+                // FIXME(syoyo): Report warning.
+                state->current_smoothing_id = 0;
             } else {
-                // assume number
-                int smGroupId = parseInt(&token);
-                if (smGroupId < 0) {
-                    // parse error. force set to 0.
-                    // FIXME(syoyo): Report warning.
-                    current_smoothing_id = 0;
-                } else {
-                    current_smoothing_id = static_cast<unsigned int>(smGroupId);
-                }
+                state->current_smoothing_id = static_cast<unsigned int>(smGroupId);
             }
+        }
 
-            continue;
-        }  // smoothing group id
+        return;
+    }  // smoothing group id
 
-           // Ignore unknown command.
-    }
+       // Ignore unknown command.
+}
 
+// Flushes the last shape and moves the attributes into `attrib`.
+static void finishObj(obj_load_state_t *state, attrib_t *attrib,
+    std::vector<shape_t> *shapes, bool triangulate,
+    bool default_vcols_fallback, std::string *warn) {
     // not all vertices have colors, no default colors desired? -> clear colors
-    if (!found_all_colors && !default_vcols_fallback) {
-        vc.clear();
+    if (!state->found_all_colors && !default_vcols_fallback) {
+        state->vc.clear();
     }
 
-    if (greatest_v_idx >= static_cast<int>(v.size() / 3)) {
+    if (state->greatest_v_idx >= static_cast<int>(state->v.size() / 3)) {
         if (warn) {
             std::stringstream ss;
-            ss << "Vertex indices out of bounds (line " << line_num << ".)\n"
+            ss << "Vertex indices out of bounds (line " << state->line_num << ".)\n"
                 << std::endl;
             (*warn) += ss.str();
         }
     }
-    if (greatest_vn_idx >= static_cast<int>(vn.size() / 3)) {
+    if (state->greatest_vn_idx >= static_cast<int>(state->vn.size() / 3)) {
         if (warn) {
             std::stringstream ss;
-            ss << "Vertex normal indices out of bounds (line " << line_num << ".)\n"
+            ss << "Vertex normal indices out of bounds (line " << state->line_num << ".)\n"
                 << std::endl;
             (*warn) += ss.str();
         }
     }
-    if (greatest_vt_idx >= static_cast<int>(vt.size() / 2)) {
+    if (state->greatest_vt_idx >= static_cast<int>(state->vt.size() / 2)) {
         if (warn) {
             std::stringstream ss;
-            ss << "Vertex texcoord indices out of bounds (line " << line_num << ".)\n"
+            ss << "Vertex texcoord indices out of bounds (line " << state->line_num << ".)\n"
                 << std::endl;
             (*warn) += ss.str();
         }
     }
 
-    bool ret = exportGroupsToShape(&shape, faceGroup, lineGroup, tags, material,
-        name, triangulate, v);
+    bool ret = exportGroupsToShape(&state->shape, state->faceGroup,
+        state->lineGroup, state->tags, state->material,
+        state->name, triangulate, state->v);
     // exportGroupsToShape return false when `usemtl` is called in the last
     // line.
     // we also add `shape` to `shapes` when `shape.mesh` has already some
     // faces(indices)
-    if (ret || shape.mesh.indices.size()) {
-        shapes->push_back(shape);
+    if (ret || state->shape.mesh.indices.size()) {
+        shapes->push_back(state->shape);
     }
-    faceGroup.clear();  // for safety
+    state->faceGroup.clear();  // for safety
 
+    attrib->vertices.swap(state->v);
+    attrib->normals.swap(state->vn);
+    attrib->texcoords.swap(state->vt);
+    attrib->colors.swap(state->vc);
+}
+
+static void reportFaceError(size_t line_num, std::string *err) {
     if (err) {
-        (*err) += errss.str();
+        std::stringstream ss;
+        ss << "Failed parse `f' line(e.g. zero value for face index. line "
+            << line_num << ".)\n";
+        (*err) += ss.str();
     }
-
-    attrib->vertices.swap(v);
-    attrib->normals.swap(vn);
-    attrib->texcoords.swap(vt);
-    attrib->colors.swap(vc);
-
-    return true;
 }
 
-bool LoadObjWithCallback(std::istream &inStream, const callback_t &callback,
-    void *user_data /*= NULL*/,
-    MaterialReader *readMatFn /*= NULL*/,
-    std::string *warn, /* = NULL*/
-    std::string *err /*= NULL*/) {
+bool LoadObj(attrib_t *attrib, std::vector<shape_t> *shapes,
+    std::vector<material_t> *materials, std::string *warn,
+    std::string *err, std::istream *inStream,
+    MaterialReader *readMatFn /*= NULL*/, bool triangulate,
+    bool default_vcols_fallback) {
     std::stringstream errss;
 
-    // material
-    std::map<std::string, int> material_map;
-    int material_id = -1;  // -1 = invalid
-
-    std::vector<index_t> indices;
-    std::vector<material_t> materials;
-    std::vector<std::string> names;
-    names.reserve(2);
-    std::vector<const char *> names_out;
+    obj_load_state_t state;
 
     std::string linebuf;
-    while (inStream.peek() != -1) {
-        safeGetline(inStream, linebuf);
+    while (inStream->peek() != -1) {
+        safeGetline(*inStream, linebuf);
+
+        state.line_num++;
 
         // Trim newline '\r\n' or '\n'
         if (linebuf.size() > 0) {
@@ -2325,12 +2686,21 @@ bool LoadObjWithCallback(std::istream &inStream, const callback_t &callback,
                                         // vertex
         if (token[0] == 'v' && IS_SPACE((token[1]))) {
             token += 2;
-            // TODO(syoyo): Support parsing vertex color extension.
-            real_t x, y, z, w;  // w is optional. default = 1.0
-            parseV(&x, &y, &z, &w, &token);
-            if (callback.vertex_cb) {
-                callback.vertex_cb(user_data, x, y, z, w);
+            real_t x, y, z;
+            real_t r, g, b;
+
+            state.found_all_colors &= parseVertexWithColor(&x, &y, &z, &r, &g, &b, &token);
+
+            state.v.push_back(x);
+            state.v.push_back(y);
+            state.v.push_back(z);
+
+            if (state.found_all_colors || default_vcols_fallback) {
+                state.vc.push_back(r);
+                state.vc.push_back(g);
+                state.vc.push_back(b);
             }
+
             continue;
         }
 
@@ -2339,20 +2709,19 @@ bool LoadObjWithCallback(std::istream &inStream, const callback_t &callback,
             token += 3;
             real_t x, y, z;
             parseReal3(&x, &y, &z, &token);
-            if (callback.normal_cb) {
-                callback.normal_cb(user_data, x, y, z);
-            }
+            state.vn.push_back(x);
+            state.vn.push_back(y);
+            state.vn.push_back(z);
             continue;
         }
 
         // texcoord
         if (token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2]))) {
             token += 3;
-            real_t x, y, z;  // y and z are optional. default = 0.0
-            parseReal3(&x, &y, &z, &token);
-            if (callback.texcoord_cb) {
-                callback.texcoord_cb(user_data, x, y, z);
-            }
+            real_t x, y;
+            parseReal2(&x, &y, &token);
+            state.vt.push_back(x);
+            state.vt.push_back(y);
             continue;
         }
 
@@ -2361,192 +2730,750 @@ bool LoadObjWithCallback(std::istream &inStream, const callback_t &callback,
             token += 2;
             token += strspn(token, " \t");
 
-            indices.clear();
+            face_t face;
+
+            face.smoothing_group_id = state.current_smoothing_id;
+            face.vertex_indices.reserve(3);
+
             while (!IS_NEW_LINE(token[0])) {
-                vertex_index_t vi = parseRawTriple(&token);
+                vertex_index_t vi;
+                if (!parseTriple(&token, static_cast<int>(state.v.size() / 3),
+                    static_cast<int>(state.vn.size() / 3),
+                    static_cast<int>(state.vt.size() / 2), &vi)) {
+                    reportFaceError(state.line_num, err);
+                    return false;
+                }
 
-                index_t idx;
-                idx.vertex_index = vi.v_idx;
-                idx.normal_index = vi.vn_idx;
-                idx.texcoord_index = vi.vt_idx;
+                state.greatest_v_idx = state.greatest_v_idx > vi.v_idx ? state.greatest_v_idx : vi.v_idx;
+                state.greatest_vn_idx =
+                    state.greatest_vn_idx > vi.vn_idx ? state.greatest_vn_idx : vi.vn_idx;
+                state.greatest_vt_idx =
+                    state.greatest_vt_idx > vi.vt_idx ? state.greatest_vt_idx : vi.vt_idx;
 
-                indices.push_back(idx);
+                face.vertex_indices.push_back(vi);
                 size_t n = strspn(token, " \t\r");
                 token += n;
             }
 
-            if (callback.index_cb && indices.size() > 0) {
-                callback.index_cb(user_data, &indices.at(0),
-                    static_cast<int>(indices.size()));
-            }
+            // replace with emplace_back + std::move on C++11
+            state.faceGroup.push_back(face);
 
             continue;
         }
 
-        // use mtl
-        if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
-            token += 7;
-            std::stringstream ss;
-            ss << token;
-            std::string namebuf = ss.str();
+        parseObjCommand(&state, token, shapes, materials, readMatFn, triangulate,
+            warn, err);
+    }
 
-            int newMaterialId = -1;
-            if (material_map.find(namebuf) != material_map.end()) {
-                newMaterialId = material_map[namebuf];
-            } else {
-                // { error!! material not found }
-            }
+    finishObj(&state, attrib, shapes, triangulate, default_vcols_fallback, warn);
 
-            if (newMaterialId != material_id) {
-                material_id = newMaterialId;
-            }
+    if (err) {
+        (*err) += errss.str();
+    }
+
+    return true;
+}
+
+// Marks a face index that is not present in a face triple. The chunks keep
+// the indices as written, and resolving them with fixIndex() is deferred until
+// the number of preceding attributes is known.
+static const int kAbsentIndex = (std::numeric_limits<int>::min)();
 
-            if (callback.usemtl_cb) {
-                callback.usemtl_cb(user_data, namebuf.c_str(), material_id);
+static bool resolveDeferredIndex(int idx, int n, int *ret) {
+    if (idx == kAbsentIndex) {
+        (*ret) = -1;
+        return true;
+    }
+    return fixIndex(idx, n, ret);
+}
+
+// A line of a chunk that is replayed in order once all chunks are parsed.
+struct obj_chunk_record_t {
+    enum kind_t { FACE, BAD_FACE, COMMAND };
+
+    kind_t kind;
+    size_t line_num;  // Line number within the chunk (1-based)
+
+    // FACE: the range of the face's indices in obj_chunk_t::face_indices.
+    // COMMAND: the offset and length of the line in the chunk.
+    size_t begin;
+    size_t size;
+
+    // FACE: the number of attributes in the chunk preceding the face.
+    int num_v;
+    int num_vn;
+    int num_vt;
+};
+
+// Results of parsing one chunk of an .obj file
+struct obj_chunk_t {
+    const char *begin;
+    const char *end;
+
+    size_t num_lines;
+    bool found_all_colors;
+
+    std::vector<real_t> v;
+    std::vector<real_t> vn;
+    std::vector<real_t> vt;
+    std::vector<real_t> vc;
+    std::vector<vertex_index_t> face_indices;
+    std::vector<obj_chunk_record_t> records;
+
+    // Offsets of the chunk's attributes within the whole file, in elements.
+    size_t v_offset;
+    size_t vn_offset;
+    size_t vt_offset;
+    size_t vc_offset;
+
+    int greatest_v_idx;
+    int greatest_vn_idx;
+    int greatest_vt_idx;
+
+    obj_chunk_t()
+        : begin(NULL),
+        end(NULL),
+        num_lines(0),
+        found_all_colors(true),
+        v_offset(0),
+        vn_offset(0),
+        vt_offset(0),
+        vc_offset(0),
+        greatest_v_idx(-1),
+        greatest_vn_idx(-1),
+        greatest_vt_idx(-1) {}
+};
+
+// Calls fn(i) for i in [0, count) on up to num_threads threads. If a call
+// throws, no more indices are handed out, and the first exception is rethrown
+// once the threads have stopped.
+template <typename Fn>
+static void parallelFor(size_t count, unsigned int num_threads, Fn fn) {
+    if (num_threads <= 1 || count <= 1) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::vector<std::thread> threads;
+    size_t num_workers = (std::min)(count, static_cast<size_t>(num_threads));
+    threads.reserve(num_workers);
+    for (size_t t = 0; t < num_workers; ++t) {
+        threads.push_back(std::thread([&]() {
+            try {
+                for (size_t i = next++; i < count; i = next++) fn(i);
+            } catch (...) {
+                next = count;
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
             }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) threads[t].join();
+    if (error) std::rethrow_exception(error);
+}
+
+// Tokenizes the 'v', 'vn', 'vt' and 'f' lines of a chunk in place, and
+// records the positions of all other commands so they can be replayed in order
+// later.
+static void parseObjChunk(obj_chunk_t *chunk) {
+    const char *p = chunk->begin;
+    while (p < chunk->end) {
+        // Find the end of the line. Line endings are the same as safeGetline().
+        const char *line_end = findLineEnd(p, chunk->end);
+        const char *next = line_end;
+        if (next < chunk->end) {
+            if (next[0] == '\r' && next + 1 < chunk->end && next[1] == '\n')
+                next += 2;
+            else
+                next += 1;
+        }
+
+        const char *line = p;
+        p = next;
+
+        chunk->num_lines++;
+
+        // Skip leading space.
+        const char *token = skipSpace(line, line_end);
+
+        if (token == line_end) continue;  // empty line
+
+        if (token[0] == '#') continue;  // comment line
+
+        // The line is not terminated, so token[1] may only be read if it is
+        // before the end.
+        bool has_second = line_end - token >= 2;
+
+        // vertex
+        if (token[0] == 'v' && has_second && IS_SPACE((token[1]))) {
+            token += 2;
+            real_t x, y, z;
+            real_t r, g, b;
+
+            chunk->found_all_colors &=
+                fastParseVertexWithColor(&x, &y, &z, &r, &g, &b, &token, line_end);
+
+            chunk->v.push_back(x);
+            chunk->v.push_back(y);
+            chunk->v.push_back(z);
+
+            // Unlike LoadObj(), the colors are always kept. Whether they are
+            // all present is only known once every chunk has been parsed, and
+            // finishObj() discards them then if necessary.
+            chunk->vc.push_back(r);
+            chunk->vc.push_back(g);
+            chunk->vc.push_back(b);
 
             continue;
         }
 
-        // load mtl
-        if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
-            if (readMatFn) {
-                token += 7;
+        // normal
+        if (token[0] == 'v' && line_end - token >= 3 && token[1] == 'n' &&
+            IS_SPACE((token[2]))) {
+            token += 3;
+            real_t x = fastParseReal(&token, line_end);
+            real_t y = fastParseReal(&token, line_end);
+            real_t z = fastParseReal(&token, line_end);
+            chunk->vn.push_back(x);
+            chunk->vn.push_back(y);
+            chunk->vn.push_back(z);
+            continue;
+        }
 
-                std::vector<std::string> filenames;
-                SplitString(std::string(token), ' ', filenames);
+        // texcoord
+        if (token[0] == 'v' && line_end - token >= 3 && token[1] == 't' &&
+            IS_SPACE((token[2]))) {
+            token += 3;
+            real_t x = fastParseReal(&token, line_end);
+            real_t y = fastParseReal(&token, line_end);
+            chunk->vt.push_back(x);
+            chunk->vt.push_back(y);
+            continue;
+        }
 
-                if (filenames.empty()) {
-                    if (warn) {
-                        (*warn) +=
-                            "Looks like empty filename for mtllib. Use default "
-                            "material. \n";
-                    }
-                } else {
-                    bool found = false;
-                    for (size_t s = 0; s < filenames.size(); s++) {
-                        std::string warn_mtl;
-                        std::string err_mtl;
-                        bool ok = (*readMatFn)(filenames[s].c_str(), &materials,
-                            &material_map, &warn_mtl, &err_mtl);
-
-                        if (warn && (!warn_mtl.empty())) {
-                            (*warn) += warn_mtl;  // This should be warn message.
-                        }
+        obj_chunk_record_t record;
+        record.line_num = chunk->num_lines;
+        record.num_v = static_cast<int>(chunk->v.size() / 3);
+        record.num_vn = static_cast<int>(chunk->vn.size() / 3);
+        record.num_vt = static_cast<int>(chunk->vt.size() / 2);
 
-                        if (err && (!err_mtl.empty())) {
-                            (*err) += err_mtl;
-                        }
+        // face
+        if (token[0] == 'f' && has_second && IS_SPACE((token[1]))) {
+            token = skipSpace(token + 2, line_end);
+
+            record.kind = obj_chunk_record_t::FACE;
+            record.begin = chunk->face_indices.size();
+            while (token < line_end) {
+                chunk->face_indices.push_back(
+                    fastParseRawTriple(&token, line_end, kAbsentIndex));
+                token = skipSpace(token, line_end);
+            }
+            record.size = chunk->face_indices.size() - record.begin;
+            chunk->records.push_back(record);
+            continue;
+        }
 
-                        if (ok) {
-                            found = true;
-                            break;
-                        }
-                    }
+        record.kind = obj_chunk_record_t::COMMAND;
+        record.begin = static_cast<size_t>(line - chunk->begin);
+        record.size = static_cast<size_t>(line_end - line);
+        chunk->records.push_back(record);
+    }
+}
 
-                    if (!found) {
-                        if (warn) {
-                            (*warn) +=
-                                "Failed to load material file(s). Use default "
-                                "material.\n";
-                        }
-                    } else {
-                        if (callback.mtllib_cb) {
-                            callback.mtllib_cb(user_data, &materials.at(0),
-                                static_cast<int>(materials.size()));
-                        }
-                    }
-                }
+// Resolves the chunk's face indices now that the number of attributes in the
+// preceding chunks is known, and copies its attributes into the merged arrays.
+static void resolveObjChunk(obj_chunk_t *chunk, obj_load_state_t *state) {
+    int v_base = static_cast<int>(chunk->v_offset / 3);
+    int vn_base = static_cast<int>(chunk->vn_offset / 3);
+    int vt_base = static_cast<int>(chunk->vt_offset / 2);
+
+    for (size_t r = 0; r < chunk->records.size(); ++r) {
+        obj_chunk_record_t &record = chunk->records[r];
+        if (record.kind != obj_chunk_record_t::FACE) continue;
+
+        for (size_t i = record.begin; i < record.begin + record.size; ++i) {
+            vertex_index_t raw = chunk->face_indices[i];
+            vertex_index_t &vi = chunk->face_indices[i];
+            if (!resolveDeferredIndex(raw.v_idx, v_base + record.num_v, &vi.v_idx) ||
+                !resolveDeferredIndex(raw.vn_idx, vn_base + record.num_vn, &vi.vn_idx) ||
+                !resolveDeferredIndex(raw.vt_idx, vt_base + record.num_vt, &vi.vt_idx)) {
+                // Parsing stops at the first bad face, so nothing after it matters.
+                record.kind = obj_chunk_record_t::BAD_FACE;
+                chunk->records.resize(r + 1);
+                break;
             }
 
-            continue;
+            chunk->greatest_v_idx = chunk->greatest_v_idx > vi.v_idx ? chunk->greatest_v_idx : vi.v_idx;
+            chunk->greatest_vn_idx =
+                chunk->greatest_vn_idx > vi.vn_idx ? chunk->greatest_vn_idx : vi.vn_idx;
+            chunk->greatest_vt_idx =
+                chunk->greatest_vt_idx > vi.vt_idx ? chunk->greatest_vt_idx : vi.vt_idx;
         }
+    }
 
-        // group name
-        if (token[0] == 'g' && IS_SPACE((token[1]))) {
-            names.clear();
+    if (!chunk->v.empty())
+        memcpy(&state->v[chunk->v_offset], &chunk->v[0], chunk->v.size() * sizeof(real_t));
+    if (!chunk->vn.empty())
+        memcpy(&state->vn[chunk->vn_offset], &chunk->vn[0], chunk->vn.size() * sizeof(real_t));
+    if (!chunk->vt.empty())
+        memcpy(&state->vt[chunk->vt_offset], &chunk->vt[0], chunk->vt.size() * sizeof(real_t));
+    if (!chunk->vc.empty())
+        memcpy(&state->vc[chunk->vc_offset], &chunk->vc[0], chunk->vc.size() * sizeof(real_t));
+
+    std::vector<real_t>().swap(chunk->v);
+    std::vector<real_t>().swap(chunk->vn);
+    std::vector<real_t>().swap(chunk->vt);
+    std::vector<real_t>().swap(chunk->vc);
+}
 
-            while (!IS_NEW_LINE(token[0])) {
-                std::string str = parseString(&token);
-                names.push_back(str);
-                token += strspn(token, " \t\r");  // skip tag
+bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+    std::vector<material_t> *materials, std::string *warn,
+    std::string *err, const char *buf, size_t len,
+    MaterialReader *readMatFn /*= NULL*/, bool triangulate,
+    bool default_vcols_fallback, unsigned int num_threads) {
+    attrib->vertices.clear();
+    attrib->normals.clear();
+    attrib->texcoords.clear();
+    attrib->colors.clear();
+    shapes->clear();
+
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+        if (num_threads == 0) num_threads = 1;
+    }
+
+    // Split the buffer just after a '\n' roughly every `chunk_size` bytes.
+    // There are several chunks per thread to even out the load.
+    const size_t min_chunk_size = 256 * 1024;
+    size_t num_chunks = static_cast<size_t>(num_threads) * 4;
+    if (len / num_chunks < min_chunk_size)
+        num_chunks = (std::max)(static_cast<size_t>(1), len / min_chunk_size);
+
+    std::vector<obj_chunk_t> chunks(num_chunks);
+    const char *begin = buf;
+    const char *end = buf + len;
+    for (size_t c = 0; c < num_chunks; ++c) {
+        const char *split = buf + len * (c + 1) / num_chunks;
+        if (split < begin) split = begin;
+        while (split > buf && split < end && split[-1] != '\n') ++split;
+        if (c == num_chunks - 1) split = end;
+        chunks[c].begin = begin;
+        chunks[c].end = split;
+        begin = split;
+    }
+
+    parallelFor(chunks.size(), num_threads, [&](size_t c) {
+        parseObjChunk(&chunks[c]);
+    });
+
+    // Prefix sums of the attribute counts give each chunk's place in the
+    // merged arrays and the base for its relative face indices.
+    obj_load_state_t state;
+    size_t v_size = 0, vn_size = 0, vt_size = 0, vc_size = 0;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        obj_chunk_t &chunk = chunks[c];
+        chunk.v_offset = v_size;
+        chunk.vn_offset = vn_size;
+        chunk.vt_offset = vt_size;
+        chunk.vc_offset = vc_size;
+        v_size += chunk.v.size();
+        vn_size += chunk.vn.size();
+        vt_size += chunk.vt.size();
+        vc_size += chunk.vc.size();
+        state.found_all_colors &= chunk.found_all_colors;
+    }
+    state.v.resize(v_size);
+    state.vn.resize(vn_size);
+    state.vt.resize(vt_size);
+    state.vc.resize(vc_size);
+
+    parallelFor(chunks.size(), num_threads, [&](size_t c) {
+        resolveObjChunk(&chunks[c], &state);
+    });
+
+    // Replay the faces and commands in order.
+    std::string linebuf;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        obj_chunk_t &chunk = chunks[c];
+        size_t first_line = state.line_num;
+        for (size_t r = 0; r < chunk.records.size(); ++r) {
+            const obj_chunk_record_t &record = chunk.records[r];
+            state.line_num = first_line + record.line_num;
+
+            if (record.kind == obj_chunk_record_t::BAD_FACE) {
+                reportFaceError(state.line_num, err);
+                return false;
             }
 
-            assert(names.size() > 0);
+            if (record.kind == obj_chunk_record_t::FACE) {
+                face_t face;
+                face.smoothing_group_id = state.current_smoothing_id;
+                face.vertex_indices.assign(
+                    chunk.face_indices.begin() + static_cast<std::ptrdiff_t>(record.begin),
+                    chunk.face_indices.begin() + static_cast<std::ptrdiff_t>(record.begin + record.size));
+                state.faceGroup.push_back(face);
+                continue;
+            }
 
-            if (callback.group_cb) {
-                if (names.size() > 1) {
-                    // create const char* array.
-                    names_out.resize(names.size() - 1);
-                    for (size_t j = 0; j < names_out.size(); j++) {
-                        names_out[j] = names[j + 1].c_str();
+            linebuf.assign(chunk.begin + record.begin, record.size);
+            const char *token = linebuf.c_str();
+            token += strspn(token, " \t");
+            parseObjCommand(&state, token, shapes, materials, readMatFn,
+                triangulate, warn, err);
+        }
+        state.line_num = first_line + chunk.num_lines;
+
+        state.greatest_v_idx = (std::max)(state.greatest_v_idx, chunk.greatest_v_idx);
+        state.greatest_vn_idx = (std::max)(state.greatest_vn_idx, chunk.greatest_vn_idx);
+        state.greatest_vt_idx = (std::max)(state.greatest_vt_idx, chunk.greatest_vt_idx);
+
+        std::vector<vertex_index_t>().swap(chunk.face_indices);
+    }
+
+    finishObj(&state, attrib, shapes, triangulate, default_vcols_fallback, warn);
+
+    return true;
+}
+
+bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+    std::vector<material_t> *materials, std::string *warn,
+    std::string *err, const char *filename, const char *mtl_basedir,
+    bool triangulate, bool default_vcols_fallback,
+    unsigned int num_threads, bool mmap_populate) {
+    attrib->vertices.clear();
+    attrib->normals.clear();
+    attrib->texcoords.clear();
+    attrib->colors.clear();
+    shapes->clear();
+
+    std::stringstream errss;
+
+    file_view_t file;
+    if (!file.open(filename, mmap_populate)) {
+        errss << "Cannot open file [" << filename << "]" << std::endl;
+        if (err) {
+            (*err) = errss.str();
+        }
+        return false;
+    }
+
+    MaterialFileReader matFileReader(materialBaseDir(mtl_basedir));
+
+    return LoadObjParallel(attrib, shapes, materials, warn, err, file.data(),
+        file.size(), &matFileReader, triangulate,
+        default_vcols_fallback, num_threads);
+}
+
+// State of LoadObjWithCallback() that is carried from line to line.
+struct callback_state_t {
+    // material
+    std::map<std::string, int> material_map;
+    int material_id;  // -1 = invalid
+
+    std::vector<index_t> indices;
+    std::vector<material_t> materials;
+    std::vector<std::string> names;
+    std::vector<const char *> names_out;
+
+    // A copy of a line whose command needs it to be terminated.
+    std::string linebuf;
+
+    callback_state_t() : material_id(-1) { names.reserve(2); }
+};
+
+// Handles one line of LoadObjWithCallback(). [token, line_end) is the line
+// without its line ending and leading space. If `terminated` is false, the line
+// is not followed by '\0', and it is copied before parsing any command other
+// than 'v', 'vn', 'vt' and 'f'.
+static void parseCallbackLine(callback_state_t *state, const char *token,
+    const char *line_end, bool terminated,
+    const callback_t &callback, void *user_data,
+    MaterialReader *readMatFn, std::string *warn,
+    std::string *err) {
+    // token[1] and token[2] may only be read if they are before the end.
+    ptrdiff_t length = line_end - token;
+
+    // vertex
+    if (token[0] == 'v' && length >= 2 && IS_SPACE((token[1]))) {
+        token += 2;
+        // TODO(syoyo): Support parsing vertex color extension.
+        real_t x = fastParseReal(&token, line_end);
+        real_t y = fastParseReal(&token, line_end);
+        real_t z = fastParseReal(&token, line_end);
+        real_t w = fastParseReal(&token, line_end, 1.0);  // w is optional
+        if (callback.vertex_cb) {
+            callback.vertex_cb(user_data, x, y, z, w);
+        }
+        return;
+    }
+
+    // normal
+    if (token[0] == 'v' && length >= 3 && token[1] == 'n' &&
+        IS_SPACE((token[2]))) {
+        token += 3;
+        real_t x = fastParseReal(&token, line_end);
+        real_t y = fastParseReal(&token, line_end);
+        real_t z = fastParseReal(&token, line_end);
+        if (callback.normal_cb) {
+            callback.normal_cb(user_data, x, y, z);
+        }
+        return;
+    }
+
+    // texcoord
+    if (token[0] == 'v' && length >= 3 && token[1] == 't' &&
+        IS_SPACE((token[2]))) {
+        token += 3;
+        real_t x = fastParseReal(&token, line_end);
+        real_t y = fastParseReal(&token, line_end);  // y and z are optional
+        real_t z = fastParseReal(&token, line_end);
+        if (callback.texcoord_cb) {
+            callback.texcoord_cb(user_data, x, y, z);
+        }
+        return;
+    }
+
+    // face
+    if (token[0] == 'f' && length >= 2 && IS_SPACE((token[1]))) {
+        token = skipSpace(token + 2, line_end);
+
+        state->indices.clear();
+        while (token < line_end) {
+            vertex_index_t vi = fastParseRawTriple(&token, line_end, 0);
+
+            index_t idx;
+            idx.vertex_index = vi.v_idx;
+            idx.normal_index = vi.vn_idx;
+            idx.texcoord_index = vi.vt_idx;
+
+            state->indices.push_back(idx);
+            token = skipSpace(token, line_end);
+        }
+
+        if (callback.index_cb && state->indices.size() > 0) {
+            callback.index_cb(user_data, &state->indices.at(0),
+                static_cast<int>(state->indices.size()));
+        }
+
+        return;
+    }
+
+    // The remaining commands are rare, and are parsed with functions that
+    // need a terminated string.
+    if (!terminated) {
+        state->linebuf.assign(token, line_end);
+        token = state->linebuf.c_str();
+    }
+
+    // use mtl
+    if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
+        token += 7;
+        std::stringstream ss;
+        ss << token;
+        std::string namebuf = ss.str();
+
+        int newMaterialId = -1;
+        if (state->material_map.find(namebuf) != state->material_map.end()) {
+            newMaterialId = state->material_map[namebuf];
+        } else {
+            // { error!! material not found }
+        }
+
+        if (newMaterialId != state->material_id) {
+            state->material_id = newMaterialId;
+        }
+
+        if (callback.usemtl_cb) {
+            callback.usemtl_cb(user_data, namebuf.c_str(), state->material_id);
+        }
+
+        return;
+    }
+
+    // load mtl
+    if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
+        if (readMatFn) {
+            token += 7;
+
+            std::vector<std::string> filenames;
+            SplitString(std::string(token), ' ', filenames);
+
+            if (filenames.empty()) {
+                if (warn) {
+                    (*warn) +=
+                        "Looks like empty filename for mtllib. Use default "
+                        "material. \n";
+                }
+            } else {
+                bool found = false;
+                for (size_t s = 0; s < filenames.size(); s++) {
+                    std::string warn_mtl;
+                    std::string err_mtl;
+                    bool ok = (*readMatFn)(filenames[s].c_str(), &state->materials,
+                        &state->material_map, &warn_mtl, &err_mtl);
+
+                    if (warn && (!warn_mtl.empty())) {
+                        (*warn) += warn_mtl;  // This should be warn message.
+                    }
+
+                    if (err && (!err_mtl.empty())) {
+                        (*err) += err_mtl;
+                    }
+
+                    if (ok) {
+                        found = true;
+                        break;
                     }
-                    callback.group_cb(user_data, &names_out.at(0),
-                        static_cast<int>(names_out.size()));
+                }
 
+                if (!found) {
+                    if (warn) {
+                        (*warn) +=
+                            "Failed to load material file(s). Use default "
+                            "material.\n";
+                    }
                 } else {
-                    callback.group_cb(user_data, NULL, 0);
+                    if (callback.mtllib_cb) {
+                        callback.mtllib_cb(user_data, &state->materials.at(0),
+                            static_cast<int>(state->materials.size()));
+                    }
                 }
             }
+        }
 
-            continue;
+        return;
+    }
+
+    // group name
+    if (token[0] == 'g' && IS_SPACE((token[1]))) {
+        state->names.clear();
+
+        while (!IS_NEW_LINE(token[0])) {
+            std::string str = parseString(&token);
+            state->names.push_back(str);
+            token += strspn(token, " \t\r");  // skip tag
         }
 
-        // object name
-        if (token[0] == 'o' && IS_SPACE((token[1]))) {
-            // @todo { multiple object name? }
-            token += 2;
+        assert(state->names.size() > 0);
 
-            std::stringstream ss;
-            ss << token;
-            std::string object_name = ss.str();
+        if (callback.group_cb) {
+            if (state->names.size() > 1) {
+                // create const char* array.
+                state->names_out.resize(state->names.size() - 1);
+                for (size_t j = 0; j < state->names_out.size(); j++) {
+                    state->names_out[j] = state->names[j + 1].c_str();
+                }
+                callback.group_cb(user_data, &state->names_out.at(0),
+                    static_cast<int>(state->names_out.size()));
 
-            if (callback.object_cb) {
-                callback.object_cb(user_data, object_name.c_str());
+            } else {
+                callback.group_cb(user_data, NULL, 0);
             }
+        }
 
-            continue;
+        return;
+    }
+
+    // object name
+    if (token[0] == 'o' && IS_SPACE((token[1]))) {
+        // @todo { multiple object name? }
+        token += 2;
+
+        std::stringstream ss;
+        ss << token;
+        std::string object_name = ss.str();
+
+        if (callback.object_cb) {
+            callback.object_cb(user_data, object_name.c_str());
         }
 
+        return;
+    }
+
 #if 0  // @todo
-        if (token[0] == 't' && IS_SPACE(token[1])) {
-            tag_t tag;
+    if (token[0] == 't' && IS_SPACE(token[1])) {
+        tag_t tag;
 
-            token += 2;
+        token += 2;
+        std::stringstream ss;
+        ss << token;
+        tag.name = ss.str();
+
+        token += tag.name.size() + 1;
+
+        tag_sizes ts = parseTagTriple(&token);
+
+        tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
+            tag.intValues[i] = atoi(token);
+            token += strcspn(token, "/ \t\r") + 1;
+        }
+
+        tag.floatValues.resize(static_cast<size_t>(ts.num_reals));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_reals); ++i) {
+            tag.floatValues[i] = parseReal(&token);
+            token += strcspn(token, "/ \t\r") + 1;
+        }
+
+        tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
             std::stringstream ss;
             ss << token;
-            tag.name = ss.str();
+            tag.stringValues[i] = ss.str();
+            token += tag.stringValues[i].size() + 1;
+        }
 
-            token += tag.name.size() + 1;
+        tags.push_back(tag);
+    }
+#endif
 
-            tag_sizes ts = parseTagTriple(&token);
+    // Ignore unknown command.
+}
 
-            tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+bool LoadObjWithCallback(std::istream &inStream, const callback_t &callback,
+    void *user_data /*= NULL*/,
+    MaterialReader *readMatFn /*= NULL*/,
+    std::string *warn, /* = NULL*/
+    std::string *err /*= NULL*/) {
+    std::stringstream errss;
 
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
-                tag.intValues[i] = atoi(token);
-                token += strcspn(token, "/ \t\r") + 1;
-            }
+    callback_state_t state;
 
-            tag.floatValues.resize(static_cast<size_t>(ts.num_reals));
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_reals); ++i) {
-                tag.floatValues[i] = parseReal(&token);
-                token += strcspn(token, "/ \t\r") + 1;
-            }
+    std::string linebuf;
+    while (inStream.peek() != -1) {
+        safeGetline(inStream, linebuf);
 
-            tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
-                std::stringstream ss;
-                ss << token;
-                tag.stringValues[i] = ss.str();
-                token += tag.stringValues[i].size() + 1;
-            }
+        // Trim newline '\r\n' or '\n'
+        if (linebuf.size() > 0) {
+            if (linebuf[linebuf.size() - 1] == '\n')
+                linebuf.erase(linebuf.size() - 1);
+        }
+        if (linebuf.size() > 0) {
+            if (linebuf[linebuf.size() - 1] == '\r')
+                linebuf.erase(linebuf.size() - 1);
+        }
 
-            tags.push_back(tag);
+        // Skip if empty line.
+        if (linebuf.empty()) {
+            continue;
         }
-#endif
 
-        // Ignore unknown command.
+        // Skip leading space.
+        const char *token = linebuf.c_str();
+        const char *line_end = token + linebuf.size();
+        token += strspn(token, " \t");
+
+        assert(token);
+        if (token[0] == '\0') continue;  // empty line
+
+        if (token[0] == '#') continue;  // comment line
+
+        parseCallbackLine(&state, token, line_end, true, callback, user_data,
+            readMatFn, warn, err);
     }
 
     if (err) {
@@ -2556,6 +3483,83 @@ bool LoadObjWithCallback(std::istream &inStream, const callback_t &callback,
     return true;
 }
 
+// Parses the lines of [buf, buf + len) for LoadObjWithCallback(). The buffer
+// must end at a line boundary.
+static void parseCallbackBuffer(callback_state_t *state, const char *buf,
+    size_t len, const callback_t &callback,
+    void *user_data, MaterialReader *readMatFn,
+    std::string *warn, std::string *err) {
+    const char *p = buf;
+    const char *end = buf + len;
+    while (p < end) {
+        // Line endings are the same as safeGetline().
+        const char *line_end = findLineEnd(p, end);
+        const char *token = skipSpace(p, line_end);
+        p = line_end;
+        if (p < end) {
+            if (p[0] == '\r' && p + 1 < end && p[1] == '\n')
+                p += 2;
+            else
+                p += 1;
+        }
+
+        if (token == line_end) continue;  // empty line
+
+        if (token[0] == '#') continue;  // comment line
+
+        parseCallbackLine(state, token, line_end, false, callback, user_data,
+            readMatFn, warn, err);
+    }
+}
+
+bool LoadObjWithCallback(const char *buf, size_t len,
+    const callback_t &callback, void *user_data /*= NULL*/,
+    MaterialReader *readMatFn /*= NULL*/,
+    std::string *warn, /* = NULL*/
+    std::string *err /*= NULL*/) {
+    callback_state_t state;
+    parseCallbackBuffer(&state, buf, len, callback, user_data, readMatFn, warn,
+        err);
+    return true;
+}
+
+bool LoadObjWithCallback(const char *filename, const callback_t &callback,
+    void *user_data, const char *mtl_basedir,
+    std::string *warn, std::string *err,
+    bool mmap_populate) {
+    file_view_t file;
+    if (!file.open(filename, mmap_populate)) {
+        if (err) {
+            std::stringstream errss;
+            errss << "Cannot open file [" << filename << "]" << std::endl;
+            (*err) = errss.str();
+        }
+        return false;
+    }
+
+    MaterialFileReader matFileReader(materialBaseDir(mtl_basedir));
+
+    // The file is parsed in blocks that end at a line boundary, and each block
+    // is discarded once it has been parsed. Otherwise every page of the file
+    // would stay in the process's memory until the end.
+    const size_t block_size = 64 * 1024 * 1024;
+    callback_state_t state;
+    const char *buf = file.data();
+    const char *end = buf + file.size();
+    const char *begin = buf;
+    while (begin < end) {
+        const char *split = begin + (std::min)(block_size,
+            static_cast<size_t>(end - begin));
+        while (split < end && split[-1] != '\n') ++split;
+        parseCallbackBuffer(&state, begin, static_cast<size_t>(split - begin),
+            callback, user_data, &matFileReader, warn, err);
+        file.discard(static_cast<size_t>(split - buf));
+        begin = split;
+    }
+
+    return true;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -4,7 +4,6 @@
 #include <Vkx/Camera.h>
 #include <Vkx/Image.h>
 #include <Vkx/Instance.h>
-#include <Vkx/SwapChain.h>
 #include <Vkx/Vkx.h>
 
 #define GLM_FORCE_RADIANS
@@ -12,8 +11,6 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
 #include <vulkan/vulkan.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -21,19 +18,47 @@
 #define TINYOBJLOADER_IMPLEMENTATION // define this in only *one* .cc
 #include "tiny_obj_loader.h"
 
+#include "BlockCompressor.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MipGenerator.h"
+#include "Parallel.h"
+#include "PipelineCache.h"
+#include "TextureCache.h"
+#include "VertexWelder.h"
+#include "VirtualTextures.h"
+
 #include <algorithm>
 #include <array>
+#include <cctype>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
-#include <unordered_map>
+#include <string>
+#include <thread>
 #include <vector>
 
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
 #ifdef NDEBUG
 static bool constexpr VALIDATION_LAYERS_REQUESTED = false;
 #else
@@ -77,43 +102,70 @@ struct Vertex
 
 private:
     static vk::VertexInputBindingDescription bindingDescription_;
-    static std::array<vk::VertexInputAttributeDescription, 3> attributeDescriptions_;
+    static std::array<vk::VertexInputAttributeDescription, 2> attributeDescriptions_;
 };
 
-namespace std
+// This is the layout of the vertices, basically initial offset and stride
+vk::VertexInputBindingDescription Vertex::bindingDescription_ =
 {
-template <> struct hash<Vertex>
+    0, sizeof(Vertex), vk::VertexInputRate::eVertex
+};
+
+// This describes the format, index, and positions of the vertex attributes, one entry for each attribute. The color
+// is not used by the shaders, so it is not passed to them.
+std::array<vk::VertexInputAttributeDescription, 2> Vertex::attributeDescriptions_ =
 {
-    size_t operator ()(Vertex const & vertex) const
     {
-        size_t h = 0;
-        glm::detail::hash_combine(h, hash<glm::vec3>()(vertex.pos));
-        glm::detail::hash_combine(h, hash<glm::vec3>()(vertex.color));
-        glm::detail::hash_combine(h, hash<glm::vec2>()(vertex.texCoord));
-        return h;
+        { 0, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) },
+        { 1, 0, vk::Format::eR32G32Sfloat, offsetof(Vertex, texCoord) }
     }
 };
-}
 
-// This is the layout of the vertices, basically initial offset and stride
-vk::VertexInputBindingDescription Vertex::bindingDescription_ =
+// This is the compact vertex format. The position is quantized to 16 bits within the bounds of the mesh and the
+// texture coordinates are quantized to 16 bits within their range. The vertex shader restores the original values
+// using the scale and offset in the uniform buffer. The fourth component of the position is padding.
+struct CompactVertex
 {
-    0, sizeof(Vertex), vk::VertexInputRate::eVertex
+    uint16_t pos[4];
+    uint16_t texCoord[2];
+
+    // Returns the create info for this vertex format (assumes one binding)
+    static vk::PipelineVertexInputStateCreateInfo vertexInputInfo()
+    {
+        return vk::PipelineVertexInputStateCreateInfo({},
+                                                      1,
+                                                      &bindingDescription_,
+                                                      (uint32_t)attributeDescriptions_.size(),
+                                                      attributeDescriptions_.data()
+        );
+    }
+
+private:
+    static vk::VertexInputBindingDescription bindingDescription_;
+    static std::array<vk::VertexInputAttributeDescription, 2> attributeDescriptions_;
 };
 
-// This describes the format, index, and positions of the vertex attributes, one entry for each attribute
-std::array<vk::VertexInputAttributeDescription, 3> Vertex::attributeDescriptions_ =
+vk::VertexInputBindingDescription CompactVertex::bindingDescription_ =
+{
+    0, sizeof(CompactVertex), vk::VertexInputRate::eVertex
+};
+
+// Three-component 16-bit formats are not widely supported for vertex buffers, so the position is read as four
+// components and the shader ignores the fourth.
+std::array<vk::VertexInputAttributeDescription, 2> CompactVertex::attributeDescriptions_ =
 {
     {
-        { 0, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) },
-        { 1, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, color) },
-        { 2, 0, vk::Format::eR32G32Sfloat, offsetof(Vertex, texCoord) }
+        { 0, 0, vk::Format::eR16G16B16A16Unorm, offsetof(CompactVertex, pos) },
+        { 1, 0, vk::Format::eR16G16Unorm, offsetof(CompactVertex, texCoord) }
     }
 };
 
 char constexpr MODEL_PATH[]   = "models/chalet.obj";
 char constexpr TEXTURE_PATH[] = "textures/chalet.jpg";
 
+// Largest number of frames the CPU may get ahead of the GPU
+unsigned constexpr MAX_FRAMES_IN_FLIGHT = 4;
+
 struct SwapChainSupportInfo
 {
     vk::SurfaceCapabilitiesKHR capabilities;
@@ -179,9 +231,13 @@ bool isSuitable(vk::PhysicalDevice const & physicalDevice, vk::SurfaceKHR const
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
+    // The fragment shader selects the texture of a draw range from an array of textures with a push constant.
     vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
 
-    return extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+    return extensionsSupported &&
+           swapChainAdequate &&
+           supportedFeatures.samplerAnisotropy &&
+           supportedFeatures.shaderSampledImageArrayDynamicIndexing;
 }
 
 vk::SampleCountFlagBits getMaxMsaa(vk::PhysicalDeviceProperties const & properties)
@@ -251,6 +307,18 @@ vk::Extent2D chooseSwapExtent(Glfwx::Window const & window, vk::SurfaceCapabilit
     }
 }
 
+bool isFormatSupported(vk::PhysicalDevice const & physicalDevice,
+                       vk::Format                 format,
+                       vk::ImageTiling            tiling,
+                       vk::FormatFeatureFlags     features)
+{
+    vk::FormatProperties props = physicalDevice.getFormatProperties(format);
+    if (tiling == vk::ImageTiling::eLinear)
+        return (props.linearTilingFeatures & features) == features;
+    else
+        return (props.optimalTilingFeatures & features) == features;
+}
+
 vk::Format findSupportedFormat(vk::PhysicalDevice const &      physicalDevice,
                                std::vector<vk::Format> const & candidates,
                                vk::ImageTiling                 tiling,
@@ -258,15 +326,24 @@ vk::Format findSupportedFormat(vk::PhysicalDevice const &      physicalDevice,
 {
     for (auto format : candidates)
     {
-        vk::FormatProperties props = physicalDevice.getFormatProperties(format);
-        if (tiling == vk::ImageTiling::eLinear && (props.linearTilingFeatures & features) == features)
-            return format;
-        else if (tiling == vk::ImageTiling::eOptimal && (props.optimalTilingFeatures & features) == features)
+        if (isFormatSupported(physicalDevice, format, tiling, features))
             return format;
     }
     throw std::runtime_error("findSupportedFormat: failed to find supported format");
 }
 
+// Returns the Vulkan format of a texture format
+vk::Format textureImageFormat(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::eBC1: return vk::Format::eBc1RgbaUnormBlock;
+    case TextureFormat::eBC3: return vk::Format::eBc3UnormBlock;
+    case TextureFormat::eBC7: return vk::Format::eBc7UnormBlock;
+    default:                  return vk::Format::eR8G8B8A8Unorm;
+    }
+}
+
 vk::Format findDepthFormat(vk::PhysicalDevice const & physicalDevice)
 {
     return findSupportedFormat(physicalDevice,
@@ -275,11 +352,88 @@ vk::Format findDepthFormat(vk::PhysicalDevice const & physicalDevice)
                                vk::FormatFeatureFlagBits::eDepthStencilAttachment);
 }
 
+// Returns the largest amount of memory the process has used so far, in bytes
+size_t peakMemoryUsage()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Asks the system to drop a file from the page cache, so that the next read of it comes from the disk. Returns false if
+// this is not supported.
+bool evictFromPageCache(char const * path)
+{
+#if defined(POSIX_FADV_DONTNEED)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return evicted;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+// Number of threads stb_image may use for the image being decoded on the calling thread
+thread_local unsigned decodeThreads = 1;
+
+// Runs stb_image's decoding tasks with parallelFor (see stbi_set_parallel_for)
+void parallelDecode(void *, int count, stbi_parallel_task * task, void * taskData)
+{
+    parallelFor((size_t)count, decodeThreads, [&] (size_t i) {
+        task(taskData, (int)i);
+    });
+}
+
+// Settings that can be changed from the command line
+struct Options
+{
+    std::string modelPath           = MODEL_PATH; // The OBJ file to load
+    unsigned    threads             = 0;     // Number of threads used for loading (0 means one per hardware thread)
+    bool        streamingLoad       = true;  // Weld the vertices while the model is read instead of after
+    bool        mmapPopulate        = false; // Read the whole model file in when it is mapped
+    bool        optimizeVertexFetch = true;  // Reorder the vertices by first use
+    bool        compactVertices     = false; // Use the quantized 12-byte vertex format instead of the 32-byte one
+    bool        clusterCulling      = true;  // Cull meshlets on the GPU and draw the rest indirectly
+    float       lodThreshold        = 1.0f;  // Largest screen-space error of a level of detail in pixels (0 disables)
+    bool        asyncLoad           = true;  // Load the model and textures while drawing frames
+    MipFilter   mipFilter           = MipFilter::eKaiser; // Filter used to build the textures' mip chains
+    bool        compressTextures    = true;  // Store the textures in BC formats the device supports
+    CompressionQuality compressionQuality = CompressionQuality::eNormal; // Endpoint search effort of the BC encoder
+    bool        virtualTextures     = false; // Stream the textures a page at a time into a cache of fixed size
+    std::string pipelineCachePath   = "vktutorial.pipelinecache"; // Where the compiled pipelines are kept between runs
+    unsigned    framesInFlight      = 2;     // Frames recorded ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT
+    unsigned    recordThreads       = 0;     // Threads recording the draws (0 means one per hardware thread, up to 8)
+    bool        benchmarkLoad       = false; // Time the model loaders and exit
+    std::string benchmarkDecodePath;         // Time stb_image on the images in this directory and exit, if not empty
+};
+
 class HelloTriangleApplication
 {
 public:
+    explicit HelloTriangleApplication(Options const & options)
+        : options_(options)
+    {
+    }
+
     void run()
     {
+        startTime_ = std::chrono::steady_clock::now();
         initializeWindow();
         initializeVulkan();
 
@@ -288,23 +442,19 @@ public:
 
         choosePhysicalDevice();
         createLogicalDevice();
+        createPipelineCache();
         createSwapChain();
+        createFrameContexts();
         createCommandPools();
         createColorResources();
         createDepthResources();
         createRenderPass();
-        createDescriptorSetLayout();
-        createGraphicsPipeline();
         createFramebuffers();
-        createTextureImage();
+        createPlaceholderTexture();
         createTextureSampler();
-        loadModel();
-        createVertexBuffer();
-        createIndexBuffer();
-        createUniformBuffers();
-        createDescriptorPool();
-        createDescriptorSets();
-        createCommandBuffers();
+
+        // The model is loaded and uploaded in the background. Until it is ready, the frames are only cleared.
+        modelLoad_ = std::async(std::launch::async, [this] { loadModelAssets(); });
 
         Vkx::Camera camera(glm::radians(90.0f),
                            0.1f,
@@ -314,22 +464,259 @@ public:
 
         while (!window_->processEvents())
         {
+            swapInAssets();
             drawFrame(camera);
         }
+
+        // The loaders use the device, so they must finish first.
+        if (modelLoad_.valid())
+            modelLoad_.wait();
+        if (textureLoad_.valid())
+            textureLoad_.wait();
         device_->waitIdle();
+        savePipelineCache();
     }
 
 private:
 
     static int constexpr WIDTH  = 1920;
     static int constexpr HEIGHT = 1440;
-    static int constexpr MAX_FRAMES_IN_FLIGHT = 2;
+    // Bytes of uniforms each frame can allocate from the uniform ring
+    static vk::DeviceSize constexpr UNIFORM_RING_FRAME_SIZE = 1 << 20;
+
+    // Number of frames the frame times and latencies are averaged over
+    static uint64_t constexpr FRAME_STATS_INTERVAL = 300;
+
+    // Mesh cache option bits
+    static uint32_t constexpr MESH_OPTION_NO_FETCH_OPTIMIZATION = 1 << 0;
+    static uint32_t constexpr MESH_OPTION_COMPACT_VERTICES      = 1 << 1;
+    static uint32_t constexpr MESH_OPTION_FAN_TRIANGULATION     = 1 << 2;
+
+    // Texture cache option bits
+    static uint32_t constexpr TEXTURE_OPTION_COMPRESS      = 1 << 0;
+    static uint32_t constexpr TEXTURE_OPTION_QUALITY_SHIFT = 1;    // CompressionQuality, 2 bits
+    static uint32_t constexpr TEXTURE_OPTION_VIRTUAL       = 1 << 3;
+    static uint32_t constexpr TEXTURE_OPTION_FORMATS_SHIFT = 8;    // supportedTextureFormats_
+
+    // Maximum number of draws the index buffer may be split into to use 16-bit indices
+    static size_t constexpr MAX_DRAW_RANGES = 64;
+
+    // Number of meshlets culled by each workgroup of the culling shader (must match cull.comp)
+    static uint32_t constexpr CULL_GROUP_SIZE = 64;
+
+    // Largest number of levels of detail, including the full mesh
+    static size_t constexpr LEVELS_OF_DETAIL = 6;
+
+    // Virtual textures are paged into a cache of 30x30 slots, 4080x4080 texels, which is 16 MiB in BC7.
+    static uint32_t constexpr PAGE_CACHE_SLOTS_PER_SIDE = 30;
+
+    // Largest number of pages copied to the page cache before a frame
+    static size_t constexpr MAX_PAGE_UPLOADS = 32;
+
+    // Number of threads reading the pages of virtual textures
+    static unsigned constexpr PAGE_THREADS = 2;
+
+    // Largest number of threads recording a frame's draws
+    static unsigned constexpr MAX_RECORD_THREADS = 8;
+
+    // Fewest draw commands worth recording on a thread of their own
+    static uint32_t constexpr DRAWS_PER_RECORD_THREAD = 256;
+
+    // A range of a level of detail's triangles that all use the same texture
+    struct Batch
+    {
+        size_t   firstIndex;
+        size_t   indexCount;
+        uint32_t texture;
+    };
+
+    // A version of the mesh's triangles, sorted into batches by texture, and the largest distance of any of them from
+    // the full mesh
+    struct LevelOfDetail
+    {
+        std::vector<uint32_t> indices;
+        std::vector<Batch>    batches;
+        float error;
+    };
+
+    // A texture and its complete mip chain
+    struct Texture
+    {
+        vk::UniqueImage        image;
+        vk::UniqueDeviceMemory memory;
+        vk::UniqueImageView    view;
+        vk::DeviceSize         size;   // Size of the image's memory
+    };
+
+    // A host-visible buffer that stays mapped for as long as it exists, so a texture's mip chain can be built in it and
+    // the pages a frame samples can be read back from it
+    struct MappedBuffer
+    {
+        vk::UniqueBuffer       buffer;
+        vk::UniqueDeviceMemory memory;  // Freeing the memory unmaps it
+        uint8_t *              data = nullptr;
+    };
+
+    // A persistently mapped, host-coherent buffer that every frame's uniforms are allocated from. The buffer is divided
+    // among the frame contexts, and a frame allocates from its context's part with a bump allocator, which is reset
+    // when the context is reused. The uniforms are bound through dynamic uniform buffer descriptors, so a single
+    // descriptor set serves every frame and every allocation, and writing them needs no mapping or copying.
+    class UniformRing
+    {
+    public:
+        UniformRing() = default;
+
+        // The buffer has `frameSize` bytes for each frame context. Allocations are aligned to `alignment`, which is
+        // minUniformBufferOffsetAlignment and divides frameSize.
+        UniformRing(MappedBuffer buffer, vk::DeviceSize frameSize, vk::DeviceSize alignment)
+            : buffer_(std::move(buffer))
+            , frameSize_(frameSize)
+            , alignment_(alignment)
+        {
+        }
+
+        // Starts allocating from the part of frame context f. The frame that last used the context must be done.
+        void begin(size_t f)
+        {
+            next_ = f * frameSize_;
+            end_  = next_ + frameSize_;
+        }
+
+        // Returns where to write `size` bytes of uniforms, and sets `offset` to the dynamic offset to bind them with
+        void * allocate(vk::DeviceSize size, uint32_t & offset)
+        {
+            vk::DeviceSize start = (next_ + alignment_ - 1) & ~(alignment_ - 1);
+            if (start + size > end_)
+            {
+                throw std::runtime_error("UniformRing::allocate: a frame's uniforms do not fit in " +
+                                         std::to_string(frameSize_) + " bytes");
+            }
+            next_  = start + size;
+            offset = (uint32_t)start;
+            return buffer_.data + start;
+        }
+
+        vk::Buffer buffer() const { return *buffer_.buffer; }
+
+    private:
+        MappedBuffer   buffer_;
+        vk::DeviceSize frameSize_ = 0;
+        vk::DeviceSize alignment_ = 1;
+        vk::DeviceSize next_      = 0;
+        vk::DeviceSize end_       = 0;
+    };
+
+    // The pages and page table entries copied to the page cache before a frame. The copies are recorded in the frame's
+    // command buffer, so they are done when the frame's context is reused.
+    struct PageUpload
+    {
+        MappedBuffer                     staging;   // The pages, then the page table
+        std::vector<vk::BufferImageCopy> pages;
+        vk::BufferCopy                   entries;   // Empty if no entries changed
+    };
+
+    // A swap chain and views of its images
+    class SwapChain
+    {
+    public:
+        SwapChain(vk::Device device, vk::SwapchainCreateInfoKHR const & info)
+            : swapChain_(device.createSwapchainKHRUnique(info))
+            , format_(info.imageFormat)
+            , extent_(info.imageExtent)
+        {
+            vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+            for (vk::Image image : device.getSwapchainImagesKHR(*swapChain_))
+            {
+                views_.push_back(device.createImageViewUnique(
+                    vk::ImageViewCreateInfo({}, image, vk::ImageViewType::e2D, format_, vk::ComponentMapping(), range)));
+            }
+        }
+
+        vk::SwapchainKHR handle() const { return *swapChain_; }
+        vk::Format       format() const { return format_; }
+        vk::Extent2D     extent() const { return extent_; }
+        size_t           size() const { return views_.size(); }
+        vk::ImageView    view(size_t i) const { return *views_[i]; }
+
+    private:
+        vk::UniqueSwapchainKHR           swapChain_;
+        vk::Format                       format_;
+        vk::Extent2D                     extent_;
+        std::vector<vk::UniqueImageView> views_;
+    };
+
+    // A command pool and a secondary command buffer for one of the threads recording a frame's draws. A command pool
+    // must only be used by one thread at a time, so each thread has its own.
+    struct DrawRecorder
+    {
+        vk::UniqueCommandPool   commandPool;    // Reset by its thread when the context is reused
+        vk::UniqueCommandBuffer commands;
+    };
+
+    // What a frame needs until the GPU is done with it. The contexts are used in turn, so the number of frames in
+    // flight does not depend on the number of swap chain images. Context f also owns part f of the uniform ring, the
+    // indirect buffer and the feedback buffer, and element f of pageUploads_.
+    struct FrameContext
+    {
+        vk::UniqueSemaphore     imageAvailable;
+        vk::UniqueSemaphore     renderFinished;
+        vk::UniqueFence         inFlight;
+        vk::UniqueCommandPool   commandPool;    // Reset when the context is reused
+        vk::UniqueCommandBuffer commands;       // Recorded again for every frame
+        std::vector<DrawRecorder> recorders;    // One per member of recordTeam_
+        std::chrono::steady_clock::time_point started;  // When the CPU started the last frame using the context
+        bool                    pending = false;        // The last frame is not known to be done
+    };
+
+    // A swap chain that has been replaced, and everything that refers to its images. They are destroyed once the
+    // frames drawn to them are done.
+    struct RetiredSwapChain
+    {
+        std::shared_ptr<SwapChain>           swapChain;
+        std::vector<vk::UniqueFramebuffer>   framebuffers;
+        Vkx::ResolveImage                    resolveImage;
+        Vkx::DepthImage                      depthImage;
+        uint64_t                             retiredAt;     // frameNumber_ when it was replaced
+    };
+
+    // The frame times and latencies accumulated since they were last reported
+    struct FrameStats
+    {
+        std::chrono::steady_clock::time_point lastStarted;
+        uint64_t frameCount   = 0;
+        double   frameTimeSum = 0.0;    // Milliseconds between the starts of successive frames
+        uint64_t latencyCount = 0;
+        double   latencySum   = 0.0;    // Milliseconds from the start of a frame until it was seen to be done
+        double   latencyMax   = 0.0;
+        uint64_t recordCount     = 0;   // Frames whose draws were recorded
+        double   recordTimeSum   = 0.0; // Milliseconds spent recording the draws in secondary command buffers
+        uint64_t drawSum         = 0;   // Draw commands recorded
+        uint64_t recordThreadSum = 0;   // Threads the draws were recorded on
+    };
+
+    // The texture of the draw ranges that follow, pushed to the fragment shader
+    struct MaterialPushConstants
+    {
+        uint32_t texture;
+    };
+
+    // The range of meshlets culled by a dispatch of the culling shader
+    struct CullPushConstants
+    {
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+    };
 
     struct UniformBufferObject
     {
         alignas(16) glm::mat4 model;
         alignas(16) glm::mat4 view;
         alignas(16) glm::mat4 projection;
+        alignas(16) glm::vec4 positionScale;        // Vertex position = input * scale + offset
+        alignas(16) glm::vec4 positionOffset;
+        alignas(16) glm::vec4 texCoordScaleOffset;  // Texture coordinates = input * xy + zw
+        alignas(16) glm::vec4 frustumPlanes[6];     // Model space, normalized, facing inwards
+        alignas(16) glm::vec4 cameraPosition;       // Model space. w is 1 if front faces are counter-clockwise, or -1.
     };
 
     void initializeWindow()
@@ -481,8 +868,39 @@ private:
         if (graphicsFamily_ != presentFamily_)
             queueCreateInfos.emplace_back(vk::DeviceQueueCreateFlags(), presentFamily_, 1, &priority);
 
+        // Without multiDrawIndirect, the meshlets must be drawn with one indirect draw each.
+        multiDrawIndirect_ = physicalDevice_->getFeatures().multiDrawIndirect == VK_TRUE;
+
+        // The compressed texture formats that can be sampled. Without them, the textures are uncompressed.
+        bool textureCompressionBC = physicalDevice_->getFeatures().textureCompressionBC == VK_TRUE;
+        supportedTextureFormats_  = 1u << (uint32_t)TextureFormat::eRGBA8;
+        for (TextureFormat format : { TextureFormat::eBC1, TextureFormat::eBC3, TextureFormat::eBC7 })
+        {
+            if (textureCompressionBC &&
+                isFormatSupported(*physicalDevice_,
+                                  textureImageFormat(format),
+                                  vk::ImageTiling::eOptimal,
+                                  vk::FormatFeatureFlagBits::eSampledImage |
+                                  vk::FormatFeatureFlagBits::eSampledImageFilterLinear))
+            {
+                supportedTextureFormats_ |= 1u << (uint32_t)format;
+            }
+        }
+
+        // Virtual textures report the pages they sample from the fragment shader.
+        if (options_.virtualTextures && !physicalDevice_->getFeatures().fragmentStoresAndAtomics)
+        {
+            std::cerr << "createLogicalDevice: warning: the device cannot store from fragment shaders, so virtual "
+                      << "textures are disabled" << std::endl;
+            options_.virtualTextures = false;
+        }
+
         vk::PhysicalDeviceFeatures deviceFeatures;
         deviceFeatures.setSamplerAnisotropy(VK_TRUE);
+        deviceFeatures.setShaderSampledImageArrayDynamicIndexing(VK_TRUE);
+        deviceFeatures.setMultiDrawIndirect(multiDrawIndirect_ ? VK_TRUE : VK_FALSE);
+        deviceFeatures.setTextureCompressionBC(textureCompressionBC ? VK_TRUE : VK_FALSE);
+        deviceFeatures.setFragmentStoresAndAtomics(options_.virtualTextures ? VK_TRUE : VK_FALSE);
 
         vk::DeviceCreateInfo createInfo({},
                                         (uint32_t)queueCreateInfos.size(),
@@ -503,7 +921,9 @@ private:
         presentQueue_  = device_->getQueue(presentFamily_, 0);
     }
 
-    void createSwapChain()
+    // Creates the swap chain. If there is an old one, the new one takes over from it, and the old one keeps
+    // presenting the images already queued to it in the meantime.
+    void createSwapChain(vk::SwapchainKHR oldSwapChain = vk::SwapchainKHR())
     {
         std::shared_ptr<Vkx::PhysicalDevice> physicalDevice = device_->physical();
         vk::SurfaceKHR       surface          = physicalDevice->surface();
@@ -513,15 +933,66 @@ private:
         vk::PresentModeKHR   presentMode   = chooseSwapPresentMode(swapChainSupport.presentModes);
         vk::Extent2D         extent        = chooseSwapExtent(*window_, swapChainSupport.capabilities);
 
-        swapChain_ = std::make_shared<Vkx::SwapChain>(device_,
-                                                      surfaceFormat,
-                                                      extent,
-                                                      graphicsFamily_,
-                                                      presentFamily_,
-                                                      presentMode);
+        vk::SurfaceCapabilitiesKHR const & capabilities = swapChainSupport.capabilities;
+        uint32_t imageCount = capabilities.minImageCount + 1;
+        if (capabilities.maxImageCount > 0)
+            imageCount = std::min(imageCount, capabilities.maxImageCount);
+
+        std::array<uint32_t, 2>    families = { graphicsFamily_, presentFamily_ };
+        vk::SwapchainCreateInfoKHR createInfo({},
+                                              surface,
+                                              imageCount,
+                                              surfaceFormat.format,
+                                              surfaceFormat.colorSpace,
+                                              extent,
+                                              1,
+                                              vk::ImageUsageFlagBits::eColorAttachment,
+                                              vk::SharingMode::eExclusive,
+                                              0,
+                                              nullptr,
+                                              capabilities.currentTransform,
+                                              vk::CompositeAlphaFlagBitsKHR::eOpaque,
+                                              presentMode,
+                                              VK_TRUE,
+                                              oldSwapChain);
+        if (graphicsFamily_ != presentFamily_)
+        {
+            createInfo.setImageSharingMode(vk::SharingMode::eConcurrent);
+            createInfo.setQueueFamilyIndexCount((uint32_t)families.size());
+            createInfo.setPQueueFamilyIndices(families.data());
+        }
+
+        swapChain_ = std::make_shared<SwapChain>(*device_, createInfo);
         framebufferSizeChanged_ = false;
     }
 
+    // Creates a context for each frame that may be in flight. The fences start signaled, because there is nothing to
+    // wait for before the first frames.
+    void createFrameContexts()
+    {
+        unsigned recordThreads = std::min(threadCount(options_.recordThreads), MAX_RECORD_THREADS);
+        recordTeam_ = std::make_unique<ThreadTeam>(recordThreads);
+        frames_.resize(options_.framesInFlight);
+        for (FrameContext & frame : frames_)
+        {
+            frame.imageAvailable = device_->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+            frame.renderFinished = device_->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+            frame.inFlight       = device_->createFenceUnique(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+            frame.commandPool    = device_->createCommandPoolUnique(
+                vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, graphicsFamily_));
+            frame.commands = std::move(device_->allocateCommandBuffersUnique(
+                vk::CommandBufferAllocateInfo(*frame.commandPool, vk::CommandBufferLevel::ePrimary, 1))[0]);
+            frame.recorders.resize(recordThreads);
+            for (DrawRecorder & recorder : frame.recorders)
+            {
+                recorder.commandPool = device_->createCommandPoolUnique(
+                    vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, graphicsFamily_));
+                recorder.commands = std::move(device_->allocateCommandBuffersUnique(
+                    vk::CommandBufferAllocateInfo(*recorder.commandPool, vk::CommandBufferLevel::eSecondary, 1))[0]);
+            }
+        }
+    }
+
     void createRenderPass()
     {
         vk::AttachmentDescription colorAttachment({},
@@ -586,39 +1057,123 @@ private:
 
     void createDescriptorSetLayout()
     {
-        vk::DescriptorSetLayoutBinding bindings[] =
+        // The uniforms and the feedback buffer are at a different offset in each frame.
+        std::vector<vk::DescriptorSetLayoutBinding> bindings =
+        {
+            vk::DescriptorSetLayoutBinding(0,
+                                           vk::DescriptorType::eUniformBufferDynamic,
+                                           1,
+                                           vk::ShaderStageFlagBits::eVertex)
+        };
+
+        if (virtualTexturesReady_)
+        {
+            // The virtual textures are sampled from the page cache through the page table, and the pages that are
+            // sampled are written to the feedback buffer.
+            bindings.emplace_back(1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment);
+            bindings.emplace_back(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment);
+            bindings.emplace_back(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment);
+            bindings.emplace_back(4, vk::DescriptorType::eStorageBufferDynamic, 1, vk::ShaderStageFlagBits::eFragment);
+        }
+        else
+        {
+            // Every texture of the model is bound at once, in an array indexed by the draw range's texture.
+            vk::PhysicalDeviceLimits limits = physicalDevice_->getProperties().limits;
+            uint32_t textureCount = (uint32_t)textureViews_.size();
+            uint32_t maxTextures  = std::min({ limits.maxPerStageDescriptorSamplers,
+                                               limits.maxPerStageDescriptorSampledImages,
+                                               limits.maxDescriptorSetSamplers,
+                                               limits.maxDescriptorSetSampledImages });
+            if (textureCount > maxTextures)
+            {
+                throw std::runtime_error("createDescriptorSetLayout: the model has " + std::to_string(textureCount) +
+                                         " textures, but the device can only bind " + std::to_string(maxTextures));
+            }
+            bindings.emplace_back(1,
+                                  vk::DescriptorType::eCombinedImageSampler,
+                                  textureCount,
+                                  vk::ShaderStageFlagBits::eFragment);
+        }
+
+        descriptorSetLayout_ = device_->createDescriptorSetLayoutUnique(
+            vk::DescriptorSetLayoutCreateInfo({}, (uint32_t)bindings.size(), bindings.data()));
+
+        // The uniforms and the indirect draw commands are at a different offset in each frame.
+        vk::DescriptorSetLayoutBinding cullBindings[] =
         {
             vk::DescriptorSetLayoutBinding(0,
-                                           vk::DescriptorType::eUniformBuffer,
+                                           vk::DescriptorType::eUniformBufferDynamic,
                                            1,
-                                           vk::ShaderStageFlagBits::eVertex),
+                                           vk::ShaderStageFlagBits::eCompute),
             vk::DescriptorSetLayoutBinding(1,
-                                           vk::DescriptorType::eCombinedImageSampler,
+                                           vk::DescriptorType::eStorageBuffer,
                                            1,
-                                           vk::ShaderStageFlagBits::eFragment)
+                                           vk::ShaderStageFlagBits::eCompute),
+            vk::DescriptorSetLayoutBinding(2,
+                                           vk::DescriptorType::eStorageBufferDynamic,
+                                           1,
+                                           vk::ShaderStageFlagBits::eCompute)
         };
 
-        descriptorSetLayout_ = device_->createDescriptorSetLayoutUnique(
-            vk::DescriptorSetLayoutCreateInfo({}, 2, bindings));
+        cullDescriptorSetLayout_ = device_->createDescriptorSetLayoutUnique(
+            vk::DescriptorSetLayoutCreateInfo({}, 3, cullBindings));
+    }
+
+    // Creates the compute pipeline that culls the meshlets and writes the indirect draw commands
+    void createCullPipeline()
+    {
+        vk::UniqueShaderModule cullShaderModule(Vkx::loadShaderModule("shaders/cull.comp.spv", device_), *device_);
+
+        vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants));
+        cullPipelineLayout_ = device_->createPipelineLayoutUnique(
+            vk::PipelineLayoutCreateInfo({}, 1, &cullDescriptorSetLayout_.get(), 1, &pushConstantRange));
+
+        auto   start     = std::chrono::steady_clock::now();
+        size_t cacheSize = pipelineCacheSize();
+        cullPipeline_ = device_->createComputePipelineUnique(
+            *pipelineCache_,
+            vk::ComputePipelineCreateInfo({},
+                                          vk::PipelineShaderStageCreateInfo({},
+                                                                            vk::ShaderStageFlagBits::eCompute,
+                                                                            *cullShaderModule,
+                                                                            "main"),
+                                          *cullPipelineLayout_));
+        reportPipelineTime("createCullPipeline", start, cacheSize);
     }
 
     void createGraphicsPipeline()
     {
         vk::UniqueShaderModule vertShaderModule(Vkx::loadShaderModule("shaders/shader.vert.spv", device_), *device_);
-        vk::UniqueShaderModule fragShaderModule(Vkx::loadShaderModule("shaders/shader.frag.spv", device_), *device_);
+        char const * fragShaderPath = virtualTexturesReady_ ? "shaders/virtual.frag.spv" : "shaders/shader.frag.spv";
+        vk::UniqueShaderModule fragShaderModule(Vkx::loadShaderModule(fragShaderPath, device_), *device_);
+
+        // The size of the fragment shader's texture array, or the size of the page cache in slots, is a specialization
+        // constant.
+        uint32_t                   fragConstant = virtualTexturesReady_ ? PAGE_CACHE_SLOTS_PER_SIDE
+                                                                        : (uint32_t)textureViews_.size();
+        vk::SpecializationMapEntry fragConstantEntry(0, 0, sizeof(fragConstant));
+        vk::SpecializationInfo     fragSpecialization(1, &fragConstantEntry, sizeof(fragConstant), &fragConstant);
 
         vk::PipelineShaderStageCreateInfo shaderStages[] =
         {
             vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, *vertShaderModule, "main"),
-            vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, *fragShaderModule, "main")
+            vk::PipelineShaderStageCreateInfo({},
+                                              vk::ShaderStageFlagBits::eFragment,
+                                              *fragShaderModule,
+                                              "main",
+                                              &fragSpecialization)
         };
 
-        vk::PipelineVertexInputStateCreateInfo   vertexInputInfo = Vertex::vertexInputInfo();
+        vk::PipelineVertexInputStateCreateInfo   vertexInputInfo = options_.compactVertices
+                                                                   ? CompactVertex::vertexInputInfo()
+                                                                   : Vertex::vertexInputInfo();
         vk::PipelineInputAssemblyStateCreateInfo inputAssembly({}, vk::PrimitiveTopology::eTriangleList, VK_FALSE);
 
-        vk::Viewport viewport(0.0f, 0.0f, (float)swapChain_->extent().width, (float)swapChain_->extent().height, 0.0f, 1.0f);
-        vk::Rect2D   scissor({ 0, 0 }, swapChain_->extent());
-        vk::PipelineViewportStateCreateInfo viewportState({}, 1, &viewport, 1, &scissor);
+        // The viewport and the scissor are set when the command buffers are recorded, so the pipeline does not depend
+        // on the size of the swap chain.
+        vk::PipelineViewportStateCreateInfo viewportState({}, 1, nullptr, 1, nullptr);
+        std::array<vk::DynamicState, 2>     dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+        vk::PipelineDynamicStateCreateInfo  dynamicState({}, (uint32_t)dynamicStates.size(), dynamicStates.data());
 
         vk::PipelineRasterizationStateCreateInfo rasterizer;
         rasterizer.setCullMode(vk::CullModeFlagBits::eBack);
@@ -634,7 +1189,9 @@ private:
         colorBlending.setPAttachments(&colorBlendAttachment);
         colorBlending.setAttachmentCount(1);
 
-        pipelineLayout_ = device_->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo({}, 1, &descriptorSetLayout_.get()));
+        vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eFragment, 0, sizeof(MaterialPushConstants));
+        pipelineLayout_ = device_->createPipelineLayoutUnique(
+            vk::PipelineLayoutCreateInfo({}, 1, &descriptorSetLayout_.get(), 1, &pushConstantRange));
 
         vk::PipelineDepthStencilStateCreateInfo depthStencil({},
                                                              VK_TRUE,
@@ -642,8 +1199,10 @@ private:
                                                              vk::CompareOp::eLess,
                                                              VK_FALSE,
                                                              VK_FALSE);
+        auto   start     = std::chrono::steady_clock::now();
+        size_t cacheSize = pipelineCacheSize();
         graphicsPipeline_ = device_->createGraphicsPipelineUnique(
-            vk::PipelineCache(),
+            *pipelineCache_,
             vk::GraphicsPipelineCreateInfo({},
                                            2,
                                            shaderStages,
@@ -655,15 +1214,69 @@ private:
                                            &multisampling,
                                            &depthStencil,
                                            &colorBlending,
-                                           nullptr,
+                                           &dynamicState,
                                            *pipelineLayout_,
                                            *renderPass_,
                                            0));
+        reportPipelineTime("createGraphicsPipeline", start, cacheSize);
+    }
+
+    // Creates the pipeline cache that every pipeline is created with, starting from the data saved by the last run if
+    // it was saved by the same driver on the same device
+    void createPipelineCache()
+    {
+        vk::PhysicalDeviceProperties properties = physicalDevice_->getProperties();
+        PipelineCache::Device        device;
+        device.vendorId = properties.vendorID;
+        device.deviceId = properties.deviceID;
+        memcpy(device.uuid, properties.pipelineCacheUUID, sizeof(device.uuid));
+
+        std::vector<char> data = PipelineCache::load(options_.pipelineCachePath.c_str(), device);
+        if (data.empty())
+        {
+            std::cout << "createPipelineCache: no usable pipeline cache in " << options_.pipelineCachePath
+                      << ", the pipelines are compiled from scratch" << std::endl;
+        }
+        else
+        {
+            std::cout << "createPipelineCache: loaded " << data.size() << " bytes from " << options_.pipelineCachePath
+                      << std::endl;
+        }
+
+        pipelineCache_ = device_->createPipelineCacheUnique(vk::PipelineCacheCreateInfo({}, data.size(), data.data()));
+    }
+
+    // Writes the pipeline cache's data to where createPipelineCache will look for it in the next run
+    void savePipelineCache()
+    {
+        std::vector<uint8_t> data = device_->getPipelineCacheData(*pipelineCache_);
+        if (!PipelineCache::save(options_.pipelineCachePath.c_str(), data.data(), data.size()))
+        {
+            std::cerr << "savePipelineCache: warning: the pipeline cache could not be written to "
+                      << options_.pipelineCachePath << std::endl;
+        }
+    }
+
+    // Returns the size of the pipeline cache's data, which is little more than its header until pipelines are added
+    size_t pipelineCacheSize() const
+    {
+        size_t size = 0;
+        vkGetPipelineCacheData(*device_, *pipelineCache_, &size, nullptr);
+        return size;
+    }
+
+    // Prints how long a pipeline took to create and how much was in the pipeline cache before, which shows whether it
+    // was compiled from scratch or found in the cache
+    static void reportPipelineTime(char const * function, std::chrono::steady_clock::time_point start, size_t cacheSize)
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << function << ": created the pipeline in "
+                  << std::chrono::duration<double, std::milli>(elapsed).count() << " ms, with " << cacheSize
+                  << " bytes in the pipeline cache" << std::endl;
     }
 
     void createCommandPools()
     {
-        graphicsCommandPool_  = device_->createCommandPoolUnique(vk::CommandPoolCreateInfo({}, graphicsFamily_));
         transientCommandPool_ = device_->createCommandPoolUnique(
             vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient,
                                       graphicsFamily_));
@@ -722,70 +1335,874 @@ private:
         }
     }
 
-    void createTextureImage()
+    // Creates the 1x1 grey texture that is drawn in place of each texture until it is loaded
+    void createPlaceholderTexture()
     {
-        int       width, height, channels;
-        stbi_uc * pixels = stbi_load(TEXTURE_PATH, &width, &height, &channels, STBI_rgb_alpha);
-        if (!pixels)
-            throw std::runtime_error("createTextureImage: failed to load texture image!");
-        VkDeviceSize imageSize = width * height * 4;
-        uint32_t     mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
-        textureImage_ = Vkx::LocalImage(device_,
-                                        transientCommandPool_.get(),
-                                        graphicsQueue_,
-                                        vk::ImageCreateInfo({},
-                                                            vk::ImageType::e2D,
-                                                            vk::Format::eR8G8B8A8Unorm,
-                                                            { (uint32_t)width, (uint32_t)height, 1 },
-                                                            mipLevels,
-                                                            1,
-                                                            vk::SampleCountFlagBits::e1,
-                                                            vk::ImageTiling::eOptimal,
-                                                            vk::ImageUsageFlagBits::eTransferSrc |
-                                                            vk::ImageUsageFlagBits::eTransferDst |
-                                                            vk::ImageUsageFlagBits::eSampled),
-                                        pixels,
-                                        imageSize);
-        stbi_image_free(pixels);
+        uint8_t texel[4] = { 0x80, 0x80, 0x80, 0xff };
+        placeholderImage_ = Vkx::LocalImage(device_,
+                                            transientCommandPool_.get(),
+                                            graphicsQueue_,
+                                            vk::ImageCreateInfo({},
+                                                                vk::ImageType::e2D,
+                                                                vk::Format::eR8G8B8A8Unorm,
+                                                                { 1, 1, 1 },
+                                                                1,
+                                                                1,
+                                                                vk::SampleCountFlagBits::e1,
+                                                                vk::ImageTiling::eOptimal,
+                                                                vk::ImageUsageFlagBits::eTransferSrc |
+                                                                vk::ImageUsageFlagBits::eTransferDst |
+                                                                vk::ImageUsageFlagBits::eSampled),
+                                            texel,
+                                            sizeof(texel));
     }
 
-    void createTextureSampler()
+    // Loads the model's textures on worker threads, decoding them in parallel. A texture that fails to load is
+    // replaced by the default texture, which must load. The views are put in loadedTextureViews_ to be swapped in.
+    void loadTextures()
     {
-        textureSampler_ = device_->createSamplerUnique(
+        if (options_.virtualTextures)
+        {
+            loadVirtualTextures();
+            return;
+        }
+
+        unsigned threads    = threadCount(options_.threads);
+        unsigned mipThreads = mipThreadsPerTexture(threads);
+
+        std::vector<Texture> textures(texturePaths_.size());
+        std::vector<char>    loaded(texturePaths_.size(), false);
+        parallelFor(texturePaths_.size(), threads, [&] (size_t t) {
+            loaded[t] = loadTexture(texturePaths_[t].c_str(), mipThreads, textures[t]);
+        });
+        if (!loaded[0])
+            throw std::runtime_error("loadTextures: failed to load " + texturePaths_[0]);
+
+        for (size_t t = 0; t < textures.size(); ++t)
+        {
+            if (loaded[t])
+            {
+                loadedTextureViews_.push_back(*textures[t].view);
+                textureImages_.push_back(std::move(textures[t]));
+            }
+            else
+            {
+                std::cerr << "loadTextures: warning: failed to load " << texturePaths_[t] << std::endl;
+                loadedTextureViews_.push_back(loadedTextureViews_.front());
+            }
+        }
+
+        vk::DeviceSize size = 0;
+        for (auto const & texture : textureImages_)
+        {
+            size += texture.size;
+        }
+        std::cout << "loadTextures: " << textureImages_.size() << " texture(s), " << (size + 512 * 1024) / (1024 * 1024)
+                  << " MiB" << std::endl;
+    }
+
+    // Returns the threads each texture's mip chain is built with when `threads` threads load the textures. The threads
+    // are divided between the textures and the rows of each texture's mip chain.
+    unsigned mipThreadsPerTexture(unsigned threads) const
+    {
+        size_t loading = std::max<size_t>(1, std::min<size_t>(texturePaths_.size(), threads));
+        return std::max(1u, threads / (unsigned)loading);
+    }
+
+    // Opens the caches of the model's textures to be paged, first building the ones that are missing or out of date as
+    // if the textures were loaded whole, and puts the coarsest page of each texture in the page cache. Only the page
+    // cache and the page table are on the GPU. A texture that fails to load is replaced by the default texture, which
+    // must load.
+    void loadVirtualTextures()
+    {
+        unsigned threads    = threadCount(options_.threads);
+        unsigned mipThreads = mipThreadsPerTexture(threads);
+
+        std::vector<TextureCache::Key> keys(texturePaths_.size());
+        std::vector<char>              loaded(texturePaths_.size(), false);
+        parallelFor(texturePaths_.size(), threads, [&] (size_t t) {
+            char const * path = texturePaths_[t].c_str();
+            if (!TextureCache::keyFor(path, options_.mipFilter, textureOptions(), keys[t]))
+                return;
+            TextureCache cache;
+            if (cache.open(TextureCache::pathFor(path).c_str(), keys[t]))
+            {
+                loaded[t] = true;
+                return;
+            }
+
+            // Only the cache that is written is used, so the staged chain is dropped.
+            TextureFormat         format;
+            std::vector<MipLevel> levels;
+            MappedBuffer          staging;
+            loaded[t] = stageTexture(path, mipThreads, format, levels, staging);
+        });
+
+        auto pager = std::make_unique<VirtualTextures>(chooseTextureFormat(false),
+                                                       PAGE_CACHE_SLOTS_PER_SIDE * PAGE_CACHE_SLOTS_PER_SIDE,
+                                                       PAGE_THREADS);
+        std::vector<VirtualTextures::Texture> textures;
+        for (size_t t = 0; t < texturePaths_.size(); ++t)
+        {
+            std::string cachePath = TextureCache::pathFor(texturePaths_[t].c_str());
+            if (loaded[t] && pager->add(cachePath.c_str(), keys[t]))
+            {
+                textures.push_back(pager->textures().back());
+            }
+            else if (t == 0)
+            {
+                throw std::runtime_error("loadVirtualTextures: failed to load " + texturePaths_[0]);
+            }
+            else
+            {
+                std::cerr << "loadVirtualTextures: warning: failed to load " << texturePaths_[t] << std::endl;
+                textures.push_back(textures.front());
+            }
+        }
+
+        std::vector<VirtualTextures::Page> pages = pager->start();
+        std::vector<uint32_t> const &      table = pager->pageTable();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            virtualTextureBuffer_ = Vkx::LocalBuffer(device_,
+                                                     transientCommandPool_.get(),
+                                                     graphicsQueue_,
+                                                     textures.size() * sizeof(VirtualTextures::Texture),
+                                                     vk::BufferUsageFlagBits::eStorageBuffer,
+                                                     textures.data());
+            pageTableBuffer_      = Vkx::LocalBuffer(device_,
+                                                     transientCommandPool_.get(),
+                                                     graphicsQueue_,
+                                                     table.size() * sizeof(uint32_t),
+                                                     vk::BufferUsageFlagBits::eStorageBuffer |
+                                                     vk::BufferUsageFlagBits::eTransferDst,
+                                                     table.data());
+        }
+        virtualTextures_ = std::move(pager);
+        createPageCache(pages);
+
+        std::cout << "loadVirtualTextures: " << virtualTextures_->textures().size() << " texture(s), "
+                  << table.size() << " pages, " << (pageCache_.size + 512 * 1024) / (1024 * 1024)
+                  << " MiB page cache" << std::endl;
+    }
+
+    // Creates the page cache and copies the coarsest page of each virtual texture to it
+    void createPageCache(std::vector<VirtualTextures::Page> const & pages)
+    {
+        uint32_t side = PAGE_CACHE_SLOTS_PER_SIDE * VirtualTextures::SLOT_SIZE;
+        createTextureImage(virtualTextures_->format(), side, side, 1, pageCache_);
+
+        // The pages are sampled with bilinear filtering, and the levels are blended by the shader.
+        pageCacheSampler_ = device_->createSamplerUnique(
             vk::SamplerCreateInfo({},
                                   vk::Filter::eLinear,
                                   vk::Filter::eLinear,
-                                  vk::SamplerMipmapMode::eLinear,
-                                  vk::SamplerAddressMode::eRepeat,
-                                  vk::SamplerAddressMode::eRepeat,
-                                  vk::SamplerAddressMode::eRepeat,
+                                  vk::SamplerMipmapMode::eNearest,
+                                  vk::SamplerAddressMode::eClampToEdge,
+                                  vk::SamplerAddressMode::eClampToEdge,
+                                  vk::SamplerAddressMode::eClampToEdge,
                                   0.0f,
-                                  VK_TRUE,
-                                  16,
+                                  VK_FALSE,
+                                  1,
                                   VK_FALSE,
                                   vk::CompareOp::eAlways,
                                   0.0f,
-                                  (float)textureImage_.info().mipLevels,
+                                  0.0f,
                                   vk::BorderColor::eIntOpaqueBlack,
                                   VK_FALSE));
+
+        PageUpload upload;
+        upload.staging = createMappedBuffer(pages.size() * pageSlotBytes());
+        stagePages(pages, upload);
+
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        vk::UniqueCommandBuffer commands = std::move(device_->allocateCommandBuffersUnique(
+            vk::CommandBufferAllocateInfo(*transientCommandPool_, vk::CommandBufferLevel::ePrimary, 1))[0]);
+        commands->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        recordPageUploads(*commands, upload, vk::ImageLayout::eUndefined);
+        commands->end();
+        vk::UniqueFence fence = device_->createFenceUnique(vk::FenceCreateInfo());
+        graphicsQueue_.submit(vk::SubmitInfo(0, nullptr, nullptr, 1, &commands.get()), *fence);
+        device_->waitForFences(*fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
     }
 
-    void loadModel()
+    // Copies pages to the start of a staging buffer and sets up their copies to their slots
+    void stagePages(std::vector<VirtualTextures::Page> const & pages, PageUpload & upload)
     {
-        tinyobj::attrib_t attrib;
+        size_t slotBytes = pageSlotBytes();
+        upload.pages.clear();
+        for (size_t p = 0; p < pages.size(); ++p)
+        {
+            memcpy(upload.staging.data + p * slotBytes, pages[p].texels.data(), slotBytes);
+            int32_t x = (int32_t)((pages[p].slot % PAGE_CACHE_SLOTS_PER_SIDE) * VirtualTextures::SLOT_SIZE);
+            int32_t y = (int32_t)((pages[p].slot / PAGE_CACHE_SLOTS_PER_SIDE) * VirtualTextures::SLOT_SIZE);
+            upload.pages.emplace_back(p * slotBytes,
+                                      0,
+                                      0,
+                                      vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+                                      vk::Offset3D(x, y, 0),
+                                      vk::Extent3D(VirtualTextures::SLOT_SIZE, VirtualTextures::SLOT_SIZE, 1));
+        }
+    }
+
+    // Returns the size of a page with its border
+    size_t pageSlotBytes() const
+    {
+        return textureSize(virtualTextures_->format(), VirtualTextures::SLOT_SIZE, VirtualTextures::SLOT_SIZE);
+    }
+
+    // Records the copies of staged pages and page table entries. The page cache is in `layout` before, and is left
+    // ready to be sampled.
+    void recordPageUploads(vk::CommandBuffer commands, PageUpload const & upload, vk::ImageLayout layout)
+    {
+        // Frames submitted earlier may still be sampling the slots and the entries being replaced.
+        vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        commands.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader,
+                                 vk::PipelineStageFlagBits::eTransfer,
+                                 {},
+                                 nullptr,
+                                 nullptr,
+                                 vk::ImageMemoryBarrier(vk::AccessFlagBits::eShaderRead,
+                                                        vk::AccessFlagBits::eTransferWrite,
+                                                        layout,
+                                                        vk::ImageLayout::eTransferDstOptimal,
+                                                        VK_QUEUE_FAMILY_IGNORED,
+                                                        VK_QUEUE_FAMILY_IGNORED,
+                                                        *pageCache_.image,
+                                                        range));
+        if (!upload.pages.empty())
+        {
+            commands.copyBufferToImage(*upload.staging.buffer,
+                                       *pageCache_.image,
+                                       vk::ImageLayout::eTransferDstOptimal,
+                                       upload.pages);
+        }
+        if (upload.entries.size > 0)
+            commands.copyBuffer(*upload.staging.buffer, pageTableBuffer_, upload.entries);
+        commands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                 vk::PipelineStageFlagBits::eFragmentShader,
+                                 {},
+                                 vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead),
+                                 nullptr,
+                                 vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite,
+                                                        vk::AccessFlagBits::eShaderRead,
+                                                        vk::ImageLayout::eTransferDstOptimal,
+                                                        vk::ImageLayout::eShaderReadOnlyOptimal,
+                                                        VK_QUEUE_FAMILY_IGNORED,
+                                                        VK_QUEUE_FAMILY_IGNORED,
+                                                        *pageCache_.image,
+                                                        range));
+    }
+
+    // Loads a texture and uploads its complete mip chain with a single copy, compressed if possible. Returns false if
+    // it cannot be read. The chain is staged on the calling thread, and only the upload holds the queue.
+    bool loadTexture(char const * path, unsigned mipThreads, Texture & texture)
+    {
+        TextureFormat         textureFormat;
+        std::vector<MipLevel> levels;
+        MappedBuffer          staging;
+        if (!stageTexture(path, mipThreads, textureFormat, levels, staging))
+            return false;
+
+        uint32_t levelCount = (uint32_t)levels.size();
+        createTextureImage(textureFormat, levels[0].width, levels[0].height, levelCount, texture);
+
+        vk::ImageSubresourceRange allLevels(vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1);
+        std::vector<vk::BufferImageCopy> regions;
+        regions.reserve(levelCount);
+        for (uint32_t l = 0; l < levelCount; ++l)
+        {
+            regions.emplace_back(levels[l].offset,
+                                 0,
+                                 0,
+                                 vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, l, 0, 1),
+                                 vk::Offset3D(0, 0, 0),
+                                 vk::Extent3D(levels[l].width, levels[l].height, 1));
+        }
+
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        vk::UniqueCommandBuffer commands = std::move(device_->allocateCommandBuffersUnique(
+            vk::CommandBufferAllocateInfo(*transientCommandPool_, vk::CommandBufferLevel::ePrimary, 1))[0]);
+        commands->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        commands->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                  vk::PipelineStageFlagBits::eTransfer,
+                                  {},
+                                  nullptr,
+                                  nullptr,
+                                  vk::ImageMemoryBarrier({},
+                                                         vk::AccessFlagBits::eTransferWrite,
+                                                         vk::ImageLayout::eUndefined,
+                                                         vk::ImageLayout::eTransferDstOptimal,
+                                                         VK_QUEUE_FAMILY_IGNORED,
+                                                         VK_QUEUE_FAMILY_IGNORED,
+                                                         *texture.image,
+                                                         allLevels));
+        commands->copyBufferToImage(*staging.buffer, *texture.image, vk::ImageLayout::eTransferDstOptimal, regions);
+        commands->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eFragmentShader,
+                                  {},
+                                  nullptr,
+                                  nullptr,
+                                  vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite,
+                                                         vk::AccessFlagBits::eShaderRead,
+                                                         vk::ImageLayout::eTransferDstOptimal,
+                                                         vk::ImageLayout::eShaderReadOnlyOptimal,
+                                                         VK_QUEUE_FAMILY_IGNORED,
+                                                         VK_QUEUE_FAMILY_IGNORED,
+                                                         *texture.image,
+                                                         allLevels));
+        commands->end();
+
+        vk::UniqueFence fence = device_->createFenceUnique(vk::FenceCreateInfo());
+        graphicsQueue_.submit(vk::SubmitInfo(0, nullptr, nullptr, 1, &commands.get()), *fence);
+        device_->waitForFences(*fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        return true;
+    }
+
+    // Creates an image in device-local memory that can be copied to and sampled, and a view of all of its levels
+    void createTextureImage(TextureFormat textureFormat,
+                            uint32_t      width,
+                            uint32_t      height,
+                            uint32_t      levelCount,
+                            Texture &     texture)
+    {
+        vk::Format format = textureImageFormat(textureFormat);
+        texture.image = device_->createImageUnique(
+            vk::ImageCreateInfo({},
+                                vk::ImageType::e2D,
+                                format,
+                                { width, height, 1 },
+                                levelCount,
+                                1,
+                                vk::SampleCountFlagBits::e1,
+                                vk::ImageTiling::eOptimal,
+                                vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled));
+        vk::MemoryRequirements requirements = device_->getImageMemoryRequirements(*texture.image);
+        texture.size   = requirements.size;
+        texture.memory = device_->allocateMemoryUnique(
+            vk::MemoryAllocateInfo(requirements.size,
+                                   findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal)));
+        device_->bindImageMemory(*texture.image, *texture.memory, 0);
+
+        texture.view = device_->createImageViewUnique(
+            vk::ImageViewCreateInfo({},
+                                    *texture.image,
+                                    vk::ImageViewType::e2D,
+                                    format,
+                                    vk::ComponentMapping(),
+                                    vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1)));
+    }
+
+    // Puts a texture's mip chain and the levels it is stored as in a new staging buffer. If the cache is missing or out
+    // of date, the texture is decoded straight into memory laid out as a mip chain, and the chain is filtered in place
+    // and compressed into the staging buffer. Uncompressed chains are built in the staging buffer itself. The cache is
+    // then written from the staging buffer. Returns false if the texture cannot be read.
+    bool stageTexture(char const *            path,
+                      unsigned                mipThreads,
+                      TextureFormat &         format,
+                      std::vector<MipLevel> & levels,
+                      MappedBuffer &          staging)
+    {
+        TextureCache::Key key;
+        if (!TextureCache::keyFor(path, options_.mipFilter, textureOptions(), key))
+            return false;
+
+        std::string  cachePath = TextureCache::pathFor(path);
+        TextureCache cache;
+        if (cache.open(cachePath.c_str(), key))
+        {
+            size_t levelCount;
+            size_t texelSize;
+            TextureCache::Level const * cached = cache.levels(&levelCount);
+            void const *                texels = cache.texels(&texelSize);
+            format = cache.format();
+            levels.clear();
+            for (size_t l = 0; l < levelCount; ++l)
+            {
+                levels.push_back({ (size_t)cached[l].offset, cached[l].width, cached[l].height });
+            }
+            staging = createMappedBuffer(texelSize);
+            memcpy(staging.data, texels, texelSize);
+            return true;
+        }
+
+        // The image is decoded from memory, so stb_image can find the restart intervals of a JPEG and decode them in
+        // parallel.
+        MappedFile source;
+        if (!source.open(path))
+            return false;
+        stbi_uc const * encoded = reinterpret_cast<stbi_uc const *>(source.data());
+        int width, height, channels;
+        if (!stbi_info_from_memory(encoded, (int)source.size(), &width, &height, &channels))
+            return false;
+
+        size_t                chainSize;
+        std::vector<MipLevel> chainLevels = mipChainLevels((uint32_t)width, (uint32_t)height, &chainSize);
+        bool                  compress    = chooseTextureFormat(false) != TextureFormat::eRGBA8 ||
+                                            chooseTextureFormat(true) != TextureFormat::eRGBA8;
+        std::vector<uint8_t>  chain;
+        uint8_t *             texels;
+        if (compress)
+        {
+            chain.resize(chainSize);
+            texels = chain.data();
+        }
+        else
+        {
+            staging = createMappedBuffer(chainSize);
+            texels  = staging.data;
+        }
+
+        decodeThreads = mipThreads;
+        if (!stbi_load_from_memory_into(encoded,
+                                        (int)source.size(),
+                                        &width,
+                                        &height,
+                                        &channels,
+                                        STBI_rgb_alpha,
+                                        texels,
+                                        chainSize))
+        {
+            return false;
+        }
+        source.close();
+        generateMipChain(texels, chainLevels, options_.mipFilter, mipThreads);
+
+        size_t size;
+        format = chooseTextureFormat(hasTransparency(texels, (size_t)width * height));
+        levels = compressedLevels(chainLevels, format, &size);
+        if (compress)
+        {
+            staging = createMappedBuffer(size);
+            compressMipChain(texels, chainLevels, format, options_.compressionQuality, mipThreads, staging.data);
+        }
+
+        if (!TextureCache::write(cachePath.c_str(), key, format, levels, staging.data, size))
+            std::cerr << "stageTexture: warning: failed to write " << cachePath << std::endl;
+        return true;
+    }
+
+    // Creates a buffer that is mapped for as long as it exists, in memory with the preferred properties if there is
+    // any. Cached memory is preferred by default, because a chain built in the buffer is read back while it is filtered
+    // and when its cache is written, and feedback is read back as well.
+    MappedBuffer createMappedBuffer(vk::DeviceSize          size,
+                                    vk::BufferUsageFlags    usage     = vk::BufferUsageFlagBits::eTransferSrc,
+                                    vk::MemoryPropertyFlags preferred = vk::MemoryPropertyFlagBits::eHostCached)
+    {
+        MappedBuffer staging;
+        staging.buffer = device_->createBufferUnique(
+            vk::BufferCreateInfo({}, size, usage, vk::SharingMode::eExclusive));
+        vk::MemoryRequirements requirements = device_->getBufferMemoryRequirements(*staging.buffer);
+        staging.memory = device_->allocateMemoryUnique(
+            vk::MemoryAllocateInfo(requirements.size,
+                                   findMemoryType(requirements.memoryTypeBits,
+                                                  vk::MemoryPropertyFlagBits::eHostVisible |
+                                                      vk::MemoryPropertyFlagBits::eHostCoherent,
+                                                  preferred)));
+        device_->bindBufferMemory(*staging.buffer, *staging.memory, 0);
+        staging.data = static_cast<uint8_t *>(device_->mapMemory(*staging.memory, 0, size));
+        return staging;
+    }
+
+    // Returns the format a texture is stored in. Opaque textures use BC1, which is half the size of the others, and the
+    // rest use BC7, which has better quality than BC3. Each falls back to the next if the device cannot sample it.
+    // Virtual textures share a page cache, so they all use the format of transparent textures.
+    TextureFormat chooseTextureFormat(bool transparent) const
+    {
+        if (options_.compressTextures)
+        {
+            std::vector<TextureFormat> candidates = { TextureFormat::eBC1, TextureFormat::eBC7, TextureFormat::eBC3 };
+            if (transparent || options_.virtualTextures)
+                candidates = { TextureFormat::eBC7, TextureFormat::eBC3 };
+            for (TextureFormat format : candidates)
+            {
+                if (supportedTextureFormats_ & (1u << (uint32_t)format))
+                    return format;
+            }
+        }
+        return TextureFormat::eRGBA8;
+    }
+
+    // Returns the bits identifying the options that change the contents of the texture caches. The formats the device
+    // supports are included, since they determine the format that is chosen.
+    uint32_t textureOptions() const
+    {
+        uint32_t bits = 0;
+        if (options_.compressTextures)
+            bits |= TEXTURE_OPTION_COMPRESS;
+        bits |= (uint32_t)options_.compressionQuality << TEXTURE_OPTION_QUALITY_SHIFT;
+        if (options_.virtualTextures)
+            bits |= TEXTURE_OPTION_VIRTUAL;
+        bits |= supportedTextureFormats_ << TEXTURE_OPTION_FORMATS_SHIFT;
+        return bits;
+    }
+
+    // Returns the index of a memory type allowed by typeBits that has all of the given properties, choosing one that
+    // also has the preferred properties if there is one
+    uint32_t findMemoryType(uint32_t                typeBits,
+                            vk::MemoryPropertyFlags properties,
+                            vk::MemoryPropertyFlags preferred = {}) const
+    {
+        vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice_->getMemoryProperties();
+        for (vk::MemoryPropertyFlags wanted : { properties | preferred, properties })
+        {
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+            {
+                if ((typeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & wanted) == wanted)
+                    return i;
+            }
+        }
+        throw std::runtime_error("findMemoryType: failed to find a suitable memory type");
+    }
+
+    // Creates the sampler shared by all of the textures. It is created before they are loaded, so it does not limit the
+    // level of detail.
+    void createTextureSampler()
+    {
+        textureSampler_ = device_->createSamplerUnique(
+            vk::SamplerCreateInfo({},
+                                  vk::Filter::eLinear,
+                                  vk::Filter::eLinear,
+                                  vk::SamplerMipmapMode::eLinear,
+                                  vk::SamplerAddressMode::eRepeat,
+                                  vk::SamplerAddressMode::eRepeat,
+                                  vk::SamplerAddressMode::eRepeat,
+                                  0.0f,
+                                  VK_TRUE,
+                                  16,
+                                  VK_FALSE,
+                                  vk::CompareOp::eAlways,
+                                  0.0f,
+                                  VK_LOD_CLAMP_NONE,
+                                  vk::BorderColor::eIntOpaqueBlack,
+                                  VK_FALSE));
+    }
+
+    // Loads the model, uploads its buffers, and reads the paths of its textures. This runs on a worker thread, so it
+    // only touches the members describing the model.
+    void loadModelAssets()
+    {
+        loadModel();
+        createVertexBuffer();
+        createIndexBuffer();
+        createMeshletBuffer();
+
+        size_t size;
+        char const * paths = static_cast<char const *>(meshCache_.section(MeshCache::Section::eTextures, &size));
+        if (size == 0)
+            throw std::runtime_error("loadModelAssets: mesh cache has no textures");
+        for (char const * path = paths; path < paths + size; path += strlen(path) + 1)
+        {
+            texturePaths_.push_back(path);
+        }
+        meshCache_.close(); // The model has been uploaded, so the cache is no longer needed
+    }
+
+    // Finishes setting up whatever has been loaded in the background since the last frame. The frames drawn until then
+    // are a cleared screen and then the model with placeholder textures. In-flight frames use the descriptor sets and
+    // pipelines being replaced, so the device must be idle first.
+    void swapInAssets()
+    {
+        if (!options_.asyncLoad && modelLoad_.valid())
+            modelLoad_.wait();
+        if (isReady(modelLoad_))
+        {
+            modelLoad_.get(); // Rethrows anything thrown while loading
+            {
+                std::lock_guard<std::mutex> lock(queueMutex_);
+                device_->waitIdle();
+            }
+
+            // The texture array has a slot for every texture, all showing the placeholder until it is loaded.
+            textureViews_.assign(texturePaths_.size(), placeholderImage_.view());
+            createDescriptorSetLayout();
+            createGraphicsPipeline();
+            createCullPipeline();
+            createUniformRing();
+            createIndirectBuffer();
+            createDescriptorPool();
+            createDescriptorSets();
+            modelReady_ = true;
+            reportLoadTime("model ready");
+
+            textureLoad_ = std::async(std::launch::async, [this] { loadTextures(); });
+        }
+
+        if (!options_.asyncLoad && textureLoad_.valid())
+            textureLoad_.wait();
+        if (isReady(textureLoad_))
+        {
+            textureLoad_.get();
+            {
+                std::lock_guard<std::mutex> lock(queueMutex_);
+                device_->waitIdle();
+            }
+
+            // The frames are recorded with the descriptor sets as they are when they are drawn. Virtual textures change
+            // the layout of the descriptor sets, so everything that depends on it is replaced.
+            if (virtualTextures_)
+            {
+                virtualTexturesReady_ = true;
+                createPageStreamingBuffers();
+                createDescriptorSetLayout();
+                createGraphicsPipeline();
+                createDescriptorPool();
+                createDescriptorSets();
+            }
+            else
+            {
+                textureViews_ = std::move(loadedTextureViews_);
+                writeTextureDescriptors();
+            }
+            reportLoadTime("full quality");
+        }
+    }
+
+    // Returns true if a background load has finished and its result has not been taken yet
+    static bool isReady(std::future<void> const & load)
+    {
+        return load.valid() && load.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // Prints the time since run() started
+    void reportLoadTime(char const * milestone) const
+    {
+        auto elapsed = std::chrono::steady_clock::now() - startTime_;
+        std::cout << "run: " << milestone << " after "
+                  << std::chrono::duration<double, std::milli>(elapsed).count() << " ms"
+                  << std::endl;
+    }
+
+    // Loads the model from its cache, first building the cache if it is missing or out of date
+    void loadModel()
+    {
+        MeshCache::Key key;
+        uint32_t vertexSize = options_.compactVertices ? sizeof(CompactVertex) : sizeof(Vertex);
+        char const * modelPath = options_.modelPath.c_str();
+        if (!MeshCache::keyFor(modelPath, materialLibraries(), vertexSize, meshOptions(), key))
+            throw std::runtime_error("loadModel: failed to read " + options_.modelPath);
+
+        std::string cachePath = MeshCache::pathFor(modelPath);
+        if (meshCache_.open(cachePath.c_str(), key))
+            return;
+
+        std::vector<Vertex>        vertices;
+        std::vector<LevelOfDetail> levels;
+        MeshCache::Bounds          bounds;
+        std::vector<std::string>   textures;
+        buildModel(vertices, levels, bounds, textures);
+
+        // The indices, draw ranges, and meshlets of the levels of detail are stored one after the other. Each batch
+        // is packed into its own draw ranges, so every draw range has a single texture.
+        std::vector<char>                 packedIndices;
+        std::vector<MeshCache::DrawRange> drawRanges;
+        std::vector<MeshCache::Meshlet>   meshlets;
+        std::vector<MeshCache::Lod>       lods;
+        for (auto const & level : levels)
+        {
+            MeshCache::Lod lod;
+            lod.firstDrawRange = (uint32_t)drawRanges.size();
+            lod.firstMeshlet   = (uint32_t)meshlets.size();
+            size_t packedSize  = packedIndices.size();
+            for (auto const & batch : level.batches)
+            {
+                packIndices(&level.indices[batch.firstIndex],
+                            batch.indexCount,
+                            vertices.size(),
+                            batch.texture,
+                            packedIndices,
+                            drawRanges);
+            }
+            reportPackedIndices(level, drawRanges, lod.firstDrawRange, packedIndices.size() - packedSize);
+            buildClusters(vertices, level.indices, lod.firstDrawRange, drawRanges, meshlets);
+            lod.drawRangeCount = (uint32_t)drawRanges.size() - lod.firstDrawRange;
+            lod.meshletCount   = (uint32_t)meshlets.size() - lod.firstMeshlet;
+            lod.triangleCount  = (uint32_t)(level.indices.size() / 3);
+            lod.error          = level.error;
+            lods.push_back(lod);
+        }
+
+        MeshCache::Builder builder(key);
+        if (options_.compactVertices)
+        {
+            std::vector<CompactVertex> compact;
+            MeshCache::Dequantization dequantization;
+            quantizeModel(vertices, bounds, compact, dequantization);
+            builder.add(MeshCache::Section::eVertices, compact.data(), compact.size() * sizeof(CompactVertex));
+            builder.add(MeshCache::Section::eDequantization, &dequantization, sizeof(dequantization));
+
+            // Quantization moves each vertex by up to half a step on each axis, so the bounding spheres are grown to
+            // still contain them.
+            float const * scale = dequantization.positionScale;
+            float         error = glm::length(glm::vec3(scale[0], scale[1], scale[2])) / 65535.0f * 0.5f;
+            for (auto & meshlet : meshlets)
+            {
+                meshlet.radius += error;
+            }
+        }
+        else
+        {
+            // The full format needs no dequantization.
+            MeshCache::Dequantization identity =
+            {
+                { 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 0.0f }
+            };
+            builder.add(MeshCache::Section::eVertices, vertices.data(), vertices.size() * sizeof(Vertex));
+            builder.add(MeshCache::Section::eDequantization, &identity, sizeof(identity));
+        }
+        builder.add(MeshCache::Section::eIndices, packedIndices.data(), packedIndices.size());
+        builder.add(MeshCache::Section::eDrawRanges,
+                    drawRanges.data(),
+                    drawRanges.size() * sizeof(MeshCache::DrawRange));
+        builder.add(MeshCache::Section::eMeshlets, meshlets.data(), meshlets.size() * sizeof(MeshCache::Meshlet));
+        builder.add(MeshCache::Section::eLods, lods.data(), lods.size() * sizeof(MeshCache::Lod));
+        builder.add(MeshCache::Section::eBounds, &bounds, sizeof(bounds));
+        std::string texturePaths;
+        for (auto const & path : textures)
+        {
+            texturePaths.append(path.c_str(), path.size() + 1);
+        }
+        builder.add(MeshCache::Section::eTextures, texturePaths.data(), texturePaths.size());
+        std::vector<char> image = builder.finish();
+
+        // Failing to save the cache is not fatal, it just has to be rebuilt next time.
+        if (!MeshCache::write(cachePath.c_str(), image))
+            std::cerr << "loadModel: warning: failed to write " << cachePath << std::endl;
+
+        meshCache_.assign(std::move(image), key);
+    }
+
+    // Returns the bits identifying the options that change the contents of the mesh cache
+    uint32_t meshOptions() const
+    {
+        uint32_t bits = 0;
+        if (!options_.optimizeVertexFetch)
+            bits |= MESH_OPTION_NO_FETCH_OPTIMIZATION;
+        if (options_.compactVertices)
+            bits |= MESH_OPTION_COMPACT_VERTICES;
+        if (options_.streamingLoad)
+            bits |= MESH_OPTION_FAN_TRIANGULATION;
+        return bits;
+    }
+
+    // Returns the directory of the model, where its material files and textures are found, with a trailing separator
+    std::string modelDirectory() const
+    {
+        size_t separator = options_.modelPath.find_last_of("/\\");
+        return separator == std::string::npos ? std::string() : options_.modelPath.substr(0, separator + 1);
+    }
+
+    // Returns the paths of the material libraries named by the model's mtllib statements, which the batches and the
+    // texture list depend on as much as on the model itself
+    std::vector<std::string> materialLibraries() const
+    {
+        std::vector<std::string> paths;
+        MappedFile               model;
+        if (!model.open(options_.modelPath.c_str()))
+            return paths;
+
+        std::string  directory = modelDirectory();
+        char const * p         = model.data();
+        char const * end       = p + model.size();
+        while (p < end)
+        {
+            char const * lineEnd = static_cast<char const *>(memchr(p, '\n', (size_t)(end - p)));
+            if (!lineEnd)
+                lineEnd = end;
+            while (p < lineEnd && (*p == ' ' || *p == '\t'))
+                ++p;
+            if (lineEnd - p > 6 && memcmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t'))
+            {
+                std::istringstream names(std::string(p + 7, lineEnd));
+                std::string        name;
+                while (names >> name)
+                {
+                    paths.push_back(directory + name);
+                }
+            }
+            p = lineEnd + 1;
+        }
+        return paths;
+    }
+
+    // Replaces the material of each triangle with the index of its texture, whose paths are returned in `textures`.
+    // Texture 0 is the default texture, which is used by the triangles without a material and by the materials without
+    // a diffuse texture. Only the diffuse texture is used, so materials with the same one share a texture.
+    void assignTextures(std::vector<tinyobj::material_t> const & materials,
+                        std::vector<uint32_t> &                  triangleMaterials,
+                        std::vector<std::string> &               textures) const
+    {
+        std::string directory = modelDirectory();
+        textures.assign(1, TEXTURE_PATH);
+
+        std::vector<uint32_t> materialTextures(materials.size(), 0);
+        for (size_t m = 0; m < materials.size(); ++m)
+        {
+            if (materials[m].diffuse_texname.empty())
+                continue;
+            std::string path  = directory + materials[m].diffuse_texname;
+            auto        found = std::find(textures.begin(), textures.end(), path);
+            materialTextures[m] = (uint32_t)(found - textures.begin());
+            if (found == textures.end())
+                textures.push_back(path);
+        }
+
+        // A triangle without a material has a material of -1, which is out of range like any other invalid material.
+        for (auto & t : triangleMaterials)
+        {
+            t = t < materialTextures.size() ? materialTextures[t] : 0;
+        }
+    }
+
+    // Parses the whole model with the parallel parser, then welds one vertex per triangle corner into unique
+    // vertices. This is the fastest way to build the model, but the parsed attributes and the corners are all in
+    // memory at once.
+    void parseModel(std::vector<Vertex> &      vertices,
+                    std::vector<uint32_t> &    indices,
+                    std::vector<uint32_t> &    triangleTextures,
+                    std::vector<std::string> & textures) const
+    {
+        tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t>    shapes;
         std::vector<tinyobj::material_t> materials;
         std::string warn, err;
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH))
+        std::string directory = modelDirectory();
+        if (!tinyobj::LoadObjParallel(&attrib, &shapes, &materials, &warn, &err, options_.modelPath.c_str(),
+                                      directory.c_str(), true, true, options_.threads, options_.mmapPopulate))
+        {
             throw std::runtime_error(warn + err);
+        }
+
+        // Build one vertex per triangle corner and then weld them into unique vertices
+        size_t cornerCount = 0;
+        for (auto const & shape : shapes)
+        {
+            cornerCount += shape.mesh.indices.size();
+        }
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices;
+        // The faces have been triangulated, so there is one material per triangle.
+        triangleTextures.clear();
+        triangleTextures.reserve(cornerCount / 3);
+        for (auto const & shape : shapes)
+        {
+            for (int id : shape.mesh.material_ids)
+            {
+                triangleTextures.push_back((uint32_t)id);
+            }
+        }
+        assignTextures(materials, triangleTextures, textures);
+
+        // Vertices are welded by comparing their bytes, so any padding must be cleared.
+        vertices.resize(cornerCount);
+        memset(vertices.data(), 0, cornerCount * sizeof(Vertex));
+
+        size_t corner = 0;
         for (auto const & shape : shapes)
         {
             for (auto const & index : shape.mesh.indices)
             {
-                Vertex vertex;
+                Vertex & vertex = vertices[corner++];
                 vertex.pos =
                 {
                     attrib.vertices[3 * index.vertex_index + 0],
@@ -793,151 +2210,1111 @@ private:
                     attrib.vertices[3 * index.vertex_index + 2]
                 };
 
-                vertex.texCoord =
+                // A corner without texture coordinates gets (0, 0), which is flipped like the others.
+                if (index.texcoord_index < 0)
                 {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                };
+                    vertex.texCoord = { 0.0f, 1.0f };
+                }
+                else
+                {
+                    vertex.texCoord =
+                    {
+                        attrib.texcoords[2 * index.texcoord_index + 0],
+                        1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                    };
+                }
 
                 vertex.color = { 1.0f, 1.0f, 1.0f };
+            }
+        }
+
+        indices.resize(cornerCount);
+        size_t uniqueCount = VertexWelder::weld(vertices.data(),
+                                                cornerCount,
+                                                sizeof(Vertex),
+                                                indices.data(),
+                                                options_.threads);
+        vertices.resize(uniqueCount);
+        vertices.shrink_to_fit();
+    }
+
+    // The state of streamModel while the file is being read
+    struct ModelStream
+    {
+        std::vector<float>    positions;
+        std::vector<float>    texCoords;
+        VertexWelder          welder{ sizeof(Vertex), 0 };
+        std::vector<uint32_t> corners;
+        std::vector<uint32_t> * indices;
+        std::vector<uint32_t> * triangleMaterials;
+        std::vector<tinyobj::material_t> materials;
+        int                   material = -1;
+        bool                  badIndex = false;
+    };
+
+    // Parses the model with callbacks, welding each face's vertices and appending its indices as it is read. Only the
+    // positions and texture coordinates, the unique vertices, the indices, and the triangles' materials are kept, so
+    // the peak memory use is about the size of the result instead of several copies of the mesh. Faces with more than
+    // three corners are triangulated as fans, which is the same as the parallel parser for convex faces.
+    void streamModel(std::vector<Vertex> &      vertices,
+                     std::vector<uint32_t> &    indices,
+                     std::vector<uint32_t> &    triangleTextures,
+                     std::vector<std::string> & textures) const
+    {
+        ModelStream stream;
+        stream.indices           = &indices;
+        stream.triangleMaterials = &triangleTextures;
+
+        tinyobj::callback_t callbacks;
+        callbacks.vertex_cb   = streamPosition;
+        callbacks.texcoord_cb = streamTexCoord;
+        callbacks.index_cb    = streamFace;
+        callbacks.usemtl_cb   = streamMaterial;
+        callbacks.mtllib_cb   = streamMaterialLibrary;
 
-                uint32_t uniqueIndex;
-                if (uniqueVertices.count(vertex) == 0)
+        std::string warn, err;
+        std::string directory = modelDirectory();
+        if (!tinyobj::LoadObjWithCallback(options_.modelPath.c_str(), callbacks, &stream, directory.c_str(),
+                                          &warn, &err, options_.mmapPopulate))
+        {
+            throw std::runtime_error(warn + err);
+        }
+        if (stream.badIndex)
+            throw std::runtime_error("loadModel: invalid face index in " + options_.modelPath);
+
+        // The attributes are no longer needed, and freeing them first keeps them out of the peak.
+        std::vector<float>().swap(stream.positions);
+        std::vector<float>().swap(stream.texCoords);
+
+        std::vector<char> unique = stream.welder.release();
+        vertices.resize(unique.size() / sizeof(Vertex));
+        if (!unique.empty())
+            memcpy(vertices.data(), unique.data(), unique.size());
+        indices.shrink_to_fit();
+        triangleTextures.shrink_to_fit();
+        assignTextures(stream.materials, triangleTextures, textures);
+    }
+
+    static void streamPosition(void * data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z, tinyobj::real_t)
+    {
+        ModelStream * stream = static_cast<ModelStream *>(data);
+        stream->positions.insert(stream->positions.end(), { (float)x, (float)y, (float)z });
+    }
+
+    static void streamTexCoord(void * data, tinyobj::real_t u, tinyobj::real_t v, tinyobj::real_t)
+    {
+        ModelStream * stream = static_cast<ModelStream *>(data);
+        stream->texCoords.insert(stream->texCoords.end(), { (float)u, (float)v });
+    }
+
+    static void streamMaterial(void * data, char const *, int material)
+    {
+        static_cast<ModelStream *>(data)->material = material;
+    }
+
+    static void streamMaterialLibrary(void * data, tinyobj::material_t const * materials, int count)
+    {
+        static_cast<ModelStream *>(data)->materials.assign(materials, materials + count);
+    }
+
+    // Resolves a 1-based or negative (relative) OBJ index against the number of elements read so far. Returns false
+    // if the index is out of range.
+    static bool resolveObjIndex(int index, size_t count, size_t & resolved)
+    {
+        if (index > 0 && (size_t)index <= count)
+            resolved = (size_t)index - 1;
+        else if (index < 0 && (size_t)-(int64_t)index <= count)
+            resolved = count - (size_t)-(int64_t)index;
+        else
+            return false;
+        return true;
+    }
+
+    static void streamFace(void * data, tinyobj::index_t * corners, int count)
+    {
+        ModelStream * stream = static_cast<ModelStream *>(data);
+        if (count < 3 || stream->badIndex)
+            return;
+
+        // Vertices are welded by comparing their bytes, so any padding must be cleared.
+        stream->corners.clear();
+        for (int c = 0; c < count; ++c)
+        {
+            Vertex vertex;
+            memset(&vertex, 0, sizeof(vertex));
+
+            size_t p;
+            if (!resolveObjIndex(corners[c].vertex_index, stream->positions.size() / 3, p))
+            {
+                stream->badIndex = true;
+                return;
+            }
+            vertex.pos = { stream->positions[3 * p + 0], stream->positions[3 * p + 1], stream->positions[3 * p + 2] };
+
+            // A corner without texture coordinates gets (0, 0), which is flipped like the others.
+            size_t t;
+            if (corners[c].texcoord_index == 0)
+            {
+                vertex.texCoord = { 0.0f, 1.0f };
+            }
+            else if (resolveObjIndex(corners[c].texcoord_index, stream->texCoords.size() / 2, t))
+            {
+                vertex.texCoord = { stream->texCoords[2 * t + 0], 1.0f - stream->texCoords[2 * t + 1] };
+            }
+            else
+            {
+                stream->badIndex = true;
+                return;
+            }
+
+            vertex.color = { 1.0f, 1.0f, 1.0f };
+            stream->corners.push_back(stream->welder.add(&vertex));
+        }
+
+        for (int c = 2; c < count; ++c)
+        {
+            stream->indices->insert(stream->indices->end(),
+                                    { stream->corners[0], stream->corners[c - 1], stream->corners[c] });
+            stream->triangleMaterials->push_back((uint32_t)stream->material);
+        }
+    }
+
+    // Parses the model, deduplicates its vertices, sorts its triangles into batches by texture, optimizes it for
+    // rendering, and builds its levels of detail
+    void buildModel(std::vector<Vertex> &        vertices,
+                    std::vector<LevelOfDetail> & levels,
+                    MeshCache::Bounds &          bounds,
+                    std::vector<std::string> &   textures)
+    {
+        levels.resize(1);
+        levels[0].error = 0.0f;
+        std::vector<uint32_t> & indices = levels[0].indices;
+        std::vector<uint32_t>   triangleTextures;
+        if (options_.streamingLoad)
+            streamModel(vertices, indices, triangleTextures, textures);
+        else
+            parseModel(vertices, indices, triangleTextures, textures);
+        std::cout << "loadModel: " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles"
+                  << ", peak memory " << peakMemoryUsage() / (1024 * 1024) << " MiB"
+                  << std::endl;
+
+        levels[0].batches = sortIntoBatches(indices, triangleTextures, textures.size());
+        std::vector<uint32_t>().swap(triangleTextures);
+        std::cout << "loadModel: " << textures.size() << " texture(s), " << levels[0].batches.size() << " batch(es)"
+                  << std::endl;
+
+        // The faces are in file order, which is arbitrary as far as the post-transform cache is concerned.
+        VertexCacheStatistics before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+        optimizeBatches(indices, levels[0].batches, vertices.size());
+        VertexCacheStatistics after = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+        std::cout << "loadModel: vertex cache ACMR " << before.acmr << " -> " << after.acmr
+                  << ", ATVR " << before.atvr << " -> " << after.atvr
+                  << ", vertex shader invocations " << before.misses << " -> " << after.misses
+                  << std::endl;
+
+        // The vertices are in the order they were first seen in the file, which does not follow the triangle order.
+        if (options_.optimizeVertexFetch)
+        {
+            VertexFetchStatistics fetchBefore = analyzeVertexFetch(indices.data(),
+                                                                   indices.size(),
+                                                                   vertices.size(),
+                                                                   sizeof(Vertex));
+            vertices.resize(optimizeVertexFetch(vertices.data(),
+                                                vertices.size(),
+                                                sizeof(Vertex),
+                                                indices.data(),
+                                                indices.size()));
+            VertexFetchStatistics fetchAfter = analyzeVertexFetch(indices.data(),
+                                                                  indices.size(),
+                                                                  vertices.size(),
+                                                                  sizeof(Vertex));
+            std::cout << "loadModel: vertex fetch overfetch " << fetchBefore.overfetch << " -> " << fetchAfter.overfetch
+                      << ", bytes fetched " << fetchBefore.bytesFetched << " -> " << fetchAfter.bytesFetched
+                      << std::endl;
+        }
+
+        glm::vec3 minimum(std::numeric_limits<float>::max());
+        glm::vec3 maximum(-std::numeric_limits<float>::max());
+        for (auto const & v : vertices)
+        {
+            minimum = glm::min(minimum, v.pos);
+            maximum = glm::max(maximum, v.pos);
+        }
+        bounds = { { minimum.x, minimum.y, minimum.z }, { maximum.x, maximum.y, maximum.z } };
+
+        buildLevelsOfDetail(vertices, levels);
+    }
+
+    // Sorts the triangles by texture, keeping their order otherwise, and returns a batch for each texture that is used
+    static std::vector<Batch> sortIntoBatches(std::vector<uint32_t> &       indices,
+                                              std::vector<uint32_t> const & triangleTextures,
+                                              size_t                        textureCount)
+    {
+        std::vector<size_t> starts(textureCount + 1, 0);
+        for (uint32_t t : triangleTextures)
+        {
+            ++starts[t + 1];
+        }
+        for (size_t t = 0; t < textureCount; ++t)
+        {
+            starts[t + 1] += starts[t];
+        }
+
+        std::vector<Batch> batches;
+        for (size_t t = 0; t < textureCount; ++t)
+        {
+            if (starts[t + 1] > starts[t])
+                batches.push_back({ starts[t] * 3, (starts[t + 1] - starts[t]) * 3, (uint32_t)t });
+        }
+        if (batches.size() <= 1)
+            return batches;
+
+        std::vector<uint32_t> sorted(indices.size());
+        for (size_t i = 0; i < triangleTextures.size(); ++i)
+        {
+            size_t to = starts[triangleTextures[i]]++ * 3;
+            std::copy(&indices[i * 3], &indices[i * 3] + 3, &sorted[to]);
+        }
+        indices.swap(sorted);
+        return batches;
+    }
+
+    // Renumbers the vertices referenced by `indices` from 0, in ascending order, and returns the original number of
+    // each. The mesh functions allocate and scan per vertex, so a batch is renumbered to pay only for its own vertices.
+    static std::vector<uint32_t> renumberVertices(std::vector<uint32_t> & indices)
+    {
+        std::vector<uint32_t> used(indices);
+        std::sort(used.begin(), used.end());
+        used.erase(std::unique(used.begin(), used.end()), used.end());
+        for (auto & index : indices)
+        {
+            index = (uint32_t)(std::lower_bound(used.begin(), used.end(), index) - used.begin());
+        }
+        return used;
+    }
+
+    // Optimizes the triangles of each batch for the vertex cache separately, so they stay sorted by texture
+    void optimizeBatches(std::vector<uint32_t> & indices, std::vector<Batch> const & batches, size_t vertexCount) const
+    {
+        if (batches.size() <= 1)
+        {
+            optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+            return;
+        }
+
+        parallelFor(batches.size(), options_.threads, [&] (size_t b) {
+            uint32_t * first = &indices[batches[b].firstIndex];
+            std::vector<uint32_t> local(first, first + batches[b].indexCount);
+            std::vector<uint32_t> used = renumberVertices(local);
+            optimizeVertexCache(local.data(), local.size(), used.size());
+            for (size_t i = 0; i < local.size(); ++i)
+            {
+                first[i] = used[local[i]];
+            }
+        });
+    }
+
+    // Simplifies a batch of the full mesh to about `targetIndexCount` indices and optimizes it for the vertex cache.
+    // Unless the batch is the whole mesh, it is renumbered and simplified on its own. Its border is locked, so it
+    // still meets the neighboring batches without cracks.
+    static std::vector<uint32_t> simplifyBatch(std::vector<Vertex> const & vertices,
+                                               std::vector<uint32_t> const & full,
+                                               Batch const &               batch,
+                                               size_t                      targetIndexCount,
+                                               float &                     error)
+    {
+        std::vector<uint32_t> simplified(batch.indexCount);
+        if (batch.indexCount == full.size())
+        {
+            char const * positions = reinterpret_cast<char const *>(vertices.data()) + offsetof(Vertex, pos);
+            simplified.resize(simplify(simplified.data(),
+                                       full.data(),
+                                       full.size(),
+                                       positions,
+                                       sizeof(Vertex),
+                                       vertices.size(),
+                                       targetIndexCount,
+                                       &error));
+            optimizeVertexCache(simplified.data(), simplified.size(), vertices.size());
+            return simplified;
+        }
+
+        std::vector<uint32_t>  local(&full[batch.firstIndex], &full[batch.firstIndex] + batch.indexCount);
+        std::vector<uint32_t>  used = renumberVertices(local);
+        std::vector<glm::vec3> positions(used.size());
+        for (size_t v = 0; v < used.size(); ++v)
+        {
+            positions[v] = vertices[used[v]].pos;
+        }
+        simplified.resize(simplify(simplified.data(),
+                                   local.data(),
+                                   local.size(),
+                                   positions.data(),
+                                   sizeof(glm::vec3),
+                                   positions.size(),
+                                   targetIndexCount,
+                                   &error));
+        optimizeVertexCache(simplified.data(), simplified.size(), used.size());
+        for (auto & index : simplified)
+        {
+            index = used[index];
+        }
+        return simplified;
+    }
+
+    // Adds successively simpler versions of the mesh in levels[0], each with about half the triangles of the one
+    // before it. They share the vertices of the full mesh. Each batch of each level is simplified from the full mesh
+    // on its own, so they are all built in parallel.
+    void buildLevelsOfDetail(std::vector<Vertex> const & vertices, std::vector<LevelOfDetail> & levels) const
+    {
+        LevelOfDetail const & full    = levels[0];
+        size_t const          batches = full.batches.size();
+
+        // The simplified batch b of level l is in simplifiedBatches[l * batches + b].
+        std::vector<std::vector<uint32_t>> simplifiedBatches((LEVELS_OF_DETAIL - 1) * batches);
+        std::vector<float>                 errors(simplifiedBatches.size(), 0.0f);
+        parallelFor(simplifiedBatches.size(), options_.threads, [&] (size_t s) {
+            Batch const & batch  = full.batches[s % batches];
+            size_t        target = (batch.indexCount / 3 >> (s / batches + 1)) * 3;
+            simplifiedBatches[s] = simplifyBatch(vertices, full.indices, batch, target, errors[s]);
+        });
+
+        std::vector<LevelOfDetail> simplified(LEVELS_OF_DETAIL - 1);
+        for (size_t l = 0; l < simplified.size(); ++l)
+        {
+            LevelOfDetail & level = simplified[l];
+            level.error = 0.0f;
+            for (size_t b = 0; b < batches; ++b)
+            {
+                std::vector<uint32_t> & indices = simplifiedBatches[l * batches + b];
+                if (!indices.empty())
+                    level.batches.push_back({ level.indices.size(), indices.size(), full.batches[b].texture });
+                level.indices.insert(level.indices.end(), indices.begin(), indices.end());
+                level.error = std::max(level.error, errors[l * batches + b]);
+                std::vector<uint32_t>().swap(indices);
+            }
+        }
+
+        // Seams and borders are never simplified, so a level may not be much simpler than the one before it, in
+        // which case it is not worth keeping.
+        for (auto & level : simplified)
+        {
+            if (!level.indices.empty() && level.indices.size() < levels.back().indices.size() * 3 / 4)
+                levels.push_back(std::move(level));
+        }
+
+        for (size_t l = 0; l < levels.size(); ++l)
+        {
+            std::cout << "loadModel: LOD " << l << ": " << levels[l].indices.size() / 3 << " triangles"
+                      << ", error " << levels[l].error
+                      << std::endl;
+        }
+    }
+
+    // Converts a batch's indices to 16 bits wherever possible. If there are too many vertices, the triangles are split
+    // into ranges that each reference no more than 65536 consecutive vertices, and each range's indices are made
+    // relative to its first vertex. A range that cannot be narrowed keeps 32-bit indices. The indices and the ranges
+    // are appended to `packed` and `drawRanges`.
+    static void packIndices(uint32_t const *                    indices,
+                            size_t                              indexCount,
+                            size_t                              vertexCount,
+                            uint32_t                            texture,
+                            std::vector<char> &                 packed,
+                            std::vector<MeshCache::DrawRange> & drawRanges)
+    {
+        std::vector<IndexRange> ranges = splitIndexRanges(indices, indexCount);
+
+        // Every range is a separate draw, so if the vertices are scattered too much it is better not to split.
+        if (ranges.size() > MAX_DRAW_RANGES)
+            ranges = { { 0, indexCount, 0, (uint32_t)vertexCount } };
+
+        for (auto const & range : ranges)
+        {
+            uint32_t indexSize = range.vertexSpan <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+            // The offset of an index buffer binding must be a multiple of the index size.
+            packed.resize((packed.size() + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1));
+            size_t offset = packed.size();
+            packed.resize(offset + range.indexCount * indexSize);
+            for (size_t i = 0; i < range.indexCount; ++i)
+            {
+                uint32_t index = indices[range.firstIndex + i] - range.baseVertex;
+                if (indexSize == sizeof(uint16_t))
                 {
-                    uniqueIndex = (uint32_t)vertices_.size();
-                    vertices_.push_back(vertex);
-                    uniqueVertices[vertex] = uniqueIndex;
+                    uint16_t narrow = (uint16_t)index;
+                    memcpy(&packed[offset + i * sizeof(uint16_t)], &narrow, sizeof(narrow));
                 }
                 else
                 {
-                    uniqueIndex = uniqueVertices[vertex];
+                    memcpy(&packed[offset + i * sizeof(uint32_t)], &index, sizeof(index));
                 }
+            }
 
-                indices_.push_back(uniqueIndex);
+            drawRanges.push_back({ (uint32_t)offset,
+                                   (uint32_t)range.indexCount,
+                                   (int32_t)range.baseVertex,
+                                   indexSize,
+                                   0,
+                                   0,
+                                   texture });
+        }
+    }
+
+    // Reports how well the indices of a level of detail, packed into the draw ranges from `firstRange` on, were
+    // narrowed
+    static void reportPackedIndices(LevelOfDetail const &                     level,
+                                    std::vector<MeshCache::DrawRange> const & drawRanges,
+                                    size_t                                    firstRange,
+                                    size_t                                    packedSize)
+    {
+        size_t narrowCount = 0;
+        for (size_t r = firstRange; r < drawRanges.size(); ++r)
+        {
+            if (drawRanges[r].indexSize == sizeof(uint16_t))
+                narrowCount += drawRanges[r].count;
+        }
+        std::cout << "loadModel: " << level.batches.size() << " batch(es), " << drawRanges.size() - firstRange
+                  << " draw range(s), " << narrowCount << " of " << level.indices.size() << " indices are 16-bit"
+                  << ", index buffer " << level.indices.size() * sizeof(uint32_t) << " -> " << packedSize << " bytes"
+                  << std::endl;
+    }
+
+    // Splits the draw ranges of `indices`, starting at `firstRange`, into meshlets of about 64 vertices and 124
+    // triangles, which are culled individually. The meshlets are appended to `meshlets`.
+    static void buildClusters(std::vector<Vertex> const &         vertices,
+                              std::vector<uint32_t> const &       indices,
+                              size_t                              firstRange,
+                              std::vector<MeshCache::DrawRange> & drawRanges,
+                              std::vector<MeshCache::Meshlet> &   meshlets)
+    {
+        size_t const firstMeshlet = meshlets.size();
+        size_t       firstIndex   = 0;
+        size_t       coneCount    = 0;
+        for (size_t r = firstRange; r < drawRanges.size(); ++r)
+        {
+            // The range is renumbered, so building its meshlets only pays for its own vertices.
+            MeshCache::DrawRange & range = drawRanges[r];
+            std::vector<uint32_t>  local(indices.begin() + firstIndex, indices.begin() + firstIndex + range.count);
+            std::vector<uint32_t>  used = renumberVertices(local);
+            std::vector<glm::vec3> positions(used.size());
+            for (size_t v = 0; v < used.size(); ++v)
+            {
+                positions[v] = vertices[used[v]].pos;
             }
+            std::vector<Meshlet> built = buildMeshlets(local.data(),
+                                                       local.size(),
+                                                       positions.data(),
+                                                       sizeof(glm::vec3),
+                                                       positions.size());
+            range.firstMeshlet = (uint32_t)meshlets.size();
+            range.meshletCount = (uint32_t)built.size();
+
+            // The first index of a meshlet is relative to its draw range, as is the binding of the index buffer.
+            for (auto const & m : built)
+            {
+                meshlets.push_back({ { m.center[0], m.center[1], m.center[2] },
+                                     m.radius,
+                                     { m.coneAxis[0], m.coneAxis[1], m.coneAxis[2] },
+                                     m.coneCutoff,
+                                     (uint32_t)m.firstIndex,
+                                     (uint32_t)m.indexCount,
+                                     range.vertexOffset,
+                                     0 });
+                if (m.coneCutoff < 1.0f)
+                    ++coneCount;
+            }
+            firstIndex += range.count;
+        }
+
+        std::cout << "loadModel: " << meshlets.size() - firstMeshlet << " meshlets, "
+                  << coneCount << " of them can be culled by their normal cones"
+                  << std::endl;
+    }
+
+    // Converts the vertices to the compact format. Positions are quantized within the bounds of the mesh and texture
+    // coordinates within their own range, and the transform that restores them is returned in `dequantization`.
+    static void quantizeModel(std::vector<Vertex> const &  vertices,
+                              MeshCache::Bounds const &    bounds,
+                              std::vector<CompactVertex> & compact,
+                              MeshCache::Dequantization &  dequantization)
+    {
+        glm::vec2 texCoordMin(std::numeric_limits<float>::max());
+        glm::vec2 texCoordMax(-std::numeric_limits<float>::max());
+        for (auto const & v : vertices)
+        {
+            texCoordMin = glm::min(texCoordMin, v.texCoord);
+            texCoordMax = glm::max(texCoordMax, v.texCoord);
+        }
+
+        glm::vec3 positionMin(bounds.min[0], bounds.min[1], bounds.min[2]);
+        glm::vec3 positionMax(bounds.max[0], bounds.max[1], bounds.max[2]);
+        if (vertices.empty())
+        {
+            positionMin = positionMax = glm::vec3(0.0f);
+            texCoordMin = texCoordMax = glm::vec2(0.0f);
         }
+
+        // A unorm value of q is read as q / 65535, so the scale is the extent of the range. A range with no extent
+        // quantizes everything to 0.
+        glm::vec3 positionExtent = positionMax - positionMin;
+        glm::vec2 texCoordExtent = texCoordMax - texCoordMin;
+        auto quantize = [] (float value, float minimum, float extent) {
+            float normalized = extent > 0.0f ? glm::clamp((value - minimum) / extent, 0.0f, 1.0f) : 0.0f;
+            return (uint16_t)(normalized * 65535.0f + 0.5f);
+        };
+
+        compact.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            Vertex const &  v = vertices[i];
+            CompactVertex & c = compact[i];
+            c.pos[0]      = quantize(v.pos.x, positionMin.x, positionExtent.x);
+            c.pos[1]      = quantize(v.pos.y, positionMin.y, positionExtent.y);
+            c.pos[2]      = quantize(v.pos.z, positionMin.z, positionExtent.z);
+            c.pos[3]      = 0;
+            c.texCoord[0] = quantize(v.texCoord.x, texCoordMin.x, texCoordExtent.x);
+            c.texCoord[1] = quantize(v.texCoord.y, texCoordMin.y, texCoordExtent.y);
+        }
+
+        dequantization =
+        {
+            { positionExtent.x, positionExtent.y, positionExtent.z },
+            { positionMin.x, positionMin.y, positionMin.z },
+            { texCoordExtent.x, texCoordExtent.y },
+            { texCoordMin.x, texCoordMin.y }
+        };
     }
 
     void createVertexBuffer()
     {
+        size_t size;
+        void const * vertices = meshCache_.section(MeshCache::Section::eVertices, &size);
+
+        size_t count;
+        MeshCache::Dequantization const * dequantization =
+            meshCache_.array<MeshCache::Dequantization>(MeshCache::Section::eDequantization, &count);
+        if (count != 1)
+            throw std::runtime_error("createVertexBuffer: mesh cache has no dequantization");
+        dequantization_ = *dequantization;
+
+        MeshCache::Bounds const * bounds = meshCache_.array<MeshCache::Bounds>(MeshCache::Section::eBounds, &count);
+        if (count != 1)
+            throw std::runtime_error("createVertexBuffer: mesh cache has no bounds");
+        glm::vec3 minimum(bounds->min[0], bounds->min[1], bounds->min[2]);
+        glm::vec3 maximum(bounds->max[0], bounds->max[1], bounds->max[2]);
+        modelCenter_ = (minimum + maximum) * 0.5f;
+        modelRadius_ = glm::length(maximum - minimum) * 0.5f;
+
+        std::lock_guard<std::mutex> lock(queueMutex_);
         vertexBuffer_ = Vkx::LocalBuffer(device_,
                                          transientCommandPool_.get(),
                                          graphicsQueue_,
-                                         vertices_.size() * sizeof(vertices_[0]),
+                                         size,
                                          vk::BufferUsageFlagBits::eVertexBuffer,
-                                         vertices_.data());
+                                         vertices);
+    }
+
+    void createIndexBuffer()
+    {
+        size_t size;
+        void const * indices = meshCache_.section(MeshCache::Section::eIndices, &size);
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        indexBuffer_ = Vkx::LocalBuffer(device_,
+                                        transientCommandPool_.get(),
+                                        graphicsQueue_,
+                                        size,
+                                        vk::BufferUsageFlagBits::eIndexBuffer,
+                                        indices);
+
+        size_t count;
+        MeshCache::DrawRange const * ranges = meshCache_.array<MeshCache::DrawRange>(MeshCache::Section::eDrawRanges,
+                                                                                      &count);
+        drawRanges_.assign(ranges, ranges + count);
+
+        MeshCache::Lod const * lods = meshCache_.array<MeshCache::Lod>(MeshCache::Section::eLods, &count);
+        if (count == 0)
+            throw std::runtime_error("createIndexBuffer: mesh cache has no levels of detail");
+        lods_.assign(lods, lods + count);
+    }
+
+    void createMeshletBuffer()
+    {
+        size_t size;
+        void const * meshlets = meshCache_.section(MeshCache::Section::eMeshlets, &size);
+        meshletCount_  = (uint32_t)(size / sizeof(MeshCache::Meshlet));
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        meshletBuffer_ = Vkx::LocalBuffer(device_,
+                                          transientCommandPool_.get(),
+                                          graphicsQueue_,
+                                          size,
+                                          vk::BufferUsageFlagBits::eStorageBuffer,
+                                          meshlets);
+    }
+
+    // Creates the buffer of indirect draw commands, which has a part for each frame context written by the culling
+    // shader each frame
+    void createIndirectBuffer()
+    {
+        vk::DeviceSize alignment = physicalDevice_->getProperties().limits.minStorageBufferOffsetAlignment;
+        indirectStride_ = alignUp(meshletCount_ * sizeof(vk::DrawIndexedIndirectCommand), alignment);
+
+        // Every meshlet starts out culled, until the first frame is drawn.
+        std::vector<uint8_t> commands(indirectStride_ * frames_.size(), 0);
+        vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer;
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        indirectBuffer_ = Vkx::LocalBuffer(device_,
+                                           transientCommandPool_.get(),
+                                           graphicsQueue_,
+                                           commands.size(),
+                                           usage,
+                                           commands.data());
+    }
+
+    // Creates the uniform ring. It is preferably in device-local memory, which the GPU reads faster.
+    void createUniformRing()
+    {
+        vk::DeviceSize alignment = physicalDevice_->getProperties().limits.minUniformBufferOffsetAlignment;
+        vk::DeviceSize frameSize = alignUp(UNIFORM_RING_FRAME_SIZE, alignment);
+        uniformRing_ = UniformRing(createMappedBuffer(frameSize * frames_.size(),
+                                                      vk::BufferUsageFlagBits::eUniformBuffer,
+                                                      vk::MemoryPropertyFlagBits::eDeviceLocal),
+                                   frameSize,
+                                   alignment);
+    }
+
+    // Returns size rounded up to a multiple of alignment, which is a power of two
+    static vk::DeviceSize alignUp(vk::DeviceSize size, vk::DeviceSize alignment)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Creates the feedback buffer, which has a part for each frame context, and a staging buffer for the pages streamed
+    // in before each frame for each frame context
+    void createPageStreamingBuffers()
+    {
+        size_t         entryBytes = (size_t)feedbackSize();
+        size_t         slotBytes  = pageSlotBytes();
+        vk::DeviceSize alignment  = physicalDevice_->getProperties().limits.minStorageBufferOffsetAlignment;
+        feedbackStride_ = alignUp(entryBytes, alignment);
+        feedbackBuffer_ = createMappedBuffer(feedbackStride_ * frames_.size(),
+                                             vk::BufferUsageFlagBits::eStorageBuffer |
+                                             vk::BufferUsageFlagBits::eTransferDst);
+        memset(feedbackBuffer_.data, 0, feedbackStride_ * frames_.size());
+
+        pageUploads_.clear();
+        pageUploads_.resize(frames_.size());
+        for (auto & upload : pageUploads_)
+        {
+            upload.staging = createMappedBuffer(MAX_PAGE_UPLOADS * slotBytes + entryBytes);
+        }
+    }
+
+    void createDescriptorPool()
+    {
+        uint32_t               samplers              = virtualTexturesReady_ ? 1 : (uint32_t)textureViews_.size();
+        uint32_t               storageBuffers        = virtualTexturesReady_ ? 3 : 1;
+        uint32_t               dynamicStorageBuffers = virtualTexturesReady_ ? 2 : 1;
+        vk::DescriptorPoolSize poolSizes[] =
+        {
+            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 2),
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, samplers),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, storageBuffers),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBufferDynamic, dynamicStorageBuffers)
+        };
+
+        // One set for drawing and one for culling, shared by every frame
+        descriptorPool_ = device_->createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo({}, 2, 4, poolSizes));
+    }
+
+    // Creates the descriptor sets. The buffers that have a part for each frame context are bound with the size of a
+    // part, and the part is selected by the dynamic offset when the sets are bound.
+    void createDescriptorSets()
+    {
+        descriptorSet_ = device_->allocateDescriptorSets(
+            vk::DescriptorSetAllocateInfo(descriptorPool_.get(), 1, &descriptorSetLayout_.get()))[0];
+        vk::DescriptorBufferInfo uboInfo(uniformRing_.buffer(), 0, sizeof(UniformBufferObject));
+        vk::WriteDescriptorSet   writeDescriptorSet(descriptorSet_,
+                                                    0,
+                                                    0,
+                                                    1,
+                                                    vk::DescriptorType::eUniformBufferDynamic,
+                                                    nullptr,
+                                                    &uboInfo,
+                                                    nullptr);
+        device_->updateDescriptorSets(1, &writeDescriptorSet, 0, nullptr);
+        if (virtualTexturesReady_)
+            writeVirtualTextureDescriptors();
+        else
+            writeTextureDescriptors();
+
+        cullDescriptorSet_ = device_->allocateDescriptorSets(
+            vk::DescriptorSetAllocateInfo(descriptorPool_.get(), 1, &cullDescriptorSetLayout_.get()))[0];
+        vk::DescriptorBufferInfo meshletInfo(meshletBuffer_, 0, VK_WHOLE_SIZE);
+        vk::DescriptorBufferInfo commandInfo(indirectBuffer_,
+                                             0,
+                                             meshletCount_ * sizeof(vk::DrawIndexedIndirectCommand));
+        std::array<vk::WriteDescriptorSet, 3> writeDescriptorSets =
+        {
+            vk::WriteDescriptorSet(cullDescriptorSet_,
+                                   0,
+                                   0,
+                                   1,
+                                   vk::DescriptorType::eUniformBufferDynamic,
+                                   nullptr,
+                                   &uboInfo,
+                                   nullptr),
+            vk::WriteDescriptorSet(cullDescriptorSet_,
+                                   1,
+                                   0,
+                                   1,
+                                   vk::DescriptorType::eStorageBuffer,
+                                   nullptr,
+                                   &meshletInfo,
+                                   nullptr),
+            vk::WriteDescriptorSet(cullDescriptorSet_,
+                                   2,
+                                   0,
+                                   1,
+                                   vk::DescriptorType::eStorageBufferDynamic,
+                                   nullptr,
+                                   &commandInfo,
+                                   nullptr)
+        };
+        device_->updateDescriptorSets((uint32_t)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+    }
+
+    // Points the texture array of the descriptor set at the current texture views
+    void writeTextureDescriptors()
+    {
+        std::vector<vk::DescriptorImageInfo> imageInfos;
+        for (auto const & view : textureViews_)
+        {
+            imageInfos.emplace_back(textureSampler_.get(), view, vk::ImageLayout::eShaderReadOnlyOptimal);
+        }
+        vk::WriteDescriptorSet writeDescriptorSet(descriptorSet_,
+                                                  1,
+                                                  0,
+                                                  (uint32_t)imageInfos.size(),
+                                                  vk::DescriptorType::eCombinedImageSampler,
+                                                  imageInfos.data(),
+                                                  nullptr,
+                                                  nullptr);
+        device_->updateDescriptorSets(1, &writeDescriptorSet, 0, nullptr);
+    }
+
+    // Points the descriptor set at the page cache, the virtual textures and their page table, and the feedback buffer
+    void writeVirtualTextureDescriptors()
+    {
+        vk::DescriptorImageInfo  cacheInfo(pageCacheSampler_.get(),
+                                           *pageCache_.view,
+                                           vk::ImageLayout::eShaderReadOnlyOptimal);
+        vk::DescriptorBufferInfo texturesInfo(virtualTextureBuffer_, 0, VK_WHOLE_SIZE);
+        vk::DescriptorBufferInfo pageTableInfo(pageTableBuffer_, 0, VK_WHOLE_SIZE);
+        vk::DescriptorBufferInfo feedbackInfo(*feedbackBuffer_.buffer, 0, feedbackSize());
+        std::array<vk::WriteDescriptorSet, 4> writeDescriptorSets =
+        {
+            vk::WriteDescriptorSet(descriptorSet_,
+                                   1,
+                                   0,
+                                   1,
+                                   vk::DescriptorType::eCombinedImageSampler,
+                                   &cacheInfo,
+                                   nullptr,
+                                   nullptr),
+            vk::WriteDescriptorSet(descriptorSet_,
+                                   2,
+                                   0,
+                                   1,
+                                   vk::DescriptorType::eStorageBuffer,
+                                   nullptr,
+                                   &texturesInfo,
+                                   nullptr),
+            vk::WriteDescriptorSet(descriptorSet_,
+                                   3,
+                                   0,
+                                   1,
+                                   vk::DescriptorType::eStorageBuffer,
+                                   nullptr,
+                                   &pageTableInfo,
+                                   nullptr),
+            vk::WriteDescriptorSet(descriptorSet_,
+                                   4,
+                                   0,
+                                   1,
+                                   vk::DescriptorType::eStorageBufferDynamic,
+                                   nullptr,
+                                   &feedbackInfo,
+                                   nullptr)
+        };
+        device_->updateDescriptorSets((uint32_t)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
     }
 
-    void createIndexBuffer()
+    // Returns the size of a frame's part of the feedback buffer that is used, which has an element per page table entry
+    vk::DeviceSize feedbackSize() const
     {
-        indexBuffer_ = Vkx::LocalBuffer(device_,
-                                        transientCommandPool_.get(),
-                                        graphicsQueue_,
-                                        indices_.size() * sizeof(indices_[0]),
-                                        vk::BufferUsageFlagBits::eIndexBuffer,
-                                        indices_.data());
+        return virtualTextures_->pageTable().size() * sizeof(uint32_t);
     }
 
-    void createUniformBuffers()
+    // Records the commands of a frame in its context's command buffer: the pages streamed in, the culling of the
+    // meshlets and the draws of a level of detail, which are recorded in secondary command buffers. Until the model is
+    // loaded, the frame is only cleared.
+    void recordFrame(size_t f, uint32_t swapIndex, size_t lod, uint32_t uniformOffset)
     {
-        size_t size = sizeof(UniformBufferObject);
-        uniformBuffers_.reserve(swapChain_->size());
+        vk::CommandBuffer buffer = *frames_[f].commands;
+        vk::Extent2D      extent = swapChain_->extent();
+        std::array<vk::ClearValue, 2> clearValues =
+        {
+            vk::ClearColorValue(std::array<float, 4> { 0.0f, 0.0f, 0.0f, 1.0f }),
+            vk::ClearDepthStencilValue(1.0f, 0)
+        };
+        vk::RenderPassBeginInfo renderPassInfo(*renderPass_,
+                                               *framebuffers_[swapIndex],
+                                               {{ 0, 0 }, extent },
+                                               (uint32_t)clearValues.size(),
+                                               clearValues.data());
+
+        buffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        if (!modelReady_)
+        {
+            buffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+            buffer.endRenderPass();
+            buffer.end();
+            return;
+        }
 
-        for (size_t i = 0; i < swapChain_->size(); ++i)
+        if (virtualTexturesReady_)
+        {
+            PageUpload const & upload = pageUploads_[f];
+            if (!upload.pages.empty() || upload.entries.size > 0)
+                recordPageUploads(buffer, upload, vk::ImageLayout::eShaderReadOnlyOptimal);
+            recordFeedbackClear(buffer, f);
+        }
+        MeshCache::Lod const & level = lods_[lod];
+        if (options_.clusterCulling)
+            recordCulling(buffer, f, uniformOffset, level);
+
+        auto                           recordStart = std::chrono::steady_clock::now();
+        uint32_t                       drawCount;
+        std::vector<vk::CommandBuffer> draws = recordDraws(f, swapIndex, uniformOffset, level, drawCount);
+        frameStats_.recordTimeSum +=
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+        frameStats_.drawSum         += drawCount;
+        frameStats_.recordThreadSum += draws.size();
+        ++frameStats_.recordCount;
+
+        buffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+        buffer.executeCommands((uint32_t)draws.size(), draws.data());
+        buffer.endRenderPass();
+        if (virtualTexturesReady_)
         {
-            uniformBuffers_.emplace_back(device_, size, vk::BufferUsageFlagBits::eUniformBuffer);
+            // The feedback is read back once the frame is done.
+            buffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader,
+                                   vk::PipelineStageFlagBits::eHost,
+                                   {},
+                                   vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead),
+                                   nullptr,
+                                   nullptr);
         }
+        buffer.end();
     }
 
-    void createDescriptorPool()
+    // Records the draws of a level of detail in secondary command buffers of the frame's recorders. The draw ranges are
+    // split into consecutive parts with about the same number of draw commands, and each part is recorded by a member
+    // of recordTeam_, unless there are too few draw commands to be worth it. Returns the buffers to execute in order,
+    // and sets drawCount to the number of draw commands.
+    std::vector<vk::CommandBuffer> recordDraws(size_t                 f,
+                                               uint32_t               swapIndex,
+                                               uint32_t               uniformOffset,
+                                               MeshCache::Lod const & level,
+                                               uint32_t &             drawCount)
     {
-        vk::DescriptorPoolSize poolSizes[] =
+        uint32_t first = level.firstDrawRange;
+        uint32_t end   = level.firstDrawRange + level.drawRangeCount;
+        drawCount = 0;
+        for (uint32_t r = first; r < end; ++r)
         {
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, (uint32_t)swapChain_->size()),
-            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, (uint32_t)swapChain_->size())
-        };
-        descriptorPool_ = device_->createDescriptorPoolUnique(
-            vk::DescriptorPoolCreateInfo({}, (uint32_t)swapChain_->size(), 2, poolSizes));
-    }
+            drawCount += drawCommandCount(drawRanges_[r]);
+        }
 
-    void createDescriptorSets()
-    {
-        std::vector<vk::DescriptorSetLayout> layouts(swapChain_->size(), descriptorSetLayout_.get());
-        descriptorSets_ = device_->allocateDescriptorSets(
-            vk::DescriptorSetAllocateInfo(descriptorPool_.get(), (uint32_t)layouts.size(), layouts.data()));
-        for (size_t i = 0; i < swapChain_->size(); ++i)
+        // A part ends once it reaches its share of the draw commands. A range is never split, so there may be fewer
+        // parts than threads.
+        std::vector<DrawRecorder> & recorders = frames_[f].recorders;
+        uint32_t wanted = std::max<uint32_t>(1, drawCount / DRAWS_PER_RECORD_THREAD);
+        uint64_t parts  = std::min<uint64_t>(recorders.size(), wanted);
+        std::vector<uint32_t> bounds(1, first);
+        uint64_t count = 0;
+        for (uint32_t r = first; r + 1 < end && bounds.size() < parts; ++r)
         {
-            vk::DescriptorBufferInfo uboInfo(uniformBuffers_[i], 0, sizeof(UniformBufferObject));
-            vk::DescriptorImageInfo  imageInfo(textureSampler_.get(),
-                                               textureImage_.view(),
-                                               vk::ImageLayout::eShaderReadOnlyOptimal);
-            std::array<vk::WriteDescriptorSet, 2> writeDescriptorSets =
-            {
-                vk::WriteDescriptorSet(descriptorSets_[i],
-                                       0,
-                                       0,
-                                       1,
-                                       vk::DescriptorType::eUniformBuffer,
-                                       nullptr,
-                                       &uboInfo,
-                                       nullptr),
-                vk::WriteDescriptorSet(descriptorSets_[i],
-                                       1,
-                                       0,
-                                       1,
-                                       vk::DescriptorType::eCombinedImageSampler,
-                                       &imageInfo,
-                                       nullptr,
-                                       nullptr),
-            };
-            device_->updateDescriptorSets((uint32_t)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+            count += drawCommandCount(drawRanges_[r]);
+            if (count * parts >= (uint64_t)drawCount * bounds.size())
+                bounds.push_back(r + 1);
         }
+        bounds.push_back(end);
+
+        size_t                         partCount = bounds.size() - 1;
+        std::vector<vk::CommandBuffer> buffers(partCount);
+        recordTeam_->run(partCount, [&] (size_t p) {
+            DrawRecorder & recorder = recorders[p];
+            device_->resetCommandPool(*recorder.commandPool, {});
+            recordDrawRanges(*recorder.commands, f, swapIndex, uniformOffset, bounds[p], bounds[p + 1]);
+            buffers[p] = *recorder.commands;
+        });
+        return buffers;
     }
 
-    void createCommandBuffers()
+    // Returns the number of draw commands recorded for a draw range
+    uint32_t drawCommandCount(MeshCache::DrawRange const & range) const
     {
-        commandBuffers_ = device_->allocateCommandBuffersUnique(
-            vk::CommandBufferAllocateInfo(*graphicsCommandPool_,
-                                          vk::CommandBufferLevel::ePrimary,
-                                          (uint32_t)swapChain_->size()));
+        return options_.clusterCulling && !multiDrawIndirect_ ? range.meshletCount : 1;
+    }
+
+    // Records the draws of the draw ranges [first, end) in a secondary command buffer that continues the frame's render
+    // pass. A secondary command buffer inherits none of the primary's state, so all of it is set.
+    void recordDrawRanges(vk::CommandBuffer buffer,
+                          size_t            f,
+                          uint32_t          swapIndex,
+                          uint32_t          uniformOffset,
+                          uint32_t          first,
+                          uint32_t          end)
+    {
+        vk::CommandBufferInheritanceInfo inheritance(*renderPass_, 0, *framebuffers_[swapIndex]);
+        buffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+                                                    vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+                                                &inheritance));
 
+        vk::Extent2D   extent = swapChain_->extent();
         vk::Buffer     vertexBuffers[] = { vertexBuffer_ };
         vk::DeviceSize offsets[]       = { 0 };
-        std::array<vk::ClearValue, 2> clearValues =
+        vk::Viewport   viewport(0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f);
+        vk::Rect2D     scissor({ 0, 0 }, extent);
+        buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline_);
+        buffer.setViewport(0, viewport);
+        buffer.setScissor(0, scissor);
+        buffer.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+        uint32_t dynamicOffsets[] = { uniformOffset, (uint32_t)(f * feedbackStride_) };
+        buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                  pipelineLayout_.get(),
+                                  0,
+                                  1,
+                                  &descriptorSet_,
+                                  virtualTexturesReady_ ? 2 : 1,
+                                  dynamicOffsets);
+
+        // The draw ranges are sorted by texture, and all of the textures are bound, so the only state that changes
+        // between batches is the texture index.
+        uint32_t texture = std::numeric_limits<uint32_t>::max();
+        for (uint32_t r = first; r < end; ++r)
         {
-            vk::ClearColorValue(std::array<float, 4> { 0.0f, 0.0f, 0.0f, 1.0f }),
-            vk::ClearDepthStencilValue(1.0f, 0)
-        };
+            MeshCache::DrawRange const & range = drawRanges_[r];
+            if (range.texture != texture)
+            {
+                texture = range.texture;
+                MaterialPushConstants material = { texture };
+                buffer.pushConstants(pipelineLayout_.get(),
+                                     vk::ShaderStageFlagBits::eFragment,
+                                     0,
+                                     sizeof(material),
+                                     &material);
+            }
+            vk::IndexType type = range.indexSize == sizeof(uint16_t) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+            buffer.bindIndexBuffer(indexBuffer_, range.offset, type);
+            if (options_.clusterCulling)
+                recordIndirectDraws(buffer, f, range);
+            else
+                buffer.drawIndexed(range.count, 1, 0, range.vertexOffset, 0);
+        }
+        buffer.end();
+    }
 
-        int i = 0;
-        for (auto & buffer : commandBuffers_)
-        {
-            buffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eSimultaneousUse));
-            buffer->beginRenderPass(
-                vk::RenderPassBeginInfo(*renderPass_,
-                                        *framebuffers_[i],
-                                        {{ 0, 0 }, swapChain_->extent() },
-                                        (uint32_t)clearValues.size(),
-                                        clearValues.data()),
-                vk::SubpassContents::eInline);
-            buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline_);
-            buffer->bindVertexBuffers(0, 1, vertexBuffers, offsets);
-            buffer->bindIndexBuffer(indexBuffer_, 0, vk::IndexType::eUint32);
-            buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                                       pipelineLayout_.get(), 0, 1, &descriptorSets_[i], 0, nullptr);
-            buffer->drawIndexed((uint32_t)indices_.size(), 1, 0, 0, 0);
-            buffer->endRenderPass();
-            buffer->end();
-            ++i;
+    // Records the dispatch of the culling shader, which writes the indirect draw commands of a level of detail
+    void recordCulling(vk::CommandBuffer buffer, size_t f, uint32_t uniformOffset, MeshCache::Lod const & lod)
+    {
+        // The previous frame's draws must be done reading the commands before they are overwritten.
+        buffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect,
+                               vk::PipelineStageFlagBits::eComputeShader,
+                               {},
+                               0, nullptr,
+                               0, nullptr,
+                               0, nullptr);
+
+        buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *cullPipeline_);
+        uint32_t offsets[] = { uniformOffset, (uint32_t)(f * indirectStride_) };
+        buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                  cullPipelineLayout_.get(), 0, 1, &cullDescriptorSet_, 2, offsets);
+        CullPushConstants range = { lod.firstMeshlet, lod.meshletCount };
+        buffer.pushConstants(cullPipelineLayout_.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(range), &range);
+        buffer.dispatch((lod.meshletCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+        vk::BufferMemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite,
+                                        vk::AccessFlagBits::eIndirectCommandRead,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        indirectBuffer_,
+                                        f * indirectStride_,
+                                        indirectStride_);
+        buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                               vk::PipelineStageFlagBits::eDrawIndirect,
+                               {},
+                               0, nullptr,
+                               1, &barrier,
+                               0, nullptr);
+    }
+
+    // Records the clearing of a frame context's part of the feedback buffer, before the frame reports its pages
+    void recordFeedbackClear(vk::CommandBuffer buffer, size_t f)
+    {
+        buffer.fillBuffer(*feedbackBuffer_.buffer, f * feedbackStride_, feedbackSize(), 0);
+        vk::BufferMemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,
+                                        vk::AccessFlagBits::eShaderWrite,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        *feedbackBuffer_.buffer,
+                                        f * feedbackStride_,
+                                        feedbackSize());
+        buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                               vk::PipelineStageFlagBits::eFragmentShader,
+                               {},
+                               0, nullptr,
+                               1, &barrier,
+                               0, nullptr);
+    }
+
+    // Records the indirect draws of the meshlets in a draw range. A culled meshlet has an instance count of 0.
+    void recordIndirectDraws(vk::CommandBuffer buffer, size_t f, MeshCache::DrawRange const & range)
+    {
+        uint32_t constexpr STRIDE = sizeof(vk::DrawIndexedIndirectCommand);
+        vk::DeviceSize offset = f * indirectStride_ + (vk::DeviceSize)range.firstMeshlet * STRIDE;
+        if (multiDrawIndirect_)
+        {
+            buffer.drawIndexedIndirect(indirectBuffer_, offset, range.meshletCount, STRIDE);
+        }
+        else
+        {
+            for (uint32_t m = 0; m < range.meshletCount; ++m)
+            {
+                buffer.drawIndexedIndirect(indirectBuffer_, offset + (vk::DeviceSize)m * STRIDE, 1, STRIDE);
+            }
         }
     }
 
     void drawFrame(Vkx::Camera const & camera)
     {
+        // Everything in the frame's context was last used by the frame options_.framesInFlight frames ago, which must
+        // be done.
+        size_t         f     = (size_t)(frameNumber_ % frames_.size());
+        FrameContext & frame = frames_[f];
+        checkFramesDone();
+        device_->waitForFences(*frame.inFlight, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        checkFramesDone();
+        releaseRetiredSwapChains();
+
         uint32_t swapIndex;
         try
         {
-            swapIndex = swapChain_->swap();
+            swapIndex = device_->acquireNextImageKHR(swapChain_->handle(),
+                                                     std::numeric_limits<uint64_t>::max(),
+                                                     *frame.imageAvailable,
+                                                     vk::Fence()).value;
         }
         catch (vk::OutOfDateKHRError &)
         {
@@ -945,37 +3322,158 @@ private:
             return;
         }
 
-        updateUniformBuffer(camera, swapIndex);
+        frame.started = std::chrono::steady_clock::now();
+        size_t   lod           = 0;
+        uint32_t uniformOffset = 0;
+        if (modelReady_)
+        {
+            uniformRing_.begin(f);
+            UniformBufferObject ubo = updateUniformBuffer(camera, uniformOffset);
+            lod = selectLod(ubo);
+        }
+        if (virtualTexturesReady_)
+            streamPages(f);
+
+        device_->resetCommandPool(*frame.commandPool, {});
+        recordFrame(f, swapIndex, lod, uniformOffset);
 
+        // The loaders upload through the same queues.
+        std::unique_lock<std::mutex> lock(queueMutex_);
         vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
         vk::SubmitInfo         submitInfo(1,
-                                          &swapChain_->imageAvailable(),
+                                          &frame.imageAvailable.get(),
                                           &waitStage,
                                           1,
-                                          &(*commandBuffers_[swapIndex]),
+                                          &frame.commands.get(),
                                           1,
-                                          &swapChain_->renderFinished());
-        graphicsQueue_.submit(1, &submitInfo, swapChain_->inFlight());
+                                          &frame.renderFinished.get());
+        device_->resetFences(*frame.inFlight);
+        graphicsQueue_.submit(1, &submitInfo, *frame.inFlight);
+        frame.pending = true;
+        ++frameNumber_;
 
+        bool recreate = false;
         try
         {
-            std::array<vk::SwapchainKHR, 1> swapChains = { *swapChain_ };
+            std::array<vk::SwapchainKHR, 1> swapChains = { swapChain_->handle() };
             vk::Result result = presentQueue_.presentKHR(
                 vk::PresentInfoKHR(1,
-                                   &swapChain_->renderFinished(),
+                                   &frame.renderFinished.get(),
                                    (uint32_t)swapChains.size(),
                                    swapChains.data(),
                                    &swapIndex));
-            if (result == vk::Result::eSuboptimalKHR || framebufferSizeChanged_)
-                recreateSwapChain();
+            recreate = result == vk::Result::eSuboptimalKHR || framebufferSizeChanged_;
         }
         catch (vk::OutOfDateKHRError &)
         {
+            recreate = true;
+        }
+        lock.unlock();
+
+        if (!firstFrameDrawn_)
+        {
+            firstFrameDrawn_ = true;
+            reportLoadTime("first frame");
+        }
+        reportFrameStats(frame.started);
+        if (recreate)
             recreateSwapChain();
+    }
+
+    // Records the latency of the frames that have finished since the last check. The latency is the time from when the
+    // CPU started a frame until the GPU was seen to be done with it, so it is only as precise as the checks are
+    // frequent.
+    void checkFramesDone()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (FrameContext & frame : frames_)
+        {
+            if (frame.pending && device_->getFenceStatus(*frame.inFlight) == vk::Result::eSuccess)
+            {
+                double latency = std::chrono::duration<double, std::milli>(now - frame.started).count();
+                frameStats_.latencySum += latency;
+                frameStats_.latencyMax  = std::max(frameStats_.latencyMax, latency);
+                ++frameStats_.latencyCount;
+                frame.pending = false;
+            }
+        }
+    }
+
+    // Accumulates the time between the starts of successive frames, and prints the averages every
+    // FRAME_STATS_INTERVAL frames
+    void reportFrameStats(std::chrono::steady_clock::time_point started)
+    {
+        if (frameStats_.frameCount > 0)
+        {
+            frameStats_.frameTimeSum +=
+                std::chrono::duration<double, std::milli>(started - frameStats_.lastStarted).count();
+        }
+        frameStats_.lastStarted = started;
+        if (++frameStats_.frameCount <= FRAME_STATS_INTERVAL)
+            return;
+
+        std::cout << "drawFrame: " << frames_.size() << " frame(s) in flight, "
+                  << frameStats_.frameTimeSum / (double)(frameStats_.frameCount - 1) << " ms per frame, latency "
+                  << frameStats_.latencySum / (double)std::max<uint64_t>(frameStats_.latencyCount, 1) << " ms (max "
+                  << frameStats_.latencyMax << " ms)" << std::endl;
+        if (frameStats_.recordCount > 0)
+        {
+            double frames = (double)frameStats_.recordCount;
+            std::cout << "recordFrame: " << (double)frameStats_.drawSum / frames << " draw commands on "
+                      << (double)frameStats_.recordThreadSum / frames << " thread(s), "
+                      << frameStats_.recordTimeSum / frames << " ms recording" << std::endl;
+        }
+        frameStats_ = FrameStats();
+        frameStats_.lastStarted = started;
+        frameStats_.frameCount  = 1;
+    }
+
+    // Reads back the pages sampled by the frame that last used a frame context, which is done, and stages the pages
+    // that have been read since the last frame along with the page table entries that changed
+    void streamPages(size_t f)
+    {
+        PageUpload & upload = pageUploads_[f];
+        uint8_t const * feedback = feedbackBuffer_.data + f * feedbackStride_;
+        virtualTextures_->request(reinterpret_cast<uint32_t const *>(feedback), frameNumber_);
+
+        size_t dirtyBegin;
+        size_t dirtyEnd;
+        std::vector<VirtualTextures::Page> pages = virtualTextures_->update(MAX_PAGE_UPLOADS,
+                                                                            frameNumber_,
+                                                                            dirtyBegin,
+                                                                            dirtyEnd);
+        stagePages(pages, upload);
+
+        size_t entriesOffset = MAX_PAGE_UPLOADS * pageSlotBytes();
+        size_t entriesSize   = (dirtyEnd - dirtyBegin) * sizeof(uint32_t);
+        memcpy(upload.staging.data + entriesOffset, virtualTextures_->pageTable().data() + dirtyBegin, entriesSize);
+        upload.entries = vk::BufferCopy(entriesOffset, dirtyBegin * sizeof(uint32_t), entriesSize);
+    }
+
+    // Returns the coarsest level of detail whose error, projected onto the screen, is within the threshold
+    size_t selectLod(UniformBufferObject const & ubo) const
+    {
+        // The error is projected from the nearest point of the bounding sphere, so it is never underestimated. A
+        // camera inside the sphere always gets full detail.
+        float distance = glm::length(glm::vec3(ubo.cameraPosition) - modelCenter_) - modelRadius_;
+        if (distance <= 0.0f)
+            return 0;
+
+        // projection[1][1] is the cotangent of half the vertical field of view, so a length d at distance z covers
+        // d * projection[1][1] / z half-heights of the viewport.
+        float pixelsPerUnit = std::abs(ubo.projection[1][1]) * 0.5f * (float)swapChain_->extent().height / distance;
+
+        size_t lod = 0;
+        while (lod + 1 < lods_.size() && lods_[lod + 1].error * pixelsPerUnit <= options_.lodThreshold)
+        {
+            ++lod;
         }
+        return lod;
     }
 
-    void updateUniformBuffer(Vkx::Camera const & camera, int index)
+    // Writes the frame's uniforms to the uniform ring and returns them. `offset` is set to the dynamic offset to bind
+    // them with.
+    UniformBufferObject updateUniformBuffer(Vkx::Camera const & camera, uint32_t & offset)
     {
         static auto startTime = std::chrono::high_resolution_clock::now();
 
@@ -987,17 +3485,39 @@ private:
         ubo.view       = camera.view();
         ubo.projection = camera.projection();
 
-        uniformBuffers_[index].set(0, &ubo, sizeof(ubo));
-    }
+        MeshCache::Dequantization const & d = dequantization_;
+        ubo.positionScale       = glm::vec4(d.positionScale[0], d.positionScale[1], d.positionScale[2], 0.0f);
+        ubo.positionOffset      = glm::vec4(d.positionOffset[0], d.positionOffset[1], d.positionOffset[2], 0.0f);
+        ubo.texCoordScaleOffset = glm::vec4(d.texCoordScale[0], d.texCoordScale[1],
+                                            d.texCoordOffset[0], d.texCoordOffset[1]);
+
+        // The meshlets are culled in model space. The planes are extracted from the rows of the combined matrix. The
+        // near plane is w + z > 0, which is conservative for both the [0, 1] and [-1, 1] depth conventions.
+        glm::mat4 clip = ubo.projection * ubo.view * ubo.model;
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+        }
+        glm::vec4 planes[6] =
+        {
+            rows[3] + rows[0], rows[3] - rows[0],
+            rows[3] + rows[1], rows[3] - rows[1],
+            rows[3] + rows[2], rows[3] - rows[2]
+        };
+        for (int p = 0; p < 6; ++p)
+        {
+            ubo.frustumPlanes[p] = planes[p] / glm::length(glm::vec3(planes[p]));
+        }
 
-    void resetSwapChain()
-    {
-        framebuffers_.clear();
-        commandBuffers_.clear();
-        graphicsPipeline_.reset();
-        pipelineLayout_.reset();
-        renderPass_.reset();
-        swapChain_.reset();
+        // The pipeline's front faces are counter-clockwise in the framebuffer, which has y down. A model-space
+        // counter-clockwise triangle facing the camera stays counter-clockwise there only if the projection flips
+        // exactly one of x and y.
+        float frontFace = ubo.projection[0][0] * ubo.projection[1][1] < 0.0f ? 1.0f : -1.0f;
+        ubo.cameraPosition = glm::vec4(glm::vec3(glm::inverse(ubo.view * ubo.model)[3]), frontFace);
+
+        memcpy(uniformRing_.allocate(sizeof(ubo), offset), &ubo, sizeof(ubo));
+        return ubo;
     }
 
     void recreateSwapChain()
@@ -1010,19 +3530,50 @@ private:
             window_->framebufferSize(width, height);
         }
 
-        vkDeviceWaitIdle(*device_);
+        // The images are created through the queue that the loaders share.
+        std::lock_guard<std::mutex> lock(queueMutex_);
 
-        resetSwapChain();
+        // The frames drawn to the old swap chain may still be in flight, so it is kept until they are done, along with
+        // everything that refers to its images.
+        retiredSwapChains_.push_back({ std::move(swapChain_),
+                                       std::move(framebuffers_),
+                                       std::move(resolveImage_),
+                                       std::move(depthImage_),
+                                       frameNumber_ });
+        framebuffers_.clear();
+        RetiredSwapChain const & old = retiredSwapChains_.back();
 
-        createSwapChain();
-        createRenderPass();
-        createGraphicsPipeline();
+        createSwapChain(old.swapChain->handle());
         createColorResources();
         createDepthResources();
+
+        // The viewport and the scissor are dynamic, so the render pass and the pipeline only depend on the format of
+        // the images. If it changes, they are replaced, which cannot be done while they are in use.
+        if (swapChain_->format() != old.swapChain->format())
+        {
+            device_->waitIdle();
+            retiredSwapChains_.clear();
+            graphicsPipeline_.reset();
+            renderPass_.reset();
+            createRenderPass();
+            if (modelReady_)
+                createGraphicsPipeline();   // There is none until the model is loaded
+        }
         createFramebuffers();
-        createCommandBuffers();
     }
 
+    // Destroys the swap chains whose frames are done. Once the fence of every frame context has been waited for since
+    // a swap chain was replaced, the frames drawn to it are done.
+    void releaseRetiredSwapChains()
+    {
+        while (!retiredSwapChains_.empty() &&
+               retiredSwapChains_.front().retiredAt + frames_.size() <= frameNumber_)
+        {
+            retiredSwapChains_.pop_front();
+        }
+    }
+
+    Options options_;
     std::unique_ptr<Glfwx::Window> window_ = nullptr;
     std::shared_ptr<Vkx::Instance> instance_;
     vk::DispatchLoaderDynamic dynamicLoader_;
@@ -1035,35 +3586,490 @@ private:
     vk::Queue graphicsQueue_;
     vk::Queue presentQueue_;
     vk::UniqueSurfaceKHR surface_;
-    std::shared_ptr<Vkx::SwapChain> swapChain_;
+    std::shared_ptr<SwapChain> swapChain_;
     vk::UniqueRenderPass renderPass_;
     vk::UniqueDescriptorSetLayout descriptorSetLayout_;
     vk::UniquePipelineLayout pipelineLayout_;
+    vk::UniquePipelineCache pipelineCache_;     // Shared by every pipeline, and saved when the application exits
     vk::UniquePipeline graphicsPipeline_;
     std::vector<vk::UniqueFramebuffer> framebuffers_;
-    vk::UniqueCommandPool graphicsCommandPool_;
     vk::UniqueCommandPool transientCommandPool_;
     Vkx::ResolveImage resolveImage_;
     Vkx::DepthImage depthImage_;
-    Vkx::LocalImage textureImage_;
+    Vkx::LocalImage placeholderImage_;
+    std::vector<Texture> textureImages_;
+    std::vector<vk::ImageView> textureViews_;  // One per texture in the mesh cache, some may share an image
     vk::UniqueSampler textureSampler_;
-    std::vector<Vertex> vertices_;
-    std::vector<uint32_t> indices_;
+    Texture pageCache_;                         // The slots the pages of the virtual textures are streamed into
+    vk::UniqueSampler pageCacheSampler_;
+    Vkx::LocalBuffer virtualTextureBuffer_;     // A VirtualTextures::Texture for each of the model's textures
+    Vkx::LocalBuffer pageTableBuffer_;
+    std::unique_ptr<VirtualTextures> virtualTextures_;
+    MappedBuffer feedbackBuffer_;               // A part for each frame context
+    vk::DeviceSize feedbackStride_ = 0;
+    std::vector<PageUpload> pageUploads_;       // One per frame context
+    bool virtualTexturesReady_ = false;
+    uint64_t frameNumber_ = 0;
+    MeshCache meshCache_;
+    std::vector<MeshCache::DrawRange> drawRanges_;
+    std::vector<MeshCache::Lod> lods_;
+    glm::vec3 modelCenter_;
+    float modelRadius_ = 0.0f;
+    uint32_t meshletCount_ = 0;
+    MeshCache::Dequantization dequantization_;
     Vkx::LocalBuffer vertexBuffer_;
     Vkx::LocalBuffer indexBuffer_;
-    std::vector<Vkx::HostBuffer> uniformBuffers_;
+    Vkx::LocalBuffer meshletBuffer_;
+    UniformRing uniformRing_;
+    Vkx::LocalBuffer indirectBuffer_;           // A part for each frame context
+    vk::DeviceSize indirectStride_ = 0;
     vk::UniqueDescriptorPool descriptorPool_;
-    std::vector<vk::DescriptorSet> descriptorSets_;
-    std::vector<vk::UniqueCommandBuffer> commandBuffers_;
+    vk::DescriptorSet descriptorSet_;
+    vk::UniqueDescriptorSetLayout cullDescriptorSetLayout_;
+    vk::UniquePipelineLayout cullPipelineLayout_;
+    vk::UniquePipeline cullPipeline_;
+    vk::DescriptorSet cullDescriptorSet_;
+    bool multiDrawIndirect_ = false;
+    uint32_t supportedTextureFormats_ = 0;  // Bit (1 << TextureFormat) is set for each usable format
+    std::vector<FrameContext> frames_;
+    std::unique_ptr<ThreadTeam> recordTeam_;    // Records the parts of each frame's draws, started once
+    FrameStats frameStats_;
+    std::deque<RetiredSwapChain> retiredSwapChains_;   // Oldest first
     bool framebufferSizeChanged_ = false;
+
+    // Background loading. The loaders only touch the members describing the model and the textures until their futures
+    // are ready. The queues and the transient command pool are shared with them and are guarded by queueMutex_.
+    std::chrono::steady_clock::time_point startTime_;
+    std::mutex queueMutex_;
+    std::vector<std::string> texturePaths_;
+    std::vector<vk::ImageView> loadedTextureViews_;
+    bool modelReady_      = false;
+    bool firstFrameDrawn_ = false;
+    std::future<void> modelLoad_;   // Last, so that they are waited for before anything they use is destroyed
+    std::future<void> textureLoad_;
 };
 
-int main()
+// Times the serial OBJ parser and the parallel parser with an increasing number of threads, and checks that the
+// results are the same. The serial parser uses the original tokenizer, which copies each line, and the parallel parser
+// uses the in-place tokenizer, but both convert numbers with the same function, so the results must match exactly.
+void benchmarkLoad(Options const & options)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Result
+    {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t>    shapes;
+        std::vector<tinyobj::material_t> materials;
+        double milliseconds;
+    };
+
+    // With 0 threads, the file is read through a std::ifstream by the original parser. Otherwise it is mapped and
+    // parsed in place.
+    char const * path = options.modelPath.c_str();
+    auto load = [path] (unsigned threads, bool populate) {
+        Result result;
+        std::string warn, err;
+        auto start = Clock::now();
+        bool ok;
+        if (threads == 0)
+        {
+            std::ifstream               stream(path);
+            tinyobj::MaterialFileReader materialReader("");
+            ok = stream && tinyobj::LoadObj(&result.attrib, &result.shapes, &result.materials, &warn, &err,
+                                            &stream, &materialReader);
+        }
+        else
+        {
+            ok = tinyobj::LoadObjParallel(&result.attrib, &result.shapes, &result.materials, &warn, &err,
+                                          path, nullptr, true, true, threads, populate);
+        }
+        result.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (!ok)
+            throw std::runtime_error(warn + err);
+        return result;
+    };
+
+    // Returns true if the arrays hold the same values bit for bit
+    auto sameBytes = [] (std::vector<tinyobj::real_t> const & a, std::vector<tinyobj::real_t> const & b) {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0);
+    };
+
+    auto same = [sameBytes] (Result const & a, Result const & b) {
+        if (!sameBytes(a.attrib.vertices, b.attrib.vertices) ||
+            !sameBytes(a.attrib.normals, b.attrib.normals) ||
+            !sameBytes(a.attrib.texcoords, b.attrib.texcoords) ||
+            !sameBytes(a.attrib.colors, b.attrib.colors) ||
+            a.shapes.size() != b.shapes.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.shapes.size(); ++i)
+        {
+            auto const & x = a.shapes[i].mesh;
+            auto const & y = b.shapes[i].mesh;
+            if (a.shapes[i].name != b.shapes[i].name ||
+                x.num_face_vertices != y.num_face_vertices ||
+                x.material_ids != y.material_ids ||
+                !std::equal(x.indices.begin(), x.indices.end(), y.indices.begin(), y.indices.end(),
+                            [] (tinyobj::index_t const & p, tinyobj::index_t const & q) {
+                                return p.vertex_index == q.vertex_index &&
+                                       p.normal_index == q.normal_index &&
+                                       p.texcoord_index == q.texcoord_index;
+                            }))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    unsigned maxThreads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    std::ifstream file(options.modelPath, std::ios::binary | std::ios::ate);
+    double        megabytes = (double)file.tellg() / (1024.0 * 1024.0);
+    file.close();
+
+    Result serial = load(0, false);
+    std::cout << options.modelPath << ", " << megabytes << " MiB" << std::endl;
+    std::cout << "    serial:     " << serial.milliseconds << " ms"
+              << ", " << megabytes * 1000.0 / serial.milliseconds << " MiB/s"
+              << std::endl;
+    for (unsigned threads = 1; threads <= maxThreads; ++threads)
+    {
+        Result parallel = load(threads, options.mmapPopulate);
+        std::cout << "    " << threads << " thread(s): " << parallel.milliseconds << " ms"
+                  << ", " << megabytes * 1000.0 / parallel.milliseconds << " MiB/s"
+                  << ", speedup " << serial.milliseconds / parallel.milliseconds;
+        if (!same(serial, parallel))
+            std::cout << ", RESULTS DIFFER";
+        std::cout << std::endl;
+    }
+
+    // Reading the file dominates when it is not in the page cache, so each way of reading it is timed cold and warm.
+    struct Reader
+    {
+        char const * name;
+        unsigned     threads;
+        bool         populate;
+    };
+    Reader const readers[] =
+    {
+        { "stream:          ", 0, false },
+        { "mapped:          ", 1, false },
+        { "mapped, populate:", 1, true }
+    };
+    std::cout << "    page cache, one thread:" << std::endl;
+    for (auto const & reader : readers)
+    {
+        std::cout << "        " << reader.name;
+        if (evictFromPageCache(path))
+            std::cout << " cold " << load(reader.threads, reader.populate).milliseconds << " ms,";
+        std::cout << " warm " << load(reader.threads, reader.populate).milliseconds << " ms" << std::endl;
+    }
+}
+
+// Times stb_image decoding the JPEG and PNG files in a directory from memory with its AVX2 kernels off and on, and
+// checks that the pixels are the same. The images are decoded to RGBA on the calling thread, as the texture loaders
+// decode each of them, and the best of a few passes is reported.
+void benchmarkDecode(Options const & options)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Format
+    {
+        char const *             name;
+        std::vector<std::string> paths;
+        std::vector<MappedFile>  files;
+    };
+    Format formats[] = { { "JPEG", {}, {} }, { "PNG", {}, {} } };
+
+    for (auto const & entry : std::filesystem::directory_iterator(options.benchmarkDecodePath))
+    {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [] (unsigned char c) {
+            return (char)std::tolower(c);
+        });
+        if (extension == ".jpg" || extension == ".jpeg")
+            formats[0].paths.push_back(entry.path().string());
+        else if (extension == ".png")
+            formats[1].paths.push_back(entry.path().string());
+    }
+    if (formats[0].paths.empty() && formats[1].paths.empty())
+        throw std::runtime_error("benchmarkDecode: no JPEG or PNG files in " + options.benchmarkDecodePath);
+
+    // The files are mapped, as the texture loaders map them. The first pass reads them in, so the best pass leaves out
+    // the disk.
+    for (auto & format : formats)
+    {
+        std::sort(format.paths.begin(), format.paths.end());
+        format.files.resize(format.paths.size());
+        for (size_t i = 0; i < format.paths.size(); ++i)
+        {
+            if (!format.files[i].open(format.paths[i].c_str()))
+                throw std::runtime_error("benchmarkDecode: failed to open " + format.paths[i]);
+        }
+    }
+
+    // Decodes every file of a format, and returns the time taken and the pixels decoded, with a hash of the pixels
+    struct Pass
+    {
+        double   milliseconds = 0.0;
+        uint64_t pixels       = 0;
+        uint64_t hash         = 0;
+    };
+    auto decode = [] (Format const & format) {
+        Pass pass;
+        for (size_t i = 0; i < format.files.size(); ++i)
+        {
+            MappedFile const & file = format.files[i];
+            int width, height, channels;
+            auto start = Clock::now();
+            stbi_uc * pixels = stbi_load_from_memory(reinterpret_cast<stbi_uc const *>(file.data()),
+                                                     (int)file.size(),
+                                                     &width,
+                                                     &height,
+                                                     &channels,
+                                                     STBI_rgb_alpha);
+            pass.milliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (!pixels)
+            {
+                std::cerr << "benchmarkDecode: warning: failed to decode " << format.paths[i] << ": "
+                          << stbi_failure_reason() << std::endl;
+                continue;
+            }
+            pass.pixels += (uint64_t)width * height;
+            pass.hash = pass.hash * 31 + MeshCache::hash(pixels, (size_t)width * height * 4);
+            stbi_image_free(pixels);
+        }
+        return pass;
+    };
+    auto best = [&decode] (Format const & format) {
+        Pass result = decode(format);
+        for (int i = 1; i < 3; ++i)
+        {
+            Pass pass = decode(format);
+            result.milliseconds = std::min(result.milliseconds, pass.milliseconds);
+        }
+        return result;
+    };
+
+    std::cout << options.benchmarkDecodePath << std::endl;
+    for (auto const & format : formats)
+    {
+        if (format.files.empty())
+            continue;
+
+        stbi_set_use_avx2(false);
+        Pass off = best(format);
+        std::cout << "    " << format.name << ", " << format.files.size() << " file(s), " << off.pixels / 1.0e6
+                  << " Mpx" << std::endl;
+        std::cout << "        AVX2 off: " << off.milliseconds << " ms"
+                  << ", " << off.pixels / (off.milliseconds * 1000.0) << " Mpx/s" << std::endl;
+        if (!stbi_set_use_avx2(true))
+        {
+            std::cout << "        AVX2 on:  not available" << std::endl;
+            continue;
+        }
+        Pass on = best(format);
+        std::cout << "        AVX2 on:  " << on.milliseconds << " ms"
+                  << ", " << on.pixels / (on.milliseconds * 1000.0) << " Mpx/s"
+                  << ", speedup " << off.milliseconds / on.milliseconds;
+        if (on.pixels != off.pixels || on.hash != off.hash)
+            std::cout << ", RESULTS DIFFER";
+        std::cout << std::endl;
+    }
+    stbi_set_use_avx2(true);
+}
+
+// Sets the filter named by a --mip-filter argument. Returns false if the name is not recognized.
+bool parseMipFilter(std::string const & name, MipFilter & filter)
+{
+    if (name == "box")
+        filter = MipFilter::eBox;
+    else if (name == "kaiser")
+        filter = MipFilter::eKaiser;
+    else if (name == "lanczos")
+        filter = MipFilter::eLanczos;
+    else
+        return false;
+    return true;
+}
+
+// Sets the quality named by a --compression-quality argument. Returns false if the name is not recognized.
+bool parseCompressionQuality(std::string const & name, CompressionQuality & quality)
+{
+    if (name == "fast")
+        quality = CompressionQuality::eFast;
+    else if (name == "normal")
+        quality = CompressionQuality::eNormal;
+    else if (name == "best")
+        quality = CompressionQuality::eBest;
+    else
+        return false;
+    return true;
+}
+
+// Sets the number of frames in flight from a --frames-in-flight argument. Returns false if it is not a number from 1
+// to MAX_FRAMES_IN_FLIGHT.
+bool parseFramesInFlight(std::string const & text, unsigned & frames)
+{
+    char *        end;
+    unsigned long value = std::strtoul(text.c_str(), &end, 10);
+    if (*end != '\0' || value < 1 || value > MAX_FRAMES_IN_FLIGHT)
+        return false;
+    frames = (unsigned)value;
+    return true;
+}
+
+// Sets a thread count from a --threads or --record-threads argument. Returns false if it is not a whole number.
+bool parseThreadCount(std::string const & text, unsigned & threads)
 {
-    Glfwx::Instance glfwx;
+    char *        end;
+    unsigned long value = std::strtoul(text.c_str(), &end, 10);
+    if (text.empty() || !std::isdigit((unsigned char)text[0]) || *end != '\0' ||
+        value > std::numeric_limits<unsigned>::max())
+    {
+        return false;
+    }
+    threads = (unsigned)value;
+    return true;
+}
+
+// Sets the level of detail threshold from a --lod-threshold argument. Returns false if it is not a number of pixels
+// that is 0 or more.
+bool parseLodThreshold(std::string const & text, float & threshold)
+{
+    char * end;
+    float  value = std::strtof(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !(value >= 0.0f) || value == std::numeric_limits<float>::infinity())
+        return false;
+    threshold = value;
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--model" && i + 1 < argc)
+        {
+            options.modelPath = argv[++i];
+        }
+        else if (arg == "--threads" && i + 1 < argc && parseThreadCount(argv[i + 1], options.threads))
+        {
+            ++i;
+        }
+        else if (arg == "--no-streaming-load")
+        {
+            options.streamingLoad = false;
+        }
+        else if (arg == "--mmap-populate")
+        {
+            options.mmapPopulate = true;
+        }
+        else if (arg == "--no-fetch-optimization")
+        {
+            options.optimizeVertexFetch = false;
+        }
+        else if (arg == "--compact-vertices")
+        {
+            options.compactVertices = true;
+        }
+        else if (arg == "--no-cluster-culling")
+        {
+            options.clusterCulling = false;
+        }
+        else if (arg == "--lod-threshold" && i + 1 < argc && parseLodThreshold(argv[i + 1], options.lodThreshold))
+        {
+            ++i;
+        }
+        else if (arg == "--no-async-load")
+        {
+            options.asyncLoad = false;
+        }
+        else if (arg == "--mip-filter" && i + 1 < argc && parseMipFilter(argv[i + 1], options.mipFilter))
+        {
+            ++i;
+        }
+        else if (arg == "--no-texture-compression")
+        {
+            options.compressTextures = false;
+        }
+        else if (arg == "--compression-quality" && i + 1 < argc &&
+                 parseCompressionQuality(argv[i + 1], options.compressionQuality))
+        {
+            ++i;
+        }
+        else if (arg == "--virtual-textures")
+        {
+            options.virtualTextures = true;
+        }
+        else if (arg == "--pipeline-cache" && i + 1 < argc)
+        {
+            options.pipelineCachePath = argv[++i];
+        }
+        else if (arg == "--frames-in-flight" && i + 1 < argc && parseFramesInFlight(argv[i + 1], options.framesInFlight))
+        {
+            ++i;
+        }
+        else if (arg == "--record-threads" && i + 1 < argc && parseThreadCount(argv[i + 1], options.recordThreads))
+        {
+            ++i;
+        }
+        else if (arg == "--benchmark-load")
+        {
+            options.benchmarkLoad = true;
+        }
+        else if (arg == "--benchmark-decode" && i + 1 < argc)
+        {
+            options.benchmarkDecodePath = argv[++i];
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--model <path>]"
+                      << " [--threads <count>]"
+                      << " [--no-streaming-load]"
+                      << " [--mmap-populate]"
+                      << " [--no-fetch-optimization]"
+                      << " [--compact-vertices]"
+                      << " [--no-cluster-culling]"
+                      << " [--lod-threshold <pixels>]"
+                      << " [--no-async-load]"
+                      << " [--mip-filter <box|kaiser|lanczos>]"
+                      << " [--no-texture-compression]"
+                      << " [--compression-quality <fast|normal|best>]"
+                      << " [--virtual-textures]"
+                      << " [--pipeline-cache <path>]"
+                      << " [--frames-in-flight <1-4>]"
+                      << " [--record-threads <count>]"
+                      << " [--benchmark-load]"
+                      << " [--benchmark-decode <dir>]"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    stbi_set_parallel_for(parallelDecode, nullptr);
+
     try
     {
-        HelloTriangleApplication app;
+        if (options.benchmarkLoad)
+        {
+            benchmarkLoad(options);
+            return EXIT_SUCCESS;
+        }
+        if (!options.benchmarkDecodePath.empty())
+        {
+            benchmarkDecode(options);
+            return EXIT_SUCCESS;
+        }
+
+        Glfwx::Instance glfwx;
+        HelloTriangleApplication app(options);
         app.run();
     }
     catch (const std::exception & e)